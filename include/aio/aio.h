@@ -0,0 +1,500 @@
+#ifndef AIO_H
+#define AIO_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__has_include) && !defined(AIO_NO_URING)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define AIO_URING 1
+#endif
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+using namespace std;
+
+// Sequential file writer that never waits for the disk while a staging buffer is free.
+//
+// write() copies into one of AIO_BUFFERS aligned buffers; a full buffer is handed to
+// the kernel through io_uring (with the buffers registered once, so no page pinning per
+// write) or, where io_uring is unavailable or stops working, to a writer thread using
+// pwrite.  The caller only blocks when every buffer is still in flight, i.e. when the
+// disk is slower than the producer for more than AIO_BUFFERS * bufferBytes.
+//
+// With `direct` the file is opened O_DIRECT, bypassing the page cache; the partial last
+// block is written zero padded and the file truncated to its real size on close().  If
+// the file system refuses O_DIRECT the file is silently opened buffered.
+
+const size_t AIO_ALIGNMENT = 4096;
+const size_t AIO_BUFFER_BYTES = 4 << 20;
+const int AIO_BUFFERS = 2;
+
+bool pwriteAll(int fd, const char *data, size_t size, uint64_t offset)
+{
+    while (size > 0)
+    {
+        ssize_t n = pwrite(fd, data, size, offset);
+        if (n <= 0) return false;
+        data += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+class AsyncFile
+{
+public:
+    AsyncFile();
+    ~AsyncFile();
+
+    // `truncate` false appends to an existing file
+    bool open(const string &path, bool truncate = true, bool direct = false, size_t bufferBytes = AIO_BUFFER_BYTES);
+    bool isOpen();
+    bool isDirect();
+    bool usesUring();
+    // bytes written so far, including those still buffered
+    uint64_t tell();
+
+    // returns false once any write failed
+    bool write(const void *data, size_t size);
+    // writes out the buffered bytes and waits until the kernel has them
+    bool flush();
+    // flush and fsync, the file then holds exactly tell() bytes
+    bool sync();
+    bool close();
+
+private:
+    struct Request
+    {
+        uint64_t offset;
+        size_t size;
+    };
+
+    int mFd = -1;
+    bool mDirect = false;
+    size_t mBufferBytes = 0;
+    char *mBuffers[AIO_BUFFERS];
+    Request mRequests[AIO_BUFFERS];
+    bool mBusy[AIO_BUFFERS];
+    int mCurrent = 0;
+    size_t mFill = 0;
+    uint64_t mBase = 0;   // file offset of the current buffer
+    atomic<bool> mFailed;
+
+    // io_uring, mapped rings
+    int mRing = -1;
+    bool mRegistered = false;
+    void *mSqMap = NULL;
+    void *mCqMap = NULL;
+    void *mSqes = NULL;
+    size_t mSqMapSize = 0;
+    size_t mCqMapSize = 0;
+    size_t mSqesSize = 0;
+    unsigned *mSqTail, *mSqMask, *mSqArray;
+    unsigned *mCqHead, *mCqTail, *mCqMask;
+    void *mCqes;
+    struct iovec mIovecs[AIO_BUFFERS];
+
+    // fallback writer thread
+    thread mWriter;
+    mutex mMutex;
+    condition_variable mQueued;
+    condition_variable mDone;
+    deque<int> mQueue;
+    bool mStop = false;
+
+    void submit(size_t keep);
+    void issue(int buffer);
+    void wait(int buffer);
+    void complete(int buffer, long long result);
+    bool setupRing();
+    void closeRing();
+    bool reap(bool block);
+    void fallBack();
+    void writer();
+};
+
+AsyncFile::AsyncFile()
+{
+    mFailed = false;
+    for (int b = 0; b < AIO_BUFFERS; b++)
+    {
+        mBuffers[b] = NULL;
+        mBusy[b] = false;
+    }
+}
+
+AsyncFile::~AsyncFile()
+{
+    close();
+}
+
+bool AsyncFile::open(const string &path, bool truncate, bool direct, size_t bufferBytes)
+{
+    close();
+    mBufferBytes = max(AIO_ALIGNMENT, (bufferBytes + AIO_ALIGNMENT - 1) / AIO_ALIGNMENT * AIO_ALIGNMENT);
+
+    // read access for the partial block an O_DIRECT append starts with
+    int flags = O_RDWR | O_CREAT | (truncate ? O_TRUNC : 0);
+    mDirect = false;
+#ifdef O_DIRECT
+    if (direct)
+    {
+        mFd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+        mDirect = mFd >= 0;
+    }
+#endif
+    if (mFd < 0) mFd = ::open(path.c_str(), flags, 0644);
+    if (mFd < 0) return false;
+
+    for (int b = 0; b < AIO_BUFFERS; b++)
+    {
+        void *buffer = NULL;
+        if (posix_memalign(&buffer, AIO_ALIGNMENT, mBufferBytes) != 0)
+        {
+            close();
+            return false;
+        }
+        mBuffers[b] = (char *)buffer;
+        mBusy[b] = false;
+    }
+
+    struct stat info;
+    uint64_t end = 0;
+    if (!truncate && fstat(mFd, &info) == 0) end = info.st_size;
+    mBase = mDirect ? end / AIO_ALIGNMENT * AIO_ALIGNMENT : end;
+    mCurrent = 0;
+    mFailed = false;
+    if (end > mBase && pread(mFd, mBuffers[0], AIO_ALIGNMENT, mBase) != (ssize_t)(end - mBase))
+    {
+        close();
+        return false;
+    }
+    mFill = end - mBase;
+
+    if (!setupRing())
+    {
+        mStop = false;
+        mWriter = thread(&AsyncFile::writer, this);
+    }
+    return true;
+}
+
+bool AsyncFile::isOpen()
+{
+    return mFd >= 0;
+}
+
+bool AsyncFile::isDirect()
+{
+    return mDirect;
+}
+
+bool AsyncFile::usesUring()
+{
+    return mRing >= 0;
+}
+
+uint64_t AsyncFile::tell()
+{
+    return mBase + mFill;
+}
+
+bool AsyncFile::write(const void *data, size_t size)
+{
+    if (mFd < 0) return false;
+    const char *p = (const char *)data;
+    while (size > 0)
+    {
+        size_t n = min(size, mBufferBytes - mFill);
+        memcpy(mBuffers[mCurrent] + mFill, p, n);
+        mFill += n;
+        p += n;
+        size -= n;
+        if (mFill == mBufferBytes) submit(0);
+    }
+    return !mFailed;
+}
+
+// Hands the current buffer over and moves on to the next one.  In direct mode the
+// trailing `keep` bytes of a partial block start the next buffer again, the block is
+// then rewritten, so callers with keep > 0 must wait for completion first.
+void AsyncFile::submit(size_t keep)
+{
+    size_t size = mFill;
+    if (mDirect && mFill % AIO_ALIGNMENT)
+    {
+        size = (mFill + AIO_ALIGNMENT - 1) / AIO_ALIGNMENT * AIO_ALIGNMENT;
+        memset(mBuffers[mCurrent] + mFill, 0, size - mFill);
+    }
+    mRequests[mCurrent].offset = mBase;
+    mRequests[mCurrent].size = size;
+    issue(mCurrent);
+
+    int next = (mCurrent + 1) % AIO_BUFFERS;
+    wait(next);
+    if (keep) memcpy(mBuffers[next], mBuffers[mCurrent] + mFill - keep, keep);
+    mBase += mFill - keep;
+    mFill = keep;
+    mCurrent = next;
+}
+
+bool AsyncFile::flush()
+{
+    if (mFd < 0) return false;
+    size_t keep = mDirect ? mFill % AIO_ALIGNMENT : 0;
+    if (mFill > 0) submit(keep);
+    for (int b = 0; b < AIO_BUFFERS; b++)
+        wait(b);
+    return !mFailed;
+}
+
+bool AsyncFile::sync()
+{
+    if (!flush()) return false;
+    if (mDirect && ftruncate(mFd, tell()) != 0) return false;
+    return fsync(mFd) == 0;
+}
+
+bool AsyncFile::close()
+{
+    if (mFd < 0) return false;
+    bool ok = flush();
+    if (mDirect) ok = ftruncate(mFd, tell()) == 0 && ok;
+
+    if (mRing >= 0) closeRing();
+    if (mWriter.joinable())
+    {
+        {
+            lock_guard<mutex> lock(mMutex);
+            mStop = true;
+        }
+        mQueued.notify_one();
+        mWriter.join();
+    }
+    ok = ::close(mFd) == 0 && ok;
+    mFd = -1;
+    mBase = 0;
+    mFill = 0;
+    for (int b = 0; b < AIO_BUFFERS; b++)
+    {
+        free(mBuffers[b]);
+        mBuffers[b] = NULL;
+    }
+    return ok;
+}
+
+void AsyncFile::issue(int buffer)
+{
+    {
+        lock_guard<mutex> lock(mMutex);
+        mBusy[buffer] = true;
+    }
+#ifdef AIO_URING
+    if (mRing >= 0)
+    {
+        unsigned tail = *mSqTail;
+        unsigned index = tail & *mSqMask;
+        io_uring_sqe *sqe = (io_uring_sqe *)mSqes + index;
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->fd = mFd;
+        sqe->off = mRequests[buffer].offset;
+        sqe->user_data = buffer;
+        if (mRegistered)
+        {
+            sqe->opcode = IORING_OP_WRITE_FIXED;
+            sqe->addr = (uint64_t)(uintptr_t)mBuffers[buffer];
+            sqe->len = mRequests[buffer].size;
+            sqe->buf_index = buffer;
+        }
+        else
+        {
+            mIovecs[buffer].iov_base = mBuffers[buffer];
+            mIovecs[buffer].iov_len = mRequests[buffer].size;
+            sqe->opcode = IORING_OP_WRITEV;
+            sqe->addr = (uint64_t)(uintptr_t)&mIovecs[buffer];
+            sqe->len = 1;
+        }
+        mSqArray[index] = index;
+        // once published the entry belongs to the kernel, it is never taken back
+        __atomic_store_n(mSqTail, tail + 1, __ATOMIC_RELEASE);
+        while (syscall(__NR_io_uring_enter, mRing, 1, 0, 0, NULL, 0) < 0)
+        {
+            if (errno == EINTR) continue;
+            // out of resources or completions to reap, try again with room made
+            if ((errno == EAGAIN || errno == EBUSY) && reap(false)) continue;
+            fallBack();
+            break;
+        }
+        return;
+    }
+#endif
+    {
+        lock_guard<mutex> lock(mMutex);
+        mQueue.push_back(buffer);
+    }
+    mQueued.notify_one();
+}
+
+void AsyncFile::wait(int buffer)
+{
+    if (mRing >= 0)
+    {
+        while (mBusy[buffer])
+            if (!reap(true))
+            {
+                fallBack();
+                break;
+            }
+        if (mRing >= 0) return;
+    }
+    unique_lock<mutex> lock(mMutex);
+    mDone.wait(lock, [&] { return !mBusy[buffer]; });
+}
+
+// a short write (rare, e.g. on a full disk) is finished synchronously
+void AsyncFile::complete(int buffer, long long result)
+{
+    Request &r = mRequests[buffer];
+    bool ok = result >= 0;
+    if (ok && (size_t)result < r.size)
+        ok = pwriteAll(mFd, mBuffers[buffer] + result, r.size - result, r.offset + result);
+    if (!ok) mFailed = true;
+    {
+        lock_guard<mutex> lock(mMutex);
+        mBusy[buffer] = false;
+    }
+    mDone.notify_all();
+}
+
+bool AsyncFile::setupRing()
+{
+#ifdef AIO_URING
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int ring = syscall(__NR_io_uring_setup, 2 * AIO_BUFFERS, &params);
+    if (ring < 0) return false;
+    mRing = ring;
+
+    mSqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    mCqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) mSqMapSize = mCqMapSize = max(mSqMapSize, mCqMapSize);
+    mSqMap = mmap(NULL, mSqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+    mCqMap = single ? mSqMap : mmap(NULL, mCqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+    mSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    mSqes = mmap(NULL, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+    if (mSqMap == MAP_FAILED || mCqMap == MAP_FAILED || mSqes == MAP_FAILED)
+    {
+        if (mSqMap == MAP_FAILED) mSqMap = NULL;
+        if (mCqMap == MAP_FAILED) mCqMap = NULL;
+        if (mSqes == MAP_FAILED) mSqes = NULL;
+        closeRing();
+        return false;
+    }
+
+    char *sq = (char *)mSqMap, *cq = (char *)mCqMap;
+    mSqTail = (unsigned *)(sq + params.sq_off.tail);
+    mSqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+    mSqArray = (unsigned *)(sq + params.sq_off.array);
+    mCqHead = (unsigned *)(cq + params.cq_off.head);
+    mCqTail = (unsigned *)(cq + params.cq_off.tail);
+    mCqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+    mCqes = cq + params.cq_off.cqes;
+
+    // registration can fail on the locked memory limit, plain writev works regardless
+    for (int b = 0; b < AIO_BUFFERS; b++)
+    {
+        mIovecs[b].iov_base = mBuffers[b];
+        mIovecs[b].iov_len = mBufferBytes;
+    }
+    mRegistered = syscall(__NR_io_uring_register, ring, IORING_REGISTER_BUFFERS, mIovecs, AIO_BUFFERS) == 0;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AsyncFile::closeRing()
+{
+    if (mSqes) munmap(mSqes, mSqesSize);
+    if (mCqMap && mCqMap != mSqMap) munmap(mCqMap, mCqMapSize);
+    if (mSqMap) munmap(mSqMap, mSqMapSize);
+    mSqMap = mCqMap = mSqes = NULL;
+    // closing the ring releases the registered buffers
+    ::close(mRing);
+    mRing = -1;
+    mRegistered = false;
+}
+
+// false if the ring cannot be waited on any more
+bool AsyncFile::reap(bool block)
+{
+#ifdef AIO_URING
+    if (block)
+        while (syscall(__NR_io_uring_enter, mRing, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0)
+            if (errno != EINTR) return false;
+    unsigned head = *mCqHead;
+    unsigned tail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++)
+    {
+        io_uring_cqe *cqe = (io_uring_cqe *)mCqes + (head & *mCqMask);
+        complete(cqe->user_data, cqe->res);
+    }
+    __atomic_store_n(mCqHead, head, __ATOMIC_RELEASE);
+#endif
+    return true;
+}
+
+// For good after io_uring failed: the writes it finished are collected, the ring is
+// closed and the buffers still in flight are written again here, the same bytes at the
+// same offsets, so it does not matter whether the kernel got to them.  The writer thread
+// takes the rest.
+void AsyncFile::fallBack()
+{
+    reap(false);
+    closeRing();
+    for (int b = 0; b < AIO_BUFFERS; b++)
+    {
+        if (!mBusy[b]) continue;
+        Request &r = mRequests[b];
+        complete(b, pwriteAll(mFd, mBuffers[b], r.size, r.offset) ? (long long)r.size : -1);
+    }
+    mStop = false;
+    mWriter = thread(&AsyncFile::writer, this);
+}
+
+void AsyncFile::writer()
+{
+    while (true)
+    {
+        int buffer;
+        {
+            unique_lock<mutex> lock(mMutex);
+            mQueued.wait(lock, [this] { return mStop || !mQueue.empty(); });
+            if (mQueue.empty()) return;
+            buffer = mQueue.front();
+            mQueue.pop_front();
+        }
+        Request &r = mRequests[buffer];
+        complete(buffer, pwriteAll(mFd, mBuffers[buffer], r.size, r.offset) ? (long long)r.size : -1);
+    }
+}
+
+#endif
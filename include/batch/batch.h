@@ -0,0 +1,293 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <body/body.h>
+#include <ensemble/ensemble.h>
+
+#include <cmath>
+#include <vector>
+using namespace std;
+
+// Integrates W independent systems with the same number of bodies at once, one system
+// per lane.  State is stored [body][component][lane], so each statement of the
+// integrator is a loop over W contiguous lanes that the compiler emits as SIMD.
+// The scheme is the one of BodySystem::update: bodies are advanced one after another
+// and each sees the already advanced positions of the bodies before it.
+//
+// A lane retires on collision, escape (see findEscaper) or timeout; retired lanes are
+// frozen by a zero time step and can be refilled with a new system by setLane.
+template <int W>
+class BatchSystem
+{
+public:
+    BatchSystem(int n);
+    ~BatchSystem();
+
+    void config(double t, double steps);
+    void limits(double maxTime, double escapeRadius);
+    void setLane(int lane, vector<Body> bodies);
+    void update();
+
+    bool isActive(int lane);
+    int getActiveCount();
+    int getOutcome(int lane);
+    double getTime(int lane);
+    // escaping body or, for collisions, the smaller index of the colliding pair
+    int getBody(int lane);
+
+private:
+    int mN;
+    vector<double> mMass, mRadius;                  // [body][lane]
+    vector<double> mPos, mVel, mAcc;                // [body][xyz][lane]
+    double mMask[W];                                // 1.0 while the lane runs
+    double mTime[W];
+    int mOutcome[W];
+    int mBody[W];
+    double mT = 0.01;
+    double mSteps = 100;
+    double mMaxTime = 1000.0;
+    double mEscapeRadius = 100.0;
+
+    double *pos(int body, int c) { return &mPos[(body * 3 + c) * W]; }
+    double *vel(int body, int c) { return &mVel[(body * 3 + c) * W]; }
+    double *acc(int body, int c) { return &mAcc[(body * 3 + c) * W]; }
+    void retire(int lane, int outcome, int body);
+    void checkCollisions();
+    void checkEscapes();
+};
+
+template <int W>
+BatchSystem<W>::BatchSystem(int n)
+{
+    mN = n;
+    mMass.assign(n * W, 0.0);
+    mRadius.assign(n * W, 0.0);
+    mPos.assign(n * 3 * W, 0.0);
+    mVel.assign(n * 3 * W, 0.0);
+    mAcc.assign(n * 3 * W, 0.0);
+
+    // idle lanes hold massless, well separated bodies so they never produce inf or NaN
+    for (int i = 0; i < n; i++)
+        for (int l = 0; l < W; l++)
+            pos(i, 0)[l] = 1000.0 * i;
+    for (int l = 0; l < W; l++)
+    {
+        mMask[l] = 0.0;
+        mTime[l] = 0.0;
+        mOutcome[l] = RUN_TIMEOUT;
+        mBody[l] = -1;
+    }
+}
+
+template <int W>
+BatchSystem<W>::~BatchSystem() {}
+
+template <int W>
+void BatchSystem<W>::config(double t, double steps)
+{
+    mT = t;
+    mSteps = steps;
+}
+
+template <int W>
+void BatchSystem<W>::limits(double maxTime, double escapeRadius)
+{
+    mMaxTime = maxTime;
+    mEscapeRadius = escapeRadius;
+}
+
+template <int W>
+void BatchSystem<W>::setLane(int lane, vector<Body> bodies)
+{
+    for (int i = 0; i < mN; i++)
+    {
+        mMass[i * W + lane] = bodies[i].getMass();
+        mRadius[i * W + lane] = bodies[i].getRadius();
+        for (int c = 0; c < 3; c++)
+        {
+            pos(i, c)[lane] = bodies[i].getPosition()[c];
+            vel(i, c)[lane] = bodies[i].getVelocity()[c];
+            acc(i, c)[lane] = bodies[i].getAcceleration()[c];
+        }
+    }
+    mMask[lane] = 1.0;
+    mTime[lane] = 0.0;
+    mOutcome[lane] = RUN_TIMEOUT;
+    mBody[lane] = -1;
+}
+
+template <int W>
+void BatchSystem<W>::retire(int lane, int outcome, int body)
+{
+    mMask[lane] = 0.0;
+    mOutcome[lane] = outcome;
+    mBody[lane] = body;
+}
+
+template <int W>
+void BatchSystem<W>::checkCollisions()
+{
+    for (int p = 0; p + 1 < mN; p++)
+    {
+        for (int q = p + 1; q < mN; q++)
+        {
+            double hit[W];
+            for (int l = 0; l < W; l++)
+            {
+                double dx = pos(p, 0)[l] - pos(q, 0)[l];
+                double dy = pos(p, 1)[l] - pos(q, 1)[l];
+                double dz = pos(p, 2)[l] - pos(q, 2)[l];
+                double r = mRadius[p * W + l] + mRadius[q * W + l];
+                hit[l] = (dx * dx + dy * dy + dz * dz < r * r) ? mMask[l] : 0.0;
+            }
+            for (int l = 0; l < W; l++)
+                if (hit[l] != 0.0) retire(l, RUN_COLLISION, p);
+        }
+    }
+}
+
+template <int W>
+void BatchSystem<W>::update()
+{
+    double dt = mT / mSteps;
+    for (int j = 0; j < mSteps; j++)
+    {
+        checkCollisions();
+
+        double h[W];
+        for (int l = 0; l < W; l++)
+            h[l] = dt * mMask[l];
+
+        for (int i = 0; i < mN; i++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                double *x = pos(i, c), *v = vel(i, c), *a = acc(i, c);
+                for (int l = 0; l < W; l++)
+                {
+                    x[l] += v[l] * h[l] + 0.5 * a[l] * h[l] * h[l];
+                    v[l] += a[l] * h[l];
+                    a[l] = 0.0;
+                }
+            }
+
+            double *ax = acc(i, 0), *ay = acc(i, 1), *az = acc(i, 2);
+            const double *xi = pos(i, 0), *yi = pos(i, 1), *zi = pos(i, 2);
+            for (int k = 0; k < mN; k++)
+            {
+                if (k == i) continue;
+                const double *xk = pos(k, 0), *yk = pos(k, 1), *zk = pos(k, 2);
+                const double *mk = &mMass[k * W];
+                for (int l = 0; l < W; l++)
+                {
+                    double dx = xk[l] - xi[l];
+                    double dy = yk[l] - yi[l];
+                    double dz = zk[l] - zi[l];
+                    double d2 = dx * dx + dy * dy + dz * dz;
+                    double s = mk[l] / (d2 * sqrt(d2));
+                    ax[l] += dx * s;
+                    ay[l] += dy * s;
+                    az[l] += dz * s;
+                }
+            }
+            for (int l = 0; l < W; l++)
+            {
+                ax[l] *= G;
+                ay[l] *= G;
+                az[l] *= G;
+            }
+        }
+
+        for (int l = 0; l < W; l++)
+            mTime[l] += h[l];
+    }
+
+    checkEscapes();
+    for (int l = 0; l < W; l++)
+        if (mMask[l] != 0.0 && mTime[l] >= mMaxTime) retire(l, RUN_TIMEOUT, -1);
+}
+
+// lane-wise findEscaper
+template <int W>
+void BatchSystem<W>::checkEscapes()
+{
+    double M[W], R[3][W], P[3][W];
+    for (int l = 0; l < W; l++)
+    {
+        M[l] = 0.0;
+        for (int c = 0; c < 3; c++)
+            R[c][l] = P[c][l] = 0.0;
+    }
+    for (int i = 0; i < mN; i++)
+    {
+        const double *m = &mMass[i * W];
+        for (int l = 0; l < W; l++)
+            M[l] += m[l];
+        for (int c = 0; c < 3; c++)
+        {
+            const double *x = pos(i, c), *v = vel(i, c);
+            for (int l = 0; l < W; l++)
+            {
+                R[c][l] += m[l] * x[l];
+                P[c][l] += m[l] * v[l];
+            }
+        }
+    }
+
+    for (int i = 0; i < mN; i++)
+    {
+        const double *m = &mMass[i * W];
+        double escaping[W];
+        for (int l = 0; l < W; l++)
+        {
+            double rest = M[l] - m[l];
+            double r[3], v[3];
+            for (int c = 0; c < 3; c++)
+            {
+                r[c] = pos(i, c)[l] - (R[c][l] - m[l] * pos(i, c)[l]) / rest;
+                v[c] = vel(i, c)[l] - (P[c][l] - m[l] * vel(i, c)[l]) / rest;
+            }
+            double d = sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+            double radial = r[0] * v[0] + r[1] * v[1] + r[2] * v[2];
+            double energy = 0.5 * (v[0] * v[0] + v[1] * v[1] + v[2] * v[2]) - G * M[l] / d;
+            escaping[l] = (rest > 0.0 && d >= mEscapeRadius && radial > 0.0 && energy > 0.0) ? mMask[l] : 0.0;
+        }
+        for (int l = 0; l < W; l++)
+            if (escaping[l] != 0.0) retire(l, RUN_ESCAPE, i);
+    }
+}
+
+template <int W>
+bool BatchSystem<W>::isActive(int lane)
+{
+    return mMask[lane] != 0.0;
+}
+
+template <int W>
+int BatchSystem<W>::getActiveCount()
+{
+    int count = 0;
+    for (int l = 0; l < W; l++)
+        count += mMask[l] != 0.0;
+    return count;
+}
+
+template <int W>
+int BatchSystem<W>::getOutcome(int lane)
+{
+    return mOutcome[lane];
+}
+
+template <int W>
+double BatchSystem<W>::getTime(int lane)
+{
+    return mTime[lane];
+}
+
+template <int W>
+int BatchSystem<W>::getBody(int lane)
+{
+    return mBody[lane];
+}
+
+#endif
@@ -1,15 +1,28 @@
+#ifndef BODY_H
+#define BODY_H
+
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <pool/pool.h>
+#include <trail/trail.h>
+
+#include <atomic>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <cmath>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <vector>
 #include <iostream>
 using namespace std;
 
 const double G = 100.0;
 const int PATH_LENGTH = 500;
+const int REDUCE_LEAF = 256;
 
 double L2Norm(glm::dvec3 vec)
 {
@@ -32,12 +45,16 @@ public:
         glm::dvec3 acceleration = glm::dvec3(0.0));
     ~Body();
 
-    double getMass();
-    double getRadius();
-    glm::vec3 getColor();
-    glm::dvec3 getPosition();
+    double getMass() const;
+    double getRadius() const;
+    glm::vec3 getColor() const;
+    glm::dvec3 getPosition() const;
+    glm::dvec3 getVelocity() const;
+    glm::dvec3 getAcceleration() const;
+    void setAcceleration(glm::dvec3 acceleration);
 
-    void update(double dt, vector<Body> others);
+    void drift(double dt);
+    void update(double dt, const vector<Body> &bodies, int self);
     void info();
 
 private:
@@ -77,38 +94,65 @@ Body::Body(
 
 Body::~Body() {}
 
-double Body::getMass()
+double Body::getMass() const
 {
     return mMass;
 }
 
-double Body::getRadius()
+double Body::getRadius() const
 {
     return mRadius;
 }
 
-glm::vec3 Body::getColor()
+glm::vec3 Body::getColor() const
 {
     return mColor;
 }
 
-glm::dvec3 Body::getPosition()
+glm::dvec3 Body::getPosition() const
 {
     return mPosition;
 }
 
-void Body::update(double dt, vector<Body> others)
+glm::dvec3 Body::getVelocity() const
+{
+    return mVelocity;
+}
+
+glm::dvec3 Body::getAcceleration() const
+{
+    return mAcceleration;
+}
+
+void Body::setAcceleration(glm::dvec3 acceleration)
+{
+    mAcceleration = acceleration;
+}
+
+// advance position and velocity with the current acceleration
+void Body::drift(double dt)
 {
     mPosition += mVelocity * dt + 0.5 * mAcceleration * dt * dt;
     mVelocity += mAcceleration * dt;
+}
+
+// pulled by all `bodies` but `self`, summed in the order of a copy of `bodies` with the
+// last one moved into the place of `self`, as the serial scheme always did
+void Body::update(double dt, const vector<Body> &bodies, int self)
+{
+    drift(dt);
 
     
     // mAcceleration = G * (b2.getMass() * (b2.getPosition() - mPosition) / pow(L2Norm(b2.getPosition() - mPosition), 3)
     //     + b3.getMass() * (b3.getPosition() - mPosition) / pow(L2Norm(b3.getPosition() - mPosition), 3));
 
     mAcceleration = glm::dvec3(0.0);
-    for (auto body : others)
+    int last = bodies.size() - 1;
+    for (int k = 0; k < last; k++)
+    {
+        const Body &body = bodies[k == self ? last : k];
         mAcceleration += body.getMass() * (body.getPosition() - mPosition) / pow(L2Norm(body.getPosition() - mPosition), 3);
+    }
     
     mAcceleration *= G;
 }
@@ -118,43 +162,174 @@ void Body::info()
     cout << "(" << mPosition.x << ", " << mPosition.y << ", " << mPosition.z << ")" << endl;
 }
 
+// hash of the full state after `step` substeps
+struct StateHash
+{
+    long long step;
+    uint64_t hash;
+};
+
+// first recorded step at which two runs differ, -1 if all common records agree
+long long findDivergence(const vector<StateHash> &a, const vector<StateHash> &b)
+{
+    for (int i = 0, j = 0; i < a.size() && j < b.size();)
+    {
+        if (a[i].step < b[j].step) i++;
+        else if (b[j].step < a[i].step) j++;
+        else if (a[i].hash != b[j].hash) return a[i].step;
+        else i++, j++;
+    }
+    return -1;
+}
+
+// One stretch of the keyframe history with what it takes to integrate it again: the
+// snapshot it starts from and the time step of every later frame.
+struct HistorySegment
+{
+    long long frame;               // of the snapshot
+    bool collision;
+    bool parallel, deterministic;
+    vector<Body> bodies;
+    vector<glm::dvec2> configs;    // (t, steps) of each later frame
+};
+
+// Without parallel() bodies are advanced one after another, each seeing the already
+// advanced bodies before it.  With parallel() all bodies drift first and then all
+// accelerations are computed from the same positions, on a thread pool:
+//   deterministic: every body sums its own forces in index order and reductions use a
+//                  fixed tree over fixed leaves, so results are bitwise identical for
+//                  any thread count.
+//   fast:          each pair is evaluated once and applied to both bodies through
+//                  per-thread accumulators, so summation order follows scheduling.
+// The deterministic mode evaluates every pair twice; measured with one thread on 2000
+// bodies its force pass takes about 1.6x the fast one, and it is never slower than 2x.
+//
+// With keyframes() every update() is a frame of the history: a full snapshot is kept
+// every `every` frames, and in between the time step of each frame and the float offset
+// of every body from the last snapshot.  previewFrame() shows any kept frame from those
+// offsets without integrating; seekFrame() restores the snapshot before it and integrates
+// forward again with the recorded time steps, which reproduces the frame bit for bit.
+// Over the memory budget the offsets of the oldest frames go first, then old snapshots
+// are merged, so the whole run stays reachable, only with more integration per seek.  A
+// merged stretch never spans more frames than have passed since its end, so snapshots
+// thin out geometrically with age and never below a few per doubling of it, even if
+// that leaves the history over its budget.
+// Without offsets only the snapshots and time steps are kept, a few bytes per frame
+// whatever the number of bodies; getSegment() hands a stretch out for integrating
+// again elsewhere, e.g. to rebuild trails (see TrailRebuilder).
 class BodySystem
 {
 public:
-    BodySystem(vector<Body> bodies);
+    // without `recordPaths` no trail store is ever allocated, see recordPaths()
+    BodySystem(vector<Body> bodies, bool recordPaths = true);
     ~BodySystem();
     void config(double t, double steps);
-    void update();
+    void recordPaths(bool record);
+    void trailLength(size_t points);
+    void parallel(int threads, bool deterministic = true);
+    void hashEvery(int steps);
+    void keyframes(int every, size_t budget, bool offsets = true);
+    void abortWhen(function<bool()> abort);
+    // false if aborted
+    bool update();
 
     void info();
 
     vector<Body> getBodies();
-    vector<vector<glm::dvec3>> getPaths();
+    const TrailPyramid &getTrails();
+    double getTime();
+    bool hasCollided();
+    double getEnergy();
+    glm::dvec3 getMomentum();
+    uint64_t hashState();
+    vector<StateHash> getHashes();
+
+    // frames are counted by update()
+    long long getFrame();
+    long long getFirstFrame();
+    size_t getKeyframeBytes();
+    bool previewFrame(long long frame, vector<Body> &bodies);
+    bool seekFrame(long long frame);
+    int getKeyframeCount();
+    long long getKeyframeFrame(int index);
+    bool getSegment(int index, HistorySegment &segment);
 
 private:
+    friend class CheckpointIO;
+
     vector<Body> mBodies;
-    vector<vector<glm::dvec3>> mPaths;
+    TrailPyramid mTrails;            // of no bodies unless paths are recorded
+    TrailSampler mSampler;
+    size_t mTrailLength = PATH_LENGTH;
     double mT = 0.01;
     double mSteps = 100;
+    double mTime = 0.0;
+    bool mRecordPaths = true;
     bool isCollision = false;
+
+    shared_ptr<ThreadPool> mPool;
+    bool mDeterministic = true;
+    vector<glm::dvec3> mPositions;
+    vector<double> mMasses, mRadii;
+    vector<glm::dvec3> mAccumulators;   // fast mode, one row of bodies per thread
+    long long mStep = 0;
+    int mHashEvery = 0;
+    vector<StateHash> mHashes;
+    function<bool()> mAbort;
+
+    struct Keyframe
+    {
+        long long frame;
+        double time;
+        long long step;
+        bool collision;
+        vector<glm::dvec3> state;     // position, velocity, acceleration per body
+        vector<glm::dvec2> configs;   // (t, steps) of each later frame
+        vector<glm::vec3> offsets;    // [later frame][body] position - snapshot position
+    };
+    deque<Keyframe> mKeyframes;
+    long long mFrame = 0;
+    int mKeyEvery = 0;
+    size_t mKeyBudget = 0;
+    size_t mKeyBytes = 0;    // of all keyframes, kept as they change
+    bool mKeyOffsets = true;
+
+    bool advance();
+    void stepSerial(double dt);
+    void stepParallel(double dt);
+    static size_t keyframeBytes(const Keyframe &k);
+    void pushKeyframe();
+    void recordFrame();
+    bool evictKeyframes();
+    // trails of one point per body, where the bodies are
+    void startTrails();
+    template <typename T>
+    T reduce(function<T(int)> term);
 };
 
-BodySystem::BodySystem(vector<Body> bodies)
+BodySystem::BodySystem(vector<Body> bodies, bool recordPaths)
 {
     mBodies = bodies;
-    // for (auto body : mBodies)
-    // {
-    //     vector<glm::dvec3> p;
-    //     mPaths.push_back(p);
-    // }
-
-    // modified
-    vector<glm::dvec3> newPos;
-    for (auto body : mBodies)
+    mRecordPaths = recordPaths;
+    if (mRecordPaths) startTrails();
+}
+
+void BodySystem::startTrails()
+{
+    if (mTrails.getBodyCount() == mBodies.size() && mTrails.getCapacity() == mTrailLength)
     {
-        newPos.push_back(body.getPosition());
+        mTrails.clear();
     }
-    mPaths.push_back(newPos);
+    else
+    {
+        mTrails = TrailPyramid(mBodies.size(), mTrailLength);
+        mSampler = TrailSampler(mBodies.size());
+    }
+    for (int i = 0; i < mBodies.size(); i++)
+        mTrails.push(i, mBodies[i].getPosition());
+    mSampler.reset(mTrails);
+    for (int i = 0; i < mBodies.size(); i++)
+        mSampler.setDirection(i, mBodies[i].getVelocity());
 }
 
 BodySystem::~BodySystem() {}
@@ -165,61 +340,245 @@ void BodySystem::config(double t, double steps)
     mSteps = steps;
 }
 
-void BodySystem::update()
+// headless runs (e.g. the ensemble runner) have no use for the trajectory; stopping
+// frees the trails, starting again begins them where the bodies are
+void BodySystem::recordPaths(bool record)
+{
+    if (record == mRecordPaths) return;
+    mRecordPaths = record;
+    if (record)
+    {
+        startTrails();
+        return;
+    }
+    mTrails = TrailPyramid();
+    mSampler = TrailSampler();
+}
+
+// full-resolution points per body, PATH_LENGTH by default, also the size of every
+// coarser history level
+void BodySystem::trailLength(size_t points)
+{
+    mTrailLength = points;
+    if (mRecordPaths) mTrails.setCapacity(points);
+}
+
+// threads: 0 for the serial scheme, negative for one per hardware thread
+void BodySystem::parallel(int threads, bool deterministic)
+{
+    mPool = threads ? make_shared<ThreadPool>(threads) : shared_ptr<ThreadPool>();
+    mDeterministic = deterministic;
+}
+
+// record hashState() every `steps` substeps, 0 to stop
+void BodySystem::hashEvery(int steps)
+{
+    mHashEvery = steps;
+}
+
+// snapshot every `every` frames within `budget` bytes, 0 to stop; without `offsets`
+// previewFrame() interpolates between the snapshots around a frame
+void BodySystem::keyframes(int every, size_t budget, bool offsets)
+{
+    mKeyEvery = every;
+    mKeyBudget = budget;
+    mKeyOffsets = offsets;
+    mKeyframes.clear();
+    mKeyBytes = 0;
+    if (every > 0) pushKeyframe();
+}
+
+// Checked before every substep of update() and seekFrame(), which give up as soon as it
+// returns true, so a long frame does not hold up shutting down.  An aborted frame is left
+// partway, not counted and not recorded in the history: the system is only good to
+// be discarded.  nullptr to stop checking.
+void BodySystem::abortWhen(function<bool()> abort)
+{
+    mAbort = abort;
+}
+
+bool BodySystem::update()
+{
+    if (!advance()) return false;
+    mFrame++;
+    if (mKeyEvery > 0) recordFrame();
+    return true;
+}
+
+bool BodySystem::advance()
 {
     double dt = mT / mSteps;
     for (int j = 0; j < mSteps; j++)
     {
         if (isCollision) break;
-        for (int p = 0; p < mBodies.size() - 1; p++)
+        if (mAbort && mAbort()) return false;
+        if (mPool)
         {
-            if (isCollision) break;
-            glm::dvec3 pPosition = mBodies[p].getPosition();
-            double pRadius = mBodies[p].getRadius();
-            for (int q = p + 1; q < mBodies.size(); q++)
-            {
-                glm::dvec3 qPosition = mBodies[q].getPosition();
-                double qRadius = mBodies[q].getRadius();
-                if (L2Norm(pPosition - qPosition) < pRadius + qRadius)
-                {
-                    isCollision = true;
-                    break;
-                }
-            }
+            stepParallel(dt);
         }
+        else
+        {
+            stepSerial(dt);
+        }
+        mTime += dt;
+        mStep++;
+
+        if (mHashEvery > 0 && mStep % mHashEvery == 0)
+            mHashes.push_back({mStep, hashState()});
 
+        if (!mRecordPaths) continue;
+
+        // every body samples its own trail, where its path bends
+        for (int i = 0; i < mBodies.size(); i++)
+            mSampler.sample(i, mBodies[i].getPosition());
+        if (!mSampler.check()) continue;
         for (int i = 0; i < mBodies.size(); i++)
         {
-            vector<Body> others = mBodies;
-            others[i] = others.back();
-            others.pop_back();
-
-            mBodies[i].update(dt, others);
-            
-            // if (!mPaths[i].size() || L2Norm(mBodies[i].getPosition() - mPaths[i].back()) > 0.1)
-            //     mPaths[i].push_back(mBodies[i].getPosition());
+            if (!mSampler.flagged(i)) continue;
+            mTrails.push(i, mBodies[i].getPosition());
+            mSampler.accept(i, mBodies[i].getVelocity());
         }
+    }
+    return true;
+}
 
-        // modified
-        bool flag = false;
-        for (int i = 0; i < mBodies.size(); i++)
+void BodySystem::stepSerial(double dt)
+{
+    for (int p = 0; p < mBodies.size() - 1; p++)
+    {
+        if (isCollision) break;
+        glm::dvec3 pPosition = mBodies[p].getPosition();
+        double pRadius = mBodies[p].getRadius();
+        for (int q = p + 1; q < mBodies.size(); q++)
         {
-            if (L2Norm(mBodies[i].getPosition() - mPaths.back()[i]) > 0.1)
+            glm::dvec3 qPosition = mBodies[q].getPosition();
+            double qRadius = mBodies[q].getRadius();
+            if (L2Norm(pPosition - qPosition) < pRadius + qRadius)
             {
-                flag = true;
+                isCollision = true;
                 break;
             }
         }
-        if (flag)
+    }
+
+    for (int i = 0; i < mBodies.size(); i++)
+    {
+        // sees the bodies before it already advanced
+        mBodies[i].update(dt, mBodies, i);
+    }
+}
+
+// Collisions are detected in the force pass, i.e. on the positions the next substep
+// starts from, which are the positions the serial scheme checks.
+void BodySystem::stepParallel(double dt)
+{
+    int n = mBodies.size();
+    int threads = mPool->size();
+    mPositions.resize(n);
+    mMasses.resize(n);
+    mRadii.resize(n);
+
+    mPool->run([&](int t) {
+        for (int i = n * t / threads; i < n * (t + 1) / threads; i++)
         {
-            vector<glm::dvec3> newPos;
-            for (auto body : mBodies)
+            mBodies[i].drift(dt);
+            mPositions[i] = mBodies[i].getPosition();
+            mMasses[i] = mBodies[i].getMass();
+            mRadii[i] = mBodies[i].getRadius();
+        }
+    });
+
+    vector<char> hit(threads, 0);
+    if (mDeterministic)
+    {
+        mPool->run([&](int t) {
+            for (int i = n * t / threads; i < n * (t + 1) / threads; i++)
             {
-                newPos.push_back(body.getPosition());
+                glm::dvec3 acceleration(0.0);
+                for (int k = 0; k < n; k++)
+                {
+                    if (k == i) continue;
+                    glm::dvec3 d = mPositions[k] - mPositions[i];
+                    double d2 = glm::dot(d, d);
+                    double r = mRadii[i] + mRadii[k];
+                    if (d2 < r * r) hit[t] = 1;
+                    acceleration += mMasses[k] * d / (d2 * sqrt(d2));
+                }
+                mBodies[i].setAcceleration(G * acceleration);
             }
-            mPaths.push_back(newPos);
-        }
+        });
+    }
+    else
+    {
+        mAccumulators.assign(threads * n, glm::dvec3(0.0));
+        atomic<int> next(0);
+        mPool->run([&](int t) {
+            glm::dvec3 *acceleration = &mAccumulators[t * n];
+            for (int i = next++; i < n - 1; i = next++)
+            {
+                for (int k = i + 1; k < n; k++)
+                {
+                    glm::dvec3 d = mPositions[k] - mPositions[i];
+                    double d2 = glm::dot(d, d);
+                    double r = mRadii[i] + mRadii[k];
+                    if (d2 < r * r) hit[t] = 1;
+                    glm::dvec3 f = d / (d2 * sqrt(d2));
+                    acceleration[i] += mMasses[k] * f;
+                    acceleration[k] -= mMasses[i] * f;
+                }
+            }
+        });
+        mPool->run([&](int t) {
+            for (int i = n * t / threads; i < n * (t + 1) / threads; i++)
+            {
+                glm::dvec3 acceleration(0.0);
+                for (int u = 0; u < threads; u++)
+                    acceleration += mAccumulators[u * n + i];
+                mBodies[i].setAcceleration(G * acceleration);
+            }
+        });
+    }
+
+    for (int t = 0; t < threads; t++)
+        if (hit[t]) isCollision = true;
+}
+
+// Sum of term(i) over all bodies.  Outside the fast parallel mode the sum is taken over
+// fixed leaves of REDUCE_LEAF bodies combined in a fixed binary tree, so its rounding
+// does not depend on the number of threads.
+template <typename T>
+T BodySystem::reduce(function<T(int)> term)
+{
+    int n = mBodies.size();
+    int threads = mPool ? mPool->size() : 1;
+
+    if (mPool && !mDeterministic)
+    {
+        vector<T> partial(threads, T(0.0));
+        mPool->run([&](int t) {
+            for (int i = n * t / threads; i < n * (t + 1) / threads; i++)
+                partial[t] += term(i);
+        });
+        T sum(0.0);
+        for (auto &p : partial)
+            sum += p;
+        return sum;
     }
+
+    int leaves = max(1, (n + REDUCE_LEAF - 1) / REDUCE_LEAF);
+    vector<T> partial(leaves, T(0.0));
+    auto sumLeaves = [&](int t) {
+        for (int l = t; l < leaves; l += threads)
+            for (int i = l * REDUCE_LEAF; i < min(n, (l + 1) * REDUCE_LEAF); i++)
+                partial[l] += term(i);
+    };
+    if (mPool) mPool->run(sumLeaves);
+    else sumLeaves(0);
+
+    for (int width = 1; width < leaves; width *= 2)
+        for (int l = 0; l + width < leaves; l += 2 * width)
+            partial[l] += partial[l + width];
+    return partial[0];
 }
 
 void BodySystem::info()
@@ -233,19 +592,265 @@ vector<Body> BodySystem::getBodies()
     return mBodies;
 }
 
-vector<vector<glm::dvec3>> BodySystem::getPaths()
+double BodySystem::getTime()
+{
+    return mTime;
+}
+
+bool BodySystem::hasCollided()
+{
+    return isCollision;
+}
+
+double BodySystem::getEnergy()
+{
+    return reduce<double>([this](int i) {
+        double potential = 0.0;
+        glm::dvec3 p = mBodies[i].getPosition();
+        for (int k = 0; k < mBodies.size(); k++)
+            if (k != i) potential -= 0.5 * G * mBodies[k].getMass() / L2Norm(mBodies[k].getPosition() - p);
+        glm::dvec3 v = mBodies[i].getVelocity();
+        return mBodies[i].getMass() * (0.5 * glm::dot(v, v) + potential);
+    });
+}
+
+glm::dvec3 BodySystem::getMomentum()
 {
-    // return mPaths;
+    return reduce<glm::dvec3>([this](int i) {
+        return mBodies[i].getMass() * mBodies[i].getVelocity();
+    });
+}
 
-    // modified
-    if (mPaths.size() > PATH_LENGTH)
+// FNV-style hash of the bit patterns of all positions and velocities
+uint64_t BodySystem::hashState()
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (auto &body : mBodies)
     {
-        vector<vector<glm::dvec3>> rlt(mPaths.end() - PATH_LENGTH, mPaths.end());
-        return rlt;
+        double state[6];
+        glm::dvec3 p = body.getPosition(), v = body.getVelocity();
+        for (int c = 0; c < 3; c++)
+        {
+            state[c] = p[c];
+            state[3 + c] = v[c];
+        }
+        for (int c = 0; c < 6; c++)
+        {
+            uint64_t bits;
+            memcpy(&bits, &state[c], sizeof(bits));
+            hash = (hash ^ bits) * 0x100000001b3ULL;
+            hash ^= hash >> 29;
+        }
     }
-    else
+    return hash;
+}
+
+vector<StateHash> BodySystem::getHashes()
+{
+    return mHashes;
+}
+
+long long BodySystem::getFrame()
+{
+    return mFrame;
+}
+
+long long BodySystem::getFirstFrame()
+{
+    return mKeyframes.empty() ? mFrame : mKeyframes.front().frame;
+}
+
+size_t BodySystem::getKeyframeBytes()
+{
+    return mKeyBytes;
+}
+
+size_t BodySystem::keyframeBytes(const Keyframe &k)
+{
+    return k.state.size() * sizeof(glm::dvec3) + k.configs.size() * sizeof(glm::dvec2) + k.offsets.size() * sizeof(glm::vec3);
+}
+
+void BodySystem::pushKeyframe()
+{
+    Keyframe k;
+    k.frame = mFrame;
+    k.time = mTime;
+    k.step = mStep;
+    k.collision = isCollision;
+    k.state.reserve(3 * mBodies.size());
+    for (auto &body : mBodies)
     {
-        vector<vector<glm::dvec3>> rlt(mPaths);
-        return rlt;
+        k.state.push_back(body.getPosition());
+        k.state.push_back(body.getVelocity());
+        k.state.push_back(body.getAcceleration());
     }
-}
\ No newline at end of file
+    mKeyBytes += keyframeBytes(k);
+    mKeyframes.push_back(k);
+}
+
+// the frame that starts a new snapshot is recorded in the previous one as well, so two
+// snapshots can always be merged
+void BodySystem::recordFrame()
+{
+    Keyframe &k = mKeyframes.back();
+    k.configs.push_back(glm::dvec2(mT, mSteps));
+    mKeyBytes += sizeof(glm::dvec2);
+    for (int i = 0; mKeyOffsets && i < mBodies.size(); i++)
+        k.offsets.push_back(glm::vec3(mBodies[i].getPosition() - k.state[3 * i]));
+    if (mKeyOffsets) mKeyBytes += mBodies.size() * sizeof(glm::vec3);
+
+    if (mFrame - k.frame >= mKeyEvery) pushKeyframe();
+    while (mKeyBytes > mKeyBudget && evictKeyframes())
+        ;
+}
+
+// frees memory in the oldest part of the history, returns false if nothing is left to free
+bool BodySystem::evictKeyframes()
+{
+    int last = mKeyframes.size() - 1;
+    for (int i = 0; i < last; i++)
+    {
+        if (mKeyframes[i].offsets.empty()) continue;
+        mKeyBytes -= mKeyframes[i].offsets.size() * sizeof(glm::vec3);
+        vector<glm::vec3>().swap(mKeyframes[i].offsets);
+        return true;
+    }
+
+    // merge the two neighbours spanning the fewest frames, never dropping the newest and
+    // never spanning more than the frames since
+    int best = -1;
+    size_t span = 0;
+    for (int i = 0; i + 1 < last; i++)
+    {
+        size_t frames = mKeyframes[i].configs.size() + mKeyframes[i + 1].configs.size();
+        if ((long long)frames > mFrame - mKeyframes[i + 2].frame) continue;
+        if (best < 0 || frames < span)
+        {
+            best = i;
+            span = frames;
+        }
+    }
+    if (best < 0) return false;
+    Keyframe &k = mKeyframes[best];
+    k.configs.insert(k.configs.end(), mKeyframes[best + 1].configs.begin(), mKeyframes[best + 1].configs.end());
+    mKeyBytes -= mKeyframes[best + 1].state.size() * sizeof(glm::dvec3) + mKeyframes[best + 1].offsets.size() * sizeof(glm::vec3);
+    mKeyframes.erase(mKeyframes.begin() + best + 1);
+    return true;
+}
+
+// approximate bodies of a kept frame, from the offsets or else the snapshots around it
+bool BodySystem::previewFrame(long long frame, vector<Body> &bodies)
+{
+    if (mKeyframes.empty() || frame < getFirstFrame() || frame > mFrame) return false;
+    int last = mKeyframes.size() - 1, s = last;
+    while (mKeyframes[s].frame > frame)
+        s--;
+    Keyframe &k = mKeyframes[s];
+
+    size_t n = mBodies.size();
+    size_t row = frame - k.frame;
+    bool snapshot = row == 0 || k.offsets.size() < row * n;
+
+    // without offsets, the cubic Hermite curve to the next snapshot if there is one
+    Keyframe *next = snapshot && row > 0 && s < last ? &mKeyframes[s + 1] : nullptr;
+    double h = next ? next->time - k.time : 0.0, u = 0.0;
+    for (size_t j = 0; next && j < row; j++)
+        u += k.configs[j].x;
+    u = h > 0.0 ? min(u / h, 1.0) : 0.0;
+    double h00 = (1 + 2 * u) * (1 - u) * (1 - u), h10 = u * (1 - u) * (1 - u) * h;
+    double h01 = u * u * (3 - 2 * u), h11 = u * u * (u - 1) * h;
+
+    bodies.clear();
+    for (size_t i = 0; i < n; i++)
+    {
+        glm::dvec3 position = k.state[3 * i];
+        if (!snapshot) position += glm::dvec3(k.offsets[(row - 1) * n + i]);
+        if (next) position = h00 * position + h10 * k.state[3 * i + 1] + h01 * next->state[3 * i] + h11 * next->state[3 * i + 1];
+        Body &b = mBodies[i];
+        bodies.push_back(Body(b.getMass(), b.getRadius(), b.getColor(), position, k.state[3 * i + 1], k.state[3 * i + 2]));
+    }
+    return true;
+}
+
+// Goes back (or forward within the history) to `frame` exactly.  Later history is
+// dropped, the run continues from there.  False for a frame out of the history or if
+// aborted.
+bool BodySystem::seekFrame(long long frame)
+{
+    if (mKeyframes.empty() || frame < getFirstFrame() || frame > mFrame) return false;
+    while (mKeyframes.back().frame > frame)
+    {
+        mKeyBytes -= keyframeBytes(mKeyframes.back());
+        mKeyframes.pop_back();
+    }
+    Keyframe &k = mKeyframes.back();
+
+    for (int i = 0; i < mBodies.size(); i++)
+    {
+        Body &b = mBodies[i];
+        b = Body(b.getMass(), b.getRadius(), b.getColor(), k.state[3 * i], k.state[3 * i + 1], k.state[3 * i + 2]);
+    }
+    mFrame = k.frame;
+    mTime = k.time;
+    mStep = k.step;
+    isCollision = k.collision;
+    while (!mHashes.empty() && mHashes.back().step > mStep)
+        mHashes.pop_back();
+    if (mRecordPaths) startTrails();
+
+    // integrating records the frames again; the storage of the dropped ones is freed,
+    // not only taken off the budget
+    vector<glm::dvec2> configs(k.configs.begin(), k.configs.begin() + (frame - k.frame));
+    mKeyBytes -= keyframeBytes(k) - k.state.size() * sizeof(glm::dvec3);
+    vector<glm::dvec2>().swap(k.configs);
+    vector<glm::vec3>().swap(k.offsets);
+    double t = mT, steps = mSteps;
+    bool done = true;
+    for (size_t i = 0; done && i < configs.size(); i++)
+    {
+        mT = configs[i].x;
+        mSteps = configs[i].y;
+        done = update();
+    }
+    mT = t;
+    mSteps = steps;
+    return done;
+}
+
+int BodySystem::getKeyframeCount()
+{
+    return mKeyframes.size();
+}
+
+long long BodySystem::getKeyframeFrame(int index)
+{
+    return mKeyframes[index].frame;
+}
+
+// copies the snapshot `index` and the frames recorded after it, up to the next one
+bool BodySystem::getSegment(int index, HistorySegment &segment)
+{
+    if (index < 0 || index >= mKeyframes.size()) return false;
+    Keyframe &k = mKeyframes[index];
+    segment.frame = k.frame;
+    segment.collision = k.collision;
+    segment.parallel = (bool)mPool;
+    segment.deterministic = mDeterministic;
+    segment.bodies.clear();
+    for (int i = 0; i < mBodies.size(); i++)
+    {
+        Body &b = mBodies[i];
+        segment.bodies.push_back(Body(b.getMass(), b.getRadius(), b.getColor(), k.state[3 * i], k.state[3 * i + 1], k.state[3 * i + 2]));
+    }
+    segment.configs = k.configs;
+    return true;
+}
+
+// valid until the next update(), TrailPyramid::gather gives the whole history; of no
+// bodies unless paths are recorded
+const TrailPyramid &BodySystem::getTrails()
+{
+    return mTrails;
+}
+
+#endif
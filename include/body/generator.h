@@ -0,0 +1,134 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <body/body.h>
+#include <random/random.h>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Initial conditions for large N.  Body i only draws from Philox(seed, i), so the
+// generated system is bit-identical for any number of threads.
+
+// calls work(begin, end) on `threads` (0: all hardware threads) contiguous slices of [0, n)
+void parallelFor(size_t n, int threads, function<void(size_t, size_t)> work)
+{
+    if (threads < 1) threads = max(1u, thread::hardware_concurrency());
+    if ((size_t)threads > n) threads = max<size_t>(n, 1);
+
+    vector<thread> workers;
+    for (int t = 1; t < threads; t++)
+        workers.push_back(thread(work, n * t / threads, n * (t + 1) / threads));
+    work(0, n / threads);
+    for (auto &w : workers)
+        w.join();
+}
+
+glm::dvec3 randomDirection(Philox &rng)
+{
+    const double PI = 3.141592653589793238462643383279502884;
+    double z = 2.0 * rng.uniform() - 1.0;
+    double phi = 2.0 * PI * rng.uniform();
+    double s = sqrt(1.0 - z * z);
+    return glm::dvec3(s * cos(phi), s * sin(phi), z);
+}
+
+vector<Body> generateBodies(size_t n, int threads, function<Body(Philox &, size_t)> make, uint64_t seed)
+{
+    vector<Body> bodies(n, Body(0.0));
+    parallelFor(n, threads, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            Philox rng(seed, i);
+            bodies[i] = make(rng, i);
+        }
+    });
+    return bodies;
+}
+
+// unit masses, positions and velocities uniform in [-10, 10], colored by velocity
+vector<Body> randomBodies(size_t n, uint64_t seed, int threads = 0)
+{
+    return generateBodies(n, threads, [](Philox &rng, size_t) {
+        glm::dvec3 p, v;
+        for (int c = 0; c < 3; c++) p[c] = rng.uniform() * 20 - 10;
+        for (int c = 0; c < 3; c++) v[c] = rng.uniform() * 20 - 10;
+        glm::vec3 color(v.x / 20 + 0.5, v.y / 20 + 0.5, v.z / 20 + 0.5);
+        return Body(1.0, 1.0, color, p, v);
+    }, seed);
+}
+
+// positions uniform in a cube of half size `halfSize`, isotropic Gaussian velocities
+vector<Body> uniformCube(size_t n, uint64_t seed, double totalMass, double halfSize, double sigma, double radius, int threads = 0)
+{
+    double mass = totalMass / n;
+    return generateBodies(n, threads, [=](Philox &rng, size_t) {
+        glm::dvec3 p, v;
+        for (int c = 0; c < 3; c++) p[c] = (2.0 * rng.uniform() - 1.0) * halfSize;
+        for (int c = 0; c < 3; c++) v[c] = sigma * rng.normal();
+        return Body(mass, radius, glm::vec3(1.0f), p, v);
+    }, seed);
+}
+
+// Plummer sphere of scale radius `a` in virial equilibrium (Aarseth, Henon & Wielen 1974)
+vector<Body> plummerSphere(size_t n, uint64_t seed, double totalMass, double a, double radius, int threads = 0)
+{
+    double mass = totalMass / n;
+    return generateBodies(n, threads, [=](Philox &rng, size_t) {
+        // cut the rare far outliers at 10 scale radii
+        double r;
+        do
+            r = a / sqrt(pow(rng.uniformPositive(), -2.0 / 3.0) - 1.0);
+        while (r > 10.0 * a);
+
+        // speed in units of the local escape speed, from g(q) = q^2 (1 - q^2)^3.5
+        double q, g;
+        do
+        {
+            q = rng.uniform();
+            g = 0.1 * rng.uniform();
+        } while (g > q * q * pow(1.0 - q * q, 3.5));
+        double escape = sqrt(2.0 * G * totalMass) * pow(r * r + a * a, -0.25);
+
+        return Body(mass, radius, glm::vec3(1.0f), r * randomDirection(rng), q * escape * randomDirection(rng));
+    }, seed);
+}
+
+// Exponential disk in the xy plane with scale length `scale` and sech^2 scale height
+// `height`, on circular orbits around an optional central mass.  The enclosed disk mass
+// is treated as spherical for the circular speed.
+vector<Body> exponentialDisk(size_t n, uint64_t seed, double totalMass, double scale, double height, double centralMass, double radius, int threads = 0)
+{
+    const double PI = 3.141592653589793238462643383279502884;
+    double mass = totalMass / n;
+    return generateBodies(n, threads, [=](Philox &rng, size_t) {
+        // R * exp(-R / scale) is a Gamma(2) distribution
+        double R = -scale * log(rng.uniformPositive() * rng.uniformPositive());
+        double phi = 2.0 * PI * rng.uniform();
+        double z = height * atanh(2.0 * rng.uniform() - 1.0);
+        if (!std::isfinite(z)) z = 0.0;
+
+        double enclosed = centralMass + totalMass * (1.0 - (1.0 + R / scale) * exp(-R / scale));
+        double speed = R > 0.0 ? sqrt(G * enclosed / R) : 0.0;
+
+        glm::dvec3 p(R * cos(phi), R * sin(phi), z);
+        glm::dvec3 v(-speed * sin(phi), speed * cos(phi), 0.0);
+        return Body(mass, radius, glm::vec3(1.0f), p, v);
+    }, seed);
+}
+
+// uniform sphere at rest
+vector<Body> coldCollapse(size_t n, uint64_t seed, double totalMass, double sphereRadius, double radius, int threads = 0)
+{
+    double mass = totalMass / n;
+    return generateBodies(n, threads, [=](Philox &rng, size_t) {
+        double r = sphereRadius * cbrt(rng.uniform());
+        return Body(mass, radius, glm::vec3(1.0f), r * randomDirection(rng), glm::dvec3(0.0));
+    }, seed);
+}
+
+#endif
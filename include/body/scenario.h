@@ -0,0 +1,194 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <body/body.h>
+#include <body/generator.h>
+
+#include <vector>
+using namespace std;
+
+enum DisplayMode
+{
+    RANDOM,
+    SUN_PLANET,
+    SUN_PLANET_MOON,
+    SUN_PLANET_COMET,
+    BINARY_STAR_PLANET,
+    TROJAN_ASTERIODS,
+    FOUR_STAR_BALLET,
+    SLINGSHOT,
+    DOUBLE_SLINGSHOT,
+    HYPERBOLICS,
+    ELLIPSES,
+    DOUBLE_DOUBLE,
+    RESUME,
+    REPLAY,
+    UNIFORM_CUBE,
+    PLUMMER_SPHERE,
+    EXPONENTIAL_DISK,
+    COLD_COLLAPSE
+};
+
+// bodies of the preset display modes, empty for RANDOM, RESUME, REPLAY, the clusters and
+// unknown modes
+vector<Body> createScenario(unsigned int mode)
+{
+    vector<Body> bodies;
+
+    if (mode == SUN_PLANET)
+    {
+        // sun and planet
+        Body sun(20.0, 3.0, glm::vec3(1.0f, 0.7f, 0.0f), glm::dvec3(0.0, 0.0, 0.0), glm::dvec3(0.0, -0.6, 0.0));
+        bodies.push_back(sun);
+        Body planet(1.0, 1.0, glm::vec3(0.0f, 0.4f, 1.0f), glm::dvec3(15.0, 0.0, 0.0), glm::dvec3(0.0, 12.0, 0.0));
+        bodies.push_back(planet);
+    }
+    else if (mode == SUN_PLANET_MOON)
+    {
+        // sun, planet and moon
+        Body sun(20.0, 3.0, glm::vec3(1.0f, 0.7f, 0.0f), glm::dvec3(0.0, 0.0, 0.0), glm::dvec3(0.0, -0.6, 0.0));
+        bodies.push_back(sun);
+        Body planet(1.0, 1.0, glm::vec3(0.0f, 0.4f, 1.0f), glm::dvec3(16.0, 0.0, 0.0), glm::dvec3(0.0, 12.0, 0.0));
+        bodies.push_back(planet);
+        Body moon(0.0001, 0.2, glm::vec3(1.0f, 1.0f, 1.0f), glm::dvec3(14.0, 0.0, 0.0), glm::dvec3(0.0, 5.3, 0.0));
+        bodies.push_back(moon);
+    }
+    else if (mode == SUN_PLANET_COMET)
+    {
+        // sun, planet and comet
+        Body sun(20.0, 3.0, glm::vec3(1.0f, 0.7f, 0.0f), glm::dvec3(0.0, 0.0, 0.0), glm::dvec3(0.0, -0.6, 0.0));
+        bodies.push_back(sun);
+        Body planet(1.0, 1.0, glm::vec3(0.0f, 0.4f, 1.0f), glm::dvec3(15.0, 0.0, 0.0), glm::dvec3(0.0, 12.0, 0.0));
+        bodies.push_back(planet);
+        Body comet(0.0001, 0.2, glm::vec3(0.0f, 1.0f, 1.0f), glm::dvec3(-20.0, 10.0, 0.0), glm::dvec3(-2.0, -5.5, 0.0));
+        bodies.push_back(comet);
+    }
+    else if (mode == BINARY_STAR_PLANET)
+    {
+        // binary star and planet
+        Body star1(15.0, 1.0, glm::vec3(1.0f, 1.0f, 0.0f), glm::dvec3(-10.0, 0.0, 0.0), glm::dvec3(0.0, -6.0, 0.0));
+        bodies.push_back(star1);
+        Body star2(15.0, 1.0, glm::vec3(1.0f, 0.0f, 1.0f), glm::dvec3(10.0, 0.0, 0.0), glm::dvec3(0.0, 6.0, 0.0));
+        bodies.push_back(star2);
+        Body star3(0.001, 0.2, glm::vec3(0.0f, 1.0f, 1.0f), glm::dvec3(-5.0, 0.0, 0.0), glm::dvec3(0.0, 12.0, 0.0));
+        bodies.push_back(star3);
+    }
+    else if (mode == TROJAN_ASTERIODS)
+    {
+        // trojan asteriods
+        Body star1(20.0, 3.0, glm::vec3(1.0f, 1.0f, 0.0f), glm::dvec3(0.0, 0.0, 0.0), glm::dvec3(0.0, 0.0, 0.0));
+        bodies.push_back(star1);
+        Body star2(0.5, 1.0, glm::vec3(1.0f, 0.0f, 1.0f), glm::dvec3(15.0, 0.0, 0.0), glm::dvec3(0.0, 11.9, 0.0));
+        bodies.push_back(star2);
+        Body star3(0.001, 0.5, glm::vec3(0.0f, 1.0f, 1.0f), glm::dvec3(7.5, -13.0, 0.0), glm::dvec3(10.3, 6.0, 0.0));
+        bodies.push_back(star3);
+        Body star4(0.001, 0.5, glm::vec3(1.0f, 1.0f, 1.0f), glm::dvec3(7.5, 13.0, 0.0), glm::dvec3(-10.3, 6.0, 0.0));
+        bodies.push_back(star4);
+    }
+    else if (mode == FOUR_STAR_BALLET)
+    {
+        // four star ballet
+        Body star1(12.0, 1.0, glm::vec3(1.0f, 1.0f, 0.0f), glm::dvec3(-10.0, 10.0, 0.0), glm::dvec3(-5.0, -5.0, 0.0));
+        bodies.push_back(star1);
+        Body star2(12.0, 1.0, glm::vec3(1.0f, 0.0f, 1.0f), glm::dvec3(10.0, 10.0, 0.0), glm::dvec3(-5.0, 5.0, 0.0));
+        bodies.push_back(star2);
+        Body star3(12.0, 1.0, glm::vec3(0.0f, 1.0f, 1.0f), glm::dvec3(10.0, -10.0, 0.0), glm::dvec3(5.0, 5.0, 0.0));
+        bodies.push_back(star3);
+        Body star4(12.0, 1.0, glm::vec3(1.0f, 1.0f, 1.0f), glm::dvec3(-10.0, -10.0, 0.0), glm::dvec3(5.0, -5.0, 0.0));
+        bodies.push_back(star4);
+    }
+    else if (mode == SLINGSHOT)
+    {
+        // slingshot
+        Body star1(20.0, 3.0, glm::vec3(1.0f, 1.0f, 0.0f), glm::dvec3(0.0, 0.0, 0.0), glm::dvec3(0.0, -0.6, 0.0));
+        bodies.push_back(star1);
+        Body star2(1.0, 1.0, glm::vec3(1.0f, 0.0f, 1.0f), glm::dvec3(15.0, 0.0, 0.0), glm::dvec3(0.0, 12.0, 0.0));
+        bodies.push_back(star2);
+        Body star3(0.001, 0.5, glm::vec3(0.0f, 1.0f, 1.0f), glm::dvec3(-0.6, -12.8, 0.0), glm::dvec3(10.0, 0.0, 0.0));
+        bodies.push_back(star3);
+    }
+    else if (mode == DOUBLE_SLINGSHOT)
+    {
+        // double slingshot
+        Body star1(20.0, 1.0, glm::vec3(1.0f, 1.0f, 0.0f), glm::dvec3(0.0, 0.0, 0.0), glm::dvec3(0.0, -0.1, 0.0));
+        bodies.push_back(star1);
+        Body star2(0.5, 0.5, glm::vec3(1.0f, 0.0f, 1.0f), glm::dvec3(0.0, -11.2, 0.0), glm::dvec3(13.4, 0.0, 0.0));
+        bodies.push_back(star2);
+        Body star3(0.4, 0.5, glm::vec3(0.0f, 1.0f, 1.0f), glm::dvec3(18.6, -0.5, 0.0), glm::dvec3(0.1, 11.1, 0.0));
+        bodies.push_back(star3);
+        Body star4(0.001, 0.2, glm::vec3(1.0f, 1.0f, 1.0f), glm::dvec3(7.0, 7.2, 0.0), glm::dvec3(-4.7, 6.3, 0.0));
+        bodies.push_back(star4);
+    }
+    else if (mode == HYPERBOLICS)
+    {
+        // hyperbolics
+        double x = 20.0;
+        double vx = -15.0;
+        Body star1(25.0, 3.0, glm::vec3(1.0f, 1.0f, 0.0f), glm::dvec3(-5.0, -4.5, 0.0), glm::dvec3(0.0, 0.0, 0.0));
+        bodies.push_back(star1);
+        Body star2(0.001, 0.5, glm::vec3(1.0f, 0.0f, 1.0f), glm::dvec3(x, 5.0, 0.0), glm::dvec3(vx, 0.0, 0.0));
+        bodies.push_back(star2);
+        Body star3(0.001, 0.5, glm::vec3(0.0f, 1.0f, 1.0f), glm::dvec3(x, 12.0, 0.0), glm::dvec3(vx, 0.0, 0.0));
+        bodies.push_back(star3);
+        Body star4(0.001, 0.5, glm::vec3(1.0f, 1.0f, 1.0f), glm::dvec3(x, 19.0, 0.0), glm::dvec3(vx, 0.0, 0.0));
+        bodies.push_back(star4);
+    }
+    else if (mode == ELLIPSES)
+    {
+        // ellipses
+        Body star1(25.0, 3.0, glm::vec3(1.0f, 1.0f, 0.0f), glm::dvec3(-20.0, 0.0, 0.0), glm::dvec3(0.0, 0.0, 0.0));
+        bodies.push_back(star1);
+        Body star2(0.001, 0.5, glm::vec3(1.0f, 0.0f, 1.0f), glm::dvec3(-11.5, 0.0, 0.0), glm::dvec3(0.0, 15.1, 0.0));
+        bodies.push_back(star2);
+        Body star3(0.001, 0.5, glm::vec3(0.0f, 1.0f, 1.0f), glm::dvec3(5.0, 0.0, 0.0), glm::dvec3(0.0, 6.0, 0.0));
+        bodies.push_back(star3);
+        Body star4(0.001, 0.5, glm::vec3(1.0f, 1.0f, 1.0f), glm::dvec3(22.0, 0.0, 0.0), glm::dvec3(0.0, 3.7, 0.0));
+        bodies.push_back(star4);
+    }
+    else if (mode == DOUBLE_DOUBLE)
+    {
+        // double double
+        Body star1(6.0, 1.0, glm::vec3(1.0f, 1.0f, 0.0f), glm::dvec3(-11.5, -0.3, 0.0), glm::dvec3(0.0, -15.4, 0.0));
+        bodies.push_back(star1);
+        Body star2(7.0, 1.0, glm::vec3(1.0f, 0.0f, 1.0f), glm::dvec3(10.2, 0.0, 0.0), glm::dvec3(0.1, 15.0, 0.0));
+        bodies.push_back(star2);
+        Body star3(5.5, 1.0, glm::vec3(0.0f, 1.0f, 1.0f), glm::dvec3(-7.7, 0.2, 0.0), glm::dvec3(-0.1, 4.2, 0.0));
+        bodies.push_back(star3);
+        Body star4(6.2, 1.0, glm::vec3(1.0f, 1.0f, 1.0f), glm::dvec3(13.5, 0.0, 0.0), glm::dvec3(-0.1, -5.2, 0.0));
+        bodies.push_back(star4);
+    }
+
+    return bodies;
+}
+
+// `n` bodies of the cluster modes, `seed` as in randomBodies.  They are point masses of
+// radius 0, which never collide and are drawn as points of light, of 100 mass units in
+// all and about 10 units across, so a run fits the view.
+vector<Body> createCluster(unsigned int mode, size_t n, uint64_t seed)
+{
+    vector<Body> bodies;
+
+    if (mode == UNIFORM_CUBE)
+    {
+        // velocity dispersion near virial equilibrium
+        bodies = uniformCube(n, seed, 100.0, 10.0, 12.0, 0.0);
+    }
+    else if (mode == PLUMMER_SPHERE)
+    {
+        bodies = plummerSphere(n, seed, 100.0, 5.0, 0.0);
+    }
+    else if (mode == EXPONENTIAL_DISK)
+    {
+        // a thin disk around a central mass five times its own
+        bodies = exponentialDisk(n, seed, 20.0, 5.0, 0.3, 100.0, 0.0);
+        if (!bodies.empty()) bodies.push_back(Body(100.0, 0.0, glm::vec3(1.0f)));
+    }
+    else if (mode == COLD_COLLAPSE)
+    {
+        bodies = coldCollapse(n, seed, 100.0, 15.0, 0.0);
+    }
+
+    return bodies;
+}
+
+#endif
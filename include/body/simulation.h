@@ -0,0 +1,367 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <glm/glm.hpp>
+
+#include <body/body.h>
+#include <trail/rebuild.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// Three slots passed between one writer and one reader without locks: the writer fills
+// back() and publish() swaps it with the middle slot, acquire() swaps the middle slot
+// with front() if the writer published since.  Neither side ever waits for the other,
+// and the reader always gets the newest complete slot.
+template <typename T>
+class TripleBuffer
+{
+public:
+    T &back();
+    void publish();
+
+    // true if front() changed
+    bool acquire();
+    T &front();
+
+private:
+    static const int FRESH = 4;
+
+    T mSlots[3];
+    atomic<int> mMiddle{1};    // slot index, FRESH once published and not yet acquired
+    int mBack = 0;
+    int mFront = 2;
+};
+
+template <typename T>
+T &TripleBuffer<T>::back()
+{
+    return mSlots[mBack];
+}
+
+template <typename T>
+void TripleBuffer<T>::publish()
+{
+    mBack = mMiddle.exchange(mBack | FRESH, memory_order_acq_rel) & ~FRESH;
+}
+
+template <typename T>
+bool TripleBuffer<T>::acquire()
+{
+    if (!(mMiddle.load(memory_order_acquire) & FRESH)) return false;
+    mFront = mMiddle.exchange(mFront, memory_order_acq_rel) & ~FRESH;
+    return true;
+}
+
+template <typename T>
+T &TripleBuffer<T>::front()
+{
+    return mSlots[mFront];
+}
+
+// What the renderer needs of one frame, never changed once published.
+struct SimSnapshot
+{
+    long long frame = -1;
+    long long firstFrame = 0, lastFrame = 0;    // of the rewind history
+    bool preview = false;                       // a frame of the history, not integrated
+    chrono::steady_clock::time_point published;
+    vector<Body> bodies;
+    vector<size_t> trailBodies;
+    vector<TrailUpdate> trails;                 // what the renderer did not have yet
+};
+
+// Runs a BodySystem on its own thread at `rate` frames per second, or as fast as it can
+// when that is too much, so neither a heavy frame nor vsync holds the other side up.
+// Every frame goes to the renderer as a SimSnapshot through a TripleBuffer; the renderer
+// shows the newest one, interpolated from the one before so the motion stays smooth at
+// any ratio of the two rates.  acquire() tells the thread which trail points the
+// renderer has, later snapshots only carry the ones after them.  The settings below are
+// taken at the start of every frame.  Once start()ed the system belongs to the thread:
+// checkpoints, recording and anything else that needs it go in onFrame() and onSeek().
+// stop() returns within a substep: the frame it interrupts is left unfinished and is
+// neither published nor passed to onFrame().
+class Simulation
+{
+public:
+    Simulation(BodySystem &system, double rate);
+    ~Simulation();
+
+    // run on the simulation thread after every integrated frame, and after a seek
+    void onFrame(function<void(BodySystem &)> callback);
+    void onSeek(function<void(BodySystem &)> callback);
+    // trails rebuilt by `rebuilder` for the bodies given to showTrails() only
+    void lazyTrails(TrailRebuilder *rebuilder);
+
+    void start();
+    void stop();
+
+    void config(double t, double steps);
+    void trailLength(size_t points);
+    void showTrails(const vector<size_t> &bodies, long long frames);
+    // shows a frame of the history and stops integrating, -1 continues from that frame
+    void preview(long long frame);
+
+    // reader side, render thread only
+    bool acquire();
+    const SimSnapshot &current();
+    const SimSnapshot &previous();
+    // how far from previous() to current() the bodies are at the time of drawing
+    double blend();
+    void interpolate(vector<Body> &bodies);
+
+private:
+    // of a trail, as the renderer has it
+    struct Known
+    {
+        unsigned generation;
+        long long total;
+        unsigned version;
+    };
+    struct Controls
+    {
+        double t = 0.01, steps = 100;
+        size_t trailLength = PATH_LENGTH;
+        vector<size_t> trailBodies;
+        long long trailFrames = 0;
+        long long preview = -1;
+        vector<Known> known;
+    };
+
+    BodySystem &mSystem;
+    double mRate;
+    function<void(BodySystem &)> mOnFrame, mOnSeek;
+    TrailRebuilder *mRebuilder = nullptr;
+    thread mThread;
+    atomic<bool> mStop{false};
+
+    mutex mMutex;    // settings only
+    Controls mControls;
+
+    TripleBuffer<SimSnapshot> mBuffer;
+    SimSnapshot mPrevious, mCurrent;
+    vector<glm::vec3> mRebuilt;
+
+    void run();
+    void publish(const Controls &controls, bool preview);
+};
+
+Simulation::Simulation(BodySystem &system, double rate) : mSystem(system)
+{
+    mRate = rate;
+}
+
+Simulation::~Simulation()
+{
+    stop();
+}
+
+void Simulation::onFrame(function<void(BodySystem &)> callback)
+{
+    mOnFrame = callback;
+}
+
+void Simulation::onSeek(function<void(BodySystem &)> callback)
+{
+    mOnSeek = callback;
+}
+
+void Simulation::lazyTrails(TrailRebuilder *rebuilder)
+{
+    mRebuilder = rebuilder;
+}
+
+void Simulation::start()
+{
+    if (mThread.joinable()) return;
+    mStop = false;
+    // stop() does not wait for the rest of a frame, however many substeps it has
+    mSystem.abortWhen([this] { return mStop.load(memory_order_relaxed); });
+    mThread = thread(&Simulation::run, this);
+}
+
+void Simulation::stop()
+{
+    mStop = true;
+    if (!mThread.joinable()) return;
+    mThread.join();
+    mSystem.abortWhen(nullptr);
+}
+
+void Simulation::config(double t, double steps)
+{
+    lock_guard<mutex> lock(mMutex);
+    mControls.t = t;
+    mControls.steps = steps;
+}
+
+void Simulation::trailLength(size_t points)
+{
+    lock_guard<mutex> lock(mMutex);
+    mControls.trailLength = points;
+}
+
+void Simulation::showTrails(const vector<size_t> &bodies, long long frames)
+{
+    lock_guard<mutex> lock(mMutex);
+    mControls.trailBodies = bodies;
+    mControls.trailFrames = frames;
+}
+
+void Simulation::preview(long long frame)
+{
+    lock_guard<mutex> lock(mMutex);
+    mControls.preview = frame;
+}
+
+bool Simulation::acquire()
+{
+    if (!mBuffer.acquire()) return false;
+    // the slot goes back to the writer with the oldest snapshot in it
+    swap(mPrevious, mCurrent);
+    swap(mCurrent, mBuffer.front());
+
+    lock_guard<mutex> lock(mMutex);
+    mControls.known.clear();
+    for (auto &trail : mCurrent.trails)
+        mControls.known.push_back({trail.generation, trail.total, trail.version});
+    return true;
+}
+
+const SimSnapshot &Simulation::current()
+{
+    return mCurrent;
+}
+
+const SimSnapshot &Simulation::previous()
+{
+    return mPrevious;
+}
+
+// The newest bodies are moved back to where they were at the time of drawing, between
+// the two newest snapshots: one frame late, but without the jitter of showing whichever
+// snapshot happened to be ready.  Previews and jumps are shown as they are, at 1.
+double Simulation::blend()
+{
+    if (mPrevious.preview || mCurrent.preview || mPrevious.frame >= mCurrent.frame) return 1.0;
+    if (mPrevious.bodies.size() != mCurrent.bodies.size()) return 1.0;
+    double span = chrono::duration<double>(mCurrent.published - mPrevious.published).count();
+    double since = chrono::duration<double>(chrono::steady_clock::now() - mCurrent.published).count();
+    if (span <= 0.0) return 1.0;
+    return min(since / span, 1.0);
+}
+
+void Simulation::interpolate(vector<Body> &bodies)
+{
+    bodies = mCurrent.bodies;
+    double alpha = blend();
+    if (alpha >= 1.0) return;
+    for (size_t i = 0; i < bodies.size(); i++)
+    {
+        Body &b = bodies[i];
+        glm::dvec3 position = glm::mix(mPrevious.bodies[i].getPosition(), b.getPosition(), alpha);
+        b = Body(b.getMass(), b.getRadius(), b.getColor(), position, b.getVelocity(), b.getAcceleration());
+    }
+}
+
+void Simulation::run()
+{
+    auto period = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(1.0 / mRate));
+    auto next = chrono::steady_clock::now();
+    long long previewed = -1;
+    while (!mStop)
+    {
+        Controls controls;
+        {
+            lock_guard<mutex> lock(mMutex);
+            controls = mControls;
+        }
+
+        if (controls.preview >= 0)
+        {
+            // nothing is integrated while the history is shown
+            previewed = controls.preview;
+            publish(controls, true);
+        }
+        else
+        {
+            if (previewed >= 0 && previewed != mSystem.getFrame())
+            {
+                // continue exactly from the frame the preview stopped at
+                if (!mSystem.seekFrame(previewed) && mStop) break;
+                if (mOnSeek) mOnSeek(mSystem);
+            }
+            previewed = -1;
+            mSystem.config(controls.t, controls.steps);
+            mSystem.trailLength(controls.trailLength);
+            if (!mSystem.update()) break;
+            if (mOnFrame) mOnFrame(mSystem);
+            publish(controls, false);
+        }
+
+        // a frame that ran late is not made up for with a burst
+        next += period;
+        auto now = chrono::steady_clock::now();
+        if (next < now) next = now;
+        this_thread::sleep_until(next);
+    }
+}
+
+void Simulation::publish(const Controls &controls, bool preview)
+{
+    SimSnapshot &s = mBuffer.back();
+    s.lastFrame = mSystem.getFrame();
+    s.firstFrame = mSystem.getFirstFrame();
+    s.preview = preview;
+    if (preview)
+    {
+        s.frame = controls.preview;
+        mSystem.previewFrame(controls.preview, s.bodies);
+    }
+    else
+    {
+        s.frame = s.lastFrame;
+        s.bodies = mSystem.getBodies();
+    }
+
+    s.trailBodies.clear();
+    if (mRebuilder)
+    {
+        s.trailBodies = controls.trailBodies;
+        mRebuilder->request(mSystem, s.trailBodies, s.frame - controls.trailFrames, s.frame);
+    }
+    else
+    {
+        for (size_t b = 0; b < mSystem.getTrails().getBodyCount(); b++)
+            s.trailBodies.push_back(b);
+    }
+    s.trails.resize(s.trailBodies.size());
+    for (size_t k = 0; k < s.trailBodies.size(); k++)
+    {
+        TrailUpdate &update = s.trails[k];
+        if (!mRebuilder)
+        {
+            Known known = k < controls.known.size() ? controls.known[k] : Known{0, 0, 0};
+            mSystem.getTrails().getUpdate(s.trailBodies[k], known.generation, known.total, known.version, update);
+            continue;
+        }
+        // rebuilt trails are sent whole, with what is ready so far
+        mRebuilder->getTrail(s.trailBodies[k], mRebuilt);
+        update.generation = newTrailGeneration();
+        update.total = update.recent = mRebuilt.size();
+        update.points.swap(mRebuilt);
+        update.hasHistory = true;
+        update.history.clear();
+    }
+
+    s.published = chrono::steady_clock::now();
+    mBuffer.publish();
+}
+
+#endif
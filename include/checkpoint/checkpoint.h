@@ -0,0 +1,676 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <aio/aio.h>
+#include <body/body.h>
+#include <random/random.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Binary checkpoint of a BodySystem and any number of random streams.
+//
+//   header:  "TBCK" u32 version u64 payload size u64 payload checksum
+//   payload: sections of u32 tag u64 size, then `size` bytes
+//     SYST  bodies, integrator settings and internals, state hashes
+//     TRLP  trail capacity and body count, the heads and counts of the rings, then the
+//           rings and their chunks packed as in TrailBuffer
+//     HSTP  coarser trail history, per level and body the first point and slot count,
+//           then the slots and their chunks packed as in PackedTrail
+//     TDIR  per body the direction of motion at its last trail point
+//     TLST  per body the last trail point as sampled, the trails keep it packed
+//     TRAL  trail points as doubles of older checkpoints, read only
+//     HIST  trail history as doubles of older checkpoints, read only
+//     PATH  path rows [rows][bodies] of older checkpoints, read only
+//     RNG   (seed, stream, position) per Philox stream
+//
+// Readers skip unknown sections, so sections can be added without a version bump.
+// Everything is stored with its in-memory bit pattern, so a restarted run continues
+// bit-exactly.
+
+const uint32_t CHECKPOINT_VERSION = 1;
+
+const uint32_t SECTION_SYSTEM = 0x54535953;       // "SYST"
+const uint32_t SECTION_PACKED_TRAILS = 0x504C5254;    // "TRLP"
+const uint32_t SECTION_PACKED_HISTORY = 0x50545348;   // "HSTP"
+const uint32_t SECTION_TRAILS = 0x4C415254;       // "TRAL"
+const uint32_t SECTION_HISTORY = 0x54534948;      // "HIST"
+const uint32_t SECTION_DIRECTIONS = 0x52494454;   // "TDIR"
+const uint32_t SECTION_LAST = 0x54534C54;         // "TLST"
+const uint32_t SECTION_PATHS = 0x48544150;        // "PATH"
+const uint32_t SECTION_RANDOM = 0x20474E52;       // "RNG "
+
+uint64_t checksum(const char *data, size_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t words = size / 8;
+    for (size_t i = 0; i < words; i++)
+    {
+        uint64_t word;
+        memcpy(&word, data + i * 8, 8);
+        hash = (hash ^ word) * 0x100000001b3ULL;
+        hash ^= hash >> 29;
+    }
+    for (size_t i = words * 8; i < size; i++)
+        hash = (hash ^ (unsigned char)data[i]) * 0x100000001b3ULL;
+    return hash;
+}
+
+class CheckpointWriter
+{
+public:
+    vector<char> data;
+
+    template <typename T>
+    void put(const T &value)
+    {
+        putBytes(&value, sizeof(T));
+    }
+
+    void putBytes(const void *bytes, size_t size)
+    {
+        const char *p = (const char *)bytes;
+        data.insert(data.end(), p, p + size);
+    }
+
+    // returns the position of the size field, to be patched by endSection
+    size_t beginSection(uint32_t tag)
+    {
+        put(tag);
+        put((uint64_t)0);
+        return data.size();
+    }
+
+    void endSection(size_t start)
+    {
+        uint64_t size = data.size() - start;
+        memcpy(&data[start - sizeof(uint64_t)], &size, sizeof(size));
+    }
+};
+
+class CheckpointReader
+{
+public:
+    CheckpointReader(const char *begin, const char *end) : mPos(begin), mEnd(end) {}
+
+    template <typename T>
+    bool get(T &value)
+    {
+        return getBytes(&value, sizeof(T));
+    }
+
+    bool getBytes(void *bytes, size_t size)
+    {
+        if ((size_t)(mEnd - mPos) < size) return false;
+        memcpy(bytes, mPos, size);
+        mPos += size;
+        return true;
+    }
+
+    const char *position() { return mPos; }
+    const char *end() { return mEnd; }
+    bool done() { return mPos == mEnd; }
+
+private:
+    const char *mPos;
+    const char *mEnd;
+};
+
+class CheckpointIO
+{
+public:
+    static vector<char> serialize(BodySystem &system, const vector<Philox> &streams);
+    // `exact` rejects a checkpoint of the fast parallel scheme, which never continues
+    // bit-exactly
+    static bool deserialize(const char *data, size_t size, BodySystem &system, vector<Philox> *streams, bool exact);
+
+private:
+    static void putSystem(CheckpointWriter &out, BodySystem &system);
+    static bool getSystem(CheckpointReader in, BodySystem &system, bool exact);
+    static void putPacked(CheckpointWriter &out, const PackedTrail &trail);
+    static bool getPacked(CheckpointReader &in, PackedTrail &trail);
+    static bool getPackedTrails(CheckpointReader in, BodySystem &system);
+    static bool getPackedHistory(CheckpointReader in, BodySystem &system);
+    static bool getTrails(CheckpointReader in, BodySystem &system);
+    static bool getHistory(CheckpointReader in, BodySystem &system);
+    static bool getPaths(CheckpointReader in, BodySystem &system);
+};
+
+void CheckpointIO::putSystem(CheckpointWriter &out, BodySystem &system)
+{
+    out.put((uint64_t)system.mBodies.size());
+    for (auto &body : system.mBodies)
+    {
+        out.put(body.getMass());
+        out.put(body.getRadius());
+        out.put(body.getColor());
+        out.put(body.getPosition());
+        out.put(body.getVelocity());
+        out.put(body.getAcceleration());
+    }
+    out.put(system.mT);
+    out.put(system.mSteps);
+    out.put(system.mTime);
+    out.put((int64_t)system.mStep);
+    out.put((uint8_t)system.isCollision);
+    out.put((uint8_t)system.mRecordPaths);
+    // the scheme only, a resumed run takes the cores of the machine it runs on
+    out.put((int32_t)(system.mPool ? -1 : 0));
+    out.put((uint8_t)system.mDeterministic);
+    out.put((int32_t)system.mHashEvery);
+    out.put((uint64_t)system.mHashes.size());
+    for (auto &h : system.mHashes)
+    {
+        out.put((int64_t)h.step);
+        out.put(h.hash);
+    }
+}
+
+vector<char> CheckpointIO::serialize(BodySystem &system, const vector<Philox> &streams)
+{
+    CheckpointWriter out;
+    // a packed point takes 6 bytes and its share of a chunk 1.5
+    size_t points = system.mTrails.getCapacity() * (1 + system.mTrails.getLevelCount());
+    out.data.reserve(64 + system.mBodies.size() * (136 + 8 * TRAIL_LEVELS + points * 8));
+    out.putBytes("TBCK", 4);
+    out.put(CHECKPOINT_VERSION);
+    out.put((uint64_t)0);
+    out.put((uint64_t)0);
+    size_t payload = out.data.size();
+
+    size_t section = out.beginSection(SECTION_SYSTEM);
+    putSystem(out, system);
+    out.endSection(section);
+
+    // the trails as they are packed, so they come back bit for bit
+    const TrailBuffer &recent = system.mTrails.mRecent;
+    section = out.beginSection(SECTION_PACKED_TRAILS);
+    out.put((uint64_t)recent.mCapacity);
+    out.put((uint64_t)recent.mBodies);
+    for (size_t b = 0; b < recent.mBodies; b++)
+    {
+        out.put((uint64_t)recent.mHead[b]);
+        out.put((uint64_t)recent.mCount[b]);
+    }
+    for (const vector<int16_t> *axis : {&recent.mX, &recent.mY, &recent.mZ})
+        out.putBytes(axis->data(), axis->size() * sizeof(int16_t));
+    out.putBytes(recent.mChunks.data(), recent.mChunks.size() * sizeof(TrailChunk));
+    out.endSection(section);
+
+    section = out.beginSection(SECTION_PACKED_HISTORY);
+    out.put((uint64_t)system.mTrails.getLevelCount());
+    out.put((uint64_t)system.mTrails.getBodyCount());
+    for (size_t l = 0; l < system.mTrails.getLevelCount(); l++)
+    {
+        for (size_t b = 0; b < system.mTrails.getBodyCount(); b++)
+            putPacked(out, system.mTrails.history(l, b));
+    }
+    out.endSection(section);
+
+    // a system that records no paths has no trails and samples nothing
+    section = out.beginSection(SECTION_DIRECTIONS);
+    out.put((uint64_t)system.mTrails.getBodyCount());
+    for (size_t b = 0; b < system.mTrails.getBodyCount(); b++)
+        out.put(system.mSampler.getDirection(b));
+    out.endSection(section);
+
+    section = out.beginSection(SECTION_LAST);
+    out.put((uint64_t)system.mTrails.getBodyCount());
+    for (size_t b = 0; b < system.mTrails.getBodyCount(); b++)
+        out.put(system.mSampler.getLast(b));
+    out.endSection(section);
+
+    section = out.beginSection(SECTION_RANDOM);
+    out.put((uint64_t)streams.size());
+    for (auto stream : streams)
+    {
+        out.put(stream.getSeed());
+        out.put(stream.getStream());
+        out.put(stream.getPosition());
+    }
+    out.endSection(section);
+
+    uint64_t size = out.data.size() - payload;
+    uint64_t sum = checksum(&out.data[payload], size);
+    memcpy(&out.data[8], &size, sizeof(size));
+    memcpy(&out.data[16], &sum, sizeof(sum));
+    return out.data;
+}
+
+bool CheckpointIO::getSystem(CheckpointReader in, BodySystem &system, bool exact)
+{
+    uint64_t n;
+    if (!in.get(n)) return false;
+
+    vector<Body> bodies;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        double mass, radius;
+        glm::vec3 color;
+        glm::dvec3 position, velocity, acceleration;
+        if (!in.get(mass) || !in.get(radius) || !in.get(color) || !in.get(position) || !in.get(velocity) || !in.get(acceleration))
+            return false;
+        bodies.push_back(Body(mass, radius, color, position, velocity, acceleration));
+    }
+
+    int64_t step;
+    uint8_t collision, recordPaths, deterministic;
+    int32_t threads, hashEvery;
+    uint64_t hashes;
+    if (!in.get(system.mT) || !in.get(system.mSteps) || !in.get(system.mTime) || !in.get(step)
+        || !in.get(collision) || !in.get(recordPaths) || !in.get(threads) || !in.get(deterministic)
+        || !in.get(hashEvery) || !in.get(hashes))
+        return false;
+    if (exact && threads && !deterministic) return false;
+
+    system.mHashes.clear();
+    for (uint64_t i = 0; i < hashes; i++)
+    {
+        int64_t hashStep;
+        uint64_t hash;
+        if (!in.get(hashStep) || !in.get(hash)) return false;
+        system.mHashes.push_back({hashStep, hash});
+    }
+
+    system.mBodies = bodies;
+    system.mStep = step;
+    system.isCollision = collision;
+    system.mRecordPaths = recordPaths;
+    system.mHashEvery = hashEvery;
+    system.parallel(threads ? -1 : 0, deterministic);
+    return true;
+}
+
+void CheckpointIO::putPacked(CheckpointWriter &out, const PackedTrail &trail)
+{
+    out.put((uint64_t)trail.mFirst);
+    out.put((uint64_t)trail.mX.size());
+    for (const vector<int16_t> *axis : {&trail.mX, &trail.mY, &trail.mZ})
+        out.putBytes(axis->data(), axis->size() * sizeof(int16_t));
+    out.putBytes(trail.mChunks.data(), trail.mChunks.size() * sizeof(TrailChunk));
+}
+
+bool CheckpointIO::getPacked(CheckpointReader &in, PackedTrail &trail)
+{
+    uint64_t first, slots;
+    if (!in.get(first) || !in.get(slots) || slots > (uint64_t)(in.end() - in.position()) / (3 * sizeof(int16_t)))
+        return false;
+    if (first > slots || (first >= TRAIL_CHUNK && first != slots)) return false;
+    trail.clear();
+    for (vector<int16_t> *axis : {&trail.mX, &trail.mY, &trail.mZ})
+    {
+        axis->resize(slots);
+        if (slots && !in.getBytes(axis->data(), slots * sizeof(int16_t))) return false;
+    }
+    trail.mChunks.resize((slots + TRAIL_CHUNK - 1) / TRAIL_CHUNK);
+    if (!trail.mChunks.empty() && !in.getBytes(trail.mChunks.data(), trail.mChunks.size() * sizeof(TrailChunk)))
+        return false;
+    trail.mFirst = first;
+    return true;
+}
+
+bool CheckpointIO::getPackedTrails(CheckpointReader in, BodySystem &system)
+{
+    uint64_t capacity, n;
+    if (!in.get(capacity) || !in.get(n)) return false;
+    // every body takes at least two u64 and its ring 6 bytes per point
+    uint64_t left = in.end() - in.position();
+    if (n > left / 16 || (n && capacity > left / n / 6)) return false;
+
+    TrailPyramid trails(n, capacity);
+    TrailBuffer &recent = trails.mRecent;
+    for (uint64_t b = 0; b < n; b++)
+    {
+        uint64_t head, count;
+        if (!in.get(head) || !in.get(count) || count > capacity || (capacity && head >= capacity) || (!capacity && head))
+            return false;
+        recent.mHead[b] = head;
+        recent.mCount[b] = count;
+        trails.mPushed[b] = count;
+    }
+    for (vector<int16_t> *axis : {&recent.mX, &recent.mY, &recent.mZ})
+        if (axis->size() && !in.getBytes(axis->data(), axis->size() * sizeof(int16_t))) return false;
+    if (recent.mChunks.size() && !in.getBytes(recent.mChunks.data(), recent.mChunks.size() * sizeof(TrailChunk)))
+        return false;
+    system.mTrails = trails;
+    return true;
+}
+
+// after TRLP, which sets up the trails
+bool CheckpointIO::getPackedHistory(CheckpointReader in, BodySystem &system)
+{
+    uint64_t levels, n;
+    if (!in.get(levels) || !in.get(n) || n != system.mTrails.getBodyCount()) return false;
+
+    PackedTrail packed;
+    for (uint64_t l = 0; l < levels; l++)
+    {
+        for (uint64_t b = 0; b < n; b++)
+        {
+            if (!getPacked(in, packed)) return false;
+            if (l < system.mTrails.getLevelCount())
+            {
+                system.mTrails.mHistory[l * n + b] = packed;
+                continue;
+            }
+            // a build with fewer levels folds the rest into its last one
+            size_t level = system.mTrails.getLevelCount() - 1;
+            vector<glm::dvec3> points;
+            packed.decode(points);
+            const PackedTrail &newer = system.mTrails.history(level, b);
+            for (size_t i = 0; i < newer.size(); i++)
+                points.push_back(newer[i]);
+            system.mTrails.setHistory(level, b, points);
+        }
+    }
+    return true;
+}
+
+bool CheckpointIO::getTrails(CheckpointReader in, BodySystem &system)
+{
+    uint64_t capacity, n;
+    if (!in.get(capacity) || !in.get(n)) return false;
+
+    TrailPyramid trails(n, capacity);
+    for (uint64_t b = 0; b < n; b++)
+    {
+        uint64_t count;
+        if (!in.get(count)) return false;
+        for (uint64_t i = 0; i < count; i++)
+        {
+            glm::dvec3 point;
+            if (!in.get(point)) return false;
+            trails.push(b, point);
+        }
+    }
+    system.mTrails = trails;
+    return true;
+}
+
+// after TRAL, which sets up the trails
+bool CheckpointIO::getHistory(CheckpointReader in, BodySystem &system)
+{
+    uint64_t levels, n;
+    if (!in.get(levels) || !in.get(n) || n != system.mTrails.getBodyCount()) return false;
+
+    for (uint64_t l = 0; l < levels; l++)
+    {
+        for (uint64_t b = 0; b < n; b++)
+        {
+            uint64_t count;
+            if (!in.get(count)) return false;
+            vector<glm::dvec3> points(count);
+            if (count && !in.getBytes(&points[0], count * sizeof(glm::dvec3))) return false;
+            // a build with fewer levels folds the rest into its last one
+            size_t level = min<uint64_t>(l, system.mTrails.getLevelCount() - 1);
+            if (level < l)
+            {
+                const PackedTrail &newer = system.mTrails.history(level, b);
+                for (size_t i = 0; i < newer.size(); i++)
+                    points.push_back(newer[i]);
+            }
+            system.mTrails.setHistory(level, b, points);
+        }
+    }
+    return true;
+}
+
+bool CheckpointIO::getPaths(CheckpointReader in, BodySystem &system)
+{
+    uint64_t rows, n;
+    if (!in.get(rows) || !in.get(n)) return false;
+
+    TrailPyramid trails(n, PATH_LENGTH);
+    for (uint64_t r = 0; r < rows; r++)
+    {
+        for (uint64_t b = 0; b < n; b++)
+        {
+            glm::dvec3 point;
+            if (!in.get(point)) return false;
+            trails.push(b, point);
+        }
+    }
+    system.mTrails = trails;
+    return true;
+}
+
+bool CheckpointIO::deserialize(const char *data, size_t size, BodySystem &system, vector<Philox> *streams, bool exact)
+{
+    CheckpointReader header(data, data + size);
+    char magic[4];
+    uint32_t version;
+    uint64_t payloadSize, sum;
+    if (!header.getBytes(magic, 4) || memcmp(magic, "TBCK", 4) || !header.get(version) || version != CHECKPOINT_VERSION
+        || !header.get(payloadSize) || !header.get(sum))
+        return false;
+
+    const char *payload = header.position();
+    if (payloadSize != (uint64_t)(data + size - payload) || checksum(payload, payloadSize) != sum)
+        return false;
+
+    CheckpointReader in(payload, payload + payloadSize);
+    bool hasSystem = false;
+    vector<glm::dvec3> directions, lasts;
+    while (!in.done())
+    {
+        uint32_t tag;
+        uint64_t sectionSize;
+        if (!in.get(tag) || !in.get(sectionSize) || (uint64_t)(payload + payloadSize - in.position()) < sectionSize)
+            return false;
+        CheckpointReader section(in.position(), in.position() + sectionSize);
+
+        if (tag == SECTION_SYSTEM)
+        {
+            if (!getSystem(section, system, exact)) return false;
+            hasSystem = true;
+        }
+        else if (tag == SECTION_PACKED_TRAILS)
+        {
+            if (!getPackedTrails(section, system)) return false;
+        }
+        else if (tag == SECTION_PACKED_HISTORY)
+        {
+            if (!getPackedHistory(section, system)) return false;
+        }
+        else if (tag == SECTION_TRAILS)
+        {
+            if (!getTrails(section, system)) return false;
+        }
+        else if (tag == SECTION_HISTORY)
+        {
+            if (!getHistory(section, system)) return false;
+        }
+        else if (tag == SECTION_DIRECTIONS)
+        {
+            uint64_t n;
+            if (!section.get(n)) return false;
+            directions.resize(n);
+            if (n && !section.getBytes(&directions[0], n * sizeof(glm::dvec3))) return false;
+        }
+        else if (tag == SECTION_LAST)
+        {
+            uint64_t n;
+            if (!section.get(n)) return false;
+            lasts.resize(n);
+            if (n && !section.getBytes(&lasts[0], n * sizeof(glm::dvec3))) return false;
+        }
+        else if (tag == SECTION_PATHS)
+        {
+            if (!getPaths(section, system)) return false;
+        }
+        else if (tag == SECTION_RANDOM && streams)
+        {
+            uint64_t count;
+            if (!section.get(count)) return false;
+            streams->clear();
+            for (uint64_t i = 0; i < count; i++)
+            {
+                uint64_t seed, stream, position;
+                if (!section.get(seed) || !section.get(stream) || !section.get(position)) return false;
+                streams->push_back(Philox(seed, stream));
+                streams->back().seek(position);
+            }
+        }
+        in = CheckpointReader(in.position() + sectionSize, payload + payloadSize);
+    }
+    if (!hasSystem) return false;
+    if (!system.mRecordPaths)
+    {
+        system.mTrails = TrailPyramid();
+        system.mSampler = TrailSampler();
+        return true;
+    }
+    if (system.mTrails.getBodyCount() != system.mBodies.size()) return false;
+    system.mTrailLength = system.mTrails.getCapacity();
+
+    // the trail sampling picks up from the restored trails
+    system.mSampler = TrailSampler(system.mBodies.size());
+    system.mSampler.reset(system.mTrails);
+    if (directions.size() == system.mBodies.size())
+    {
+        for (size_t b = 0; b < directions.size(); b++)
+            system.mSampler.setDirection(b, directions[b]);
+    }
+    if (lasts.size() == system.mBodies.size())
+    {
+        for (size_t b = 0; b < lasts.size(); b++)
+            system.mSampler.setLast(b, lasts[b]);
+    }
+    return true;
+}
+
+// Writes to `path`.tmp and renames, so a crash never leaves a torn checkpoint behind.
+// The file bypasses the page cache, a large checkpoint does not evict everything else.
+bool writeCheckpointFile(const string &path, const vector<char> &data)
+{
+    string tmp = path + ".tmp";
+    AsyncFile file;
+    if (!file.open(tmp, true, true)) return false;
+    bool ok = file.write(&data[0], data.size()) && file.sync();
+    ok = file.close() && ok;
+    return ok && rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+bool saveCheckpoint(const string &path, BodySystem &system, const vector<Philox> &streams = vector<Philox>())
+{
+    return writeCheckpointFile(path, CheckpointIO::serialize(system, streams));
+}
+
+// the file is mapped rather than read, the state is decoded straight from the mapping;
+// see CheckpointIO::deserialize for `exact`
+bool loadCheckpoint(const string &path, BodySystem &system, vector<Philox> *streams = NULL, bool exact = true)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+    madvise(data, info.st_size, MADV_SEQUENTIAL);
+
+    bool ok = CheckpointIO::deserialize((const char *)data, info.st_size, system, streams, exact);
+    munmap(data, info.st_size);
+    return ok;
+}
+
+// Periodic checkpoints written by a background thread.  offer() only serializes into
+// memory on the calling thread; the file is written while integration continues.  If
+// the disk falls behind, a pending checkpoint is replaced by the newer one.
+class AutoCheckpointer
+{
+public:
+    AutoCheckpointer(string path, double interval);
+    ~AutoCheckpointer();
+
+    // checkpoints if `interval` seconds passed since the last one, returns whether it did
+    bool offer(BodySystem &system, const vector<Philox> &streams = vector<Philox>());
+    void save(BodySystem &system, const vector<Philox> &streams = vector<Philox>());
+
+private:
+    string mPath;
+    double mInterval;
+    chrono::steady_clock::time_point mLast;
+    thread mWriter;
+    mutex mMutex;
+    condition_variable mWake;
+    vector<char> mPending;
+    bool mHasPending = false;
+    bool mStop = false;
+
+    void writer();
+};
+
+AutoCheckpointer::AutoCheckpointer(string path, double interval)
+{
+    mPath = path;
+    mInterval = interval;
+    mLast = chrono::steady_clock::now();
+    mWriter = thread(&AutoCheckpointer::writer, this);
+}
+
+AutoCheckpointer::~AutoCheckpointer()
+{
+    {
+        lock_guard<mutex> lock(mMutex);
+        mStop = true;
+    }
+    mWake.notify_one();
+    mWriter.join();
+}
+
+bool AutoCheckpointer::offer(BodySystem &system, const vector<Philox> &streams)
+{
+    if (chrono::duration<double>(chrono::steady_clock::now() - mLast).count() < mInterval) return false;
+    save(system, streams);
+    return true;
+}
+
+void AutoCheckpointer::save(BodySystem &system, const vector<Philox> &streams)
+{
+    vector<char> data = CheckpointIO::serialize(system, streams);
+    mLast = chrono::steady_clock::now();
+    {
+        lock_guard<mutex> lock(mMutex);
+        mPending.swap(data);
+        mHasPending = true;
+    }
+    mWake.notify_one();
+}
+
+void AutoCheckpointer::writer()
+{
+    while (true)
+    {
+        vector<char> data;
+        {
+            unique_lock<mutex> lock(mMutex);
+            mWake.wait(lock, [this] { return mStop || mHasPending; });
+            // a pending checkpoint is still written on shutdown
+            if (!mHasPending) return;
+            data.swap(mPending);
+            mHasPending = false;
+        }
+        if (!writeCheckpointFile(mPath, data))
+            cout << "Failed to write checkpoint " << mPath << endl;
+    }
+}
+
+#endif
@@ -0,0 +1,434 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include <aio/aio.h>
+#include <body/body.h>
+#include <random/random.h>
+
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+using namespace std;
+
+// Runs many independent BodySystems in parallel and collects one summary per run.
+//
+// Output file (columnar, little endian):
+//   header: "TBEN" uint32 version
+//   blocks: uint32 count, then each column as a contiguous array of `count` values
+//           id u64 | outcome u8 | time f64 | escaper i32 | binaryA i32 | binaryB i32 | binaryEnergy f64
+//
+// Journal file: "TBEJ" uint32 version u64 seed u64 runs, then one entry per committed
+// block: u64 output offset after the block, u32 count, u64 ids[count].  On resume the
+// output is truncated to the last committed offset and the journaled ids are skipped.
+
+const uint32_t ENSEMBLE_VERSION = 1;
+
+enum RunOutcome
+{
+    RUN_ESCAPE,
+    RUN_COLLISION,
+    RUN_TIMEOUT
+};
+
+struct RunSummary
+{
+    uint64_t id;
+    uint8_t outcome;
+    double time;          // simulated time at termination
+    int32_t escaper;      // escaping body, -1 if none
+    int32_t binaryA;      // most bound pair at termination, -1 if none
+    int32_t binaryB;
+    double binaryEnergy;  // two-body energy of that pair
+};
+
+struct EnsembleConfig
+{
+    uint64_t runs = 1000;
+    uint64_t seed = 0;
+    int threads = 0;              // 0: one per hardware thread
+    double tPerUpdate = 0.01;     // simulated time per BodySystem::update
+    int steps = 100;              // substeps per update
+    double maxTime = 1000.0;      // timeout
+    double escapeRadius = 100.0;  // distance from the rest's center of mass
+    int chunkSize = 64;           // runs per stealable task
+    int blockSize = 256;          // runs per output block / journal entry
+    string outputPath = "ensemble.bin";
+    string journalPath = "ensemble.journal";
+};
+
+// initial conditions of run `id`
+typedef function<vector<Body>(uint64_t seed, uint64_t id)> InitialConditions;
+
+// the default workload: three equal masses at random positions and velocities in [-10, 10]
+vector<Body> randomThreeBody(uint64_t seed, uint64_t id)
+{
+    Philox rng(seed, id);
+
+    vector<Body> bodies;
+    for (int i = 0; i < 3; i++)
+    {
+        glm::dvec3 p, v;
+        for (int c = 0; c < 3; c++) p[c] = rng.uniform() * 20 - 10;
+        for (int c = 0; c < 3; c++) v[c] = rng.uniform() * 20 - 10;
+        bodies.push_back(Body(1.0, 1.0, glm::vec3(1.0f), p, v));
+    }
+    return bodies;
+}
+
+// index of a body that is unbound from, receding from and farther than `radius` from
+// the rest of the system, -1 if there is none
+int findEscaper(vector<Body> &bodies, double radius)
+{
+    double totalMass = 0.0;
+    glm::dvec3 totalMoment(0.0), totalMomentum(0.0);
+    for (auto &body : bodies)
+    {
+        totalMass += body.getMass();
+        totalMoment += body.getMass() * body.getPosition();
+        totalMomentum += body.getMass() * body.getVelocity();
+    }
+
+    for (int i = 0; i < bodies.size(); i++)
+    {
+        double m = bodies[i].getMass();
+        double restMass = totalMass - m;
+        if (restMass <= 0.0) continue;
+
+        glm::dvec3 restCenter = (totalMoment - m * bodies[i].getPosition()) / restMass;
+        glm::dvec3 restVelocity = (totalMomentum - m * bodies[i].getVelocity()) / restMass;
+        glm::dvec3 r = bodies[i].getPosition() - restCenter;
+        glm::dvec3 v = bodies[i].getVelocity() - restVelocity;
+        double d = L2Norm(r);
+        if (d < radius || glm::dot(r, v) <= 0.0) continue;
+
+        // specific orbital energy of the relative motion
+        if (0.5 * glm::dot(v, v) - G * (m + restMass) / d > 0.0) return i;
+    }
+    return -1;
+}
+
+// most bound pair, returns its two-body energy (0 and a = b = -1 if no pair is bound)
+double findBinary(vector<Body> &bodies, int &a, int &b)
+{
+    double best = 0.0;
+    a = b = -1;
+    for (int p = 0; p + 1 < bodies.size(); p++)
+    {
+        for (int q = p + 1; q < bodies.size(); q++)
+        {
+            double mp = bodies[p].getMass(), mq = bodies[q].getMass();
+            glm::dvec3 v = bodies[p].getVelocity() - bodies[q].getVelocity();
+            double d = L2Norm(bodies[p].getPosition() - bodies[q].getPosition());
+            double energy = 0.5 * mp * mq / (mp + mq) * glm::dot(v, v) - G * mp * mq / d;
+            if (energy < best)
+            {
+                best = energy;
+                a = p;
+                b = q;
+            }
+        }
+    }
+    return best;
+}
+
+RunSummary simulateRun(const EnsembleConfig &config, const InitialConditions &initial, uint64_t id)
+{
+    BodySystem bodySystem(initial(config.seed, id), false);
+    bodySystem.config(config.tPerUpdate, config.steps);
+
+    RunSummary summary;
+    summary.id = id;
+    summary.escaper = -1;
+    while (true)
+    {
+        bodySystem.update();
+        vector<Body> bodies = bodySystem.getBodies();
+        if (bodySystem.hasCollided())
+        {
+            summary.outcome = RUN_COLLISION;
+            break;
+        }
+        summary.escaper = findEscaper(bodies, config.escapeRadius);
+        if (summary.escaper >= 0)
+        {
+            summary.outcome = RUN_ESCAPE;
+            break;
+        }
+        if (bodySystem.getTime() >= config.maxTime)
+        {
+            summary.outcome = RUN_TIMEOUT;
+            break;
+        }
+    }
+    summary.time = bodySystem.getTime();
+
+    vector<Body> bodies = bodySystem.getBodies();
+    summary.binaryEnergy = findBinary(bodies, summary.binaryA, summary.binaryB);
+    return summary;
+}
+
+// per-worker task deque: the owner pops from the back, thieves steal from the front
+class TaskDeque
+{
+public:
+    void push(uint64_t task)
+    {
+        lock_guard<mutex> lock(mMutex);
+        mTasks.push_back(task);
+    }
+
+    bool pop(uint64_t &task)
+    {
+        lock_guard<mutex> lock(mMutex);
+        if (mTasks.empty()) return false;
+        task = mTasks.back();
+        mTasks.pop_back();
+        return true;
+    }
+
+    bool steal(uint64_t &task)
+    {
+        lock_guard<mutex> lock(mMutex);
+        if (mTasks.empty()) return false;
+        task = mTasks.front();
+        mTasks.pop_front();
+        return true;
+    }
+
+private:
+    mutex mMutex;
+    deque<uint64_t> mTasks;
+};
+
+class EnsembleRunner
+{
+public:
+    EnsembleRunner(EnsembleConfig config, InitialConditions initial = randomThreeBody);
+    ~EnsembleRunner();
+
+    // runs every run not yet in the journal, returns the number of runs simulated
+    uint64_t run();
+
+private:
+    EnsembleConfig mConfig;
+    InitialConditions mInitial;
+    AsyncFile mOutput;
+    AsyncFile mJournal;
+    mutex mCommitMutex;
+    atomic<uint64_t> mCommitted;
+    uint64_t mTotal = 0;
+
+    vector<uint64_t> resume();
+    void worker(int index, vector<TaskDeque> &deques, const vector<uint64_t> &pending);
+    void commit(vector<RunSummary> &block);
+};
+
+EnsembleRunner::EnsembleRunner(EnsembleConfig config, InitialConditions initial)
+{
+    mConfig = config;
+    mInitial = initial;
+    mCommitted = 0;
+}
+
+EnsembleRunner::~EnsembleRunner() {}
+
+template <typename T>
+void writeRaw(ostream &out, const T &value)
+{
+    out.write((const char *)&value, sizeof(T));
+}
+
+template <typename T>
+void writeRaw(AsyncFile &out, const T &value)
+{
+    out.write(&value, sizeof(T));
+}
+
+template <typename T>
+bool readRaw(istream &in, T &value)
+{
+    return (bool)in.read((char *)&value, sizeof(T));
+}
+
+// reads the journal, truncates the output to the last committed block and returns the ids still to run
+vector<uint64_t> EnsembleRunner::resume()
+{
+    unordered_set<uint64_t> done;
+    uint64_t outputEnd = 0;
+    uint64_t journalEnd = 0;
+
+    ifstream journal(mConfig.journalPath, ios::binary);
+    if (journal)
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t seed, runs;
+        if (journal.read(magic, 4) && readRaw(journal, version) && readRaw(journal, seed) && readRaw(journal, runs)
+            && !memcmp(magic, "TBEJ", 4) && version == ENSEMBLE_VERSION)
+        {
+            if (seed != mConfig.seed || runs != mConfig.runs)
+                throw runtime_error("ensemble journal " + mConfig.journalPath + " belongs to a different configuration");
+            journalEnd = journal.tellg();
+
+            // a torn trailing entry is dropped
+            uint64_t offset;
+            uint32_t count;
+            while (readRaw(journal, offset) && readRaw(journal, count))
+            {
+                vector<uint64_t> ids(count);
+                if (count && !journal.read((char *)&ids[0], count * sizeof(uint64_t))) break;
+                done.insert(ids.begin(), ids.end());
+                outputEnd = offset;
+                journalEnd = journal.tellg();
+            }
+        }
+    }
+    journal.close();
+
+    if (journalEnd == 0)
+    {
+        ofstream output(mConfig.outputPath, ios::binary | ios::trunc);
+        output.write("TBEN", 4);
+        writeRaw(output, ENSEMBLE_VERSION);
+        ofstream newJournal(mConfig.journalPath, ios::binary | ios::trunc);
+        newJournal.write("TBEJ", 4);
+        writeRaw(newJournal, ENSEMBLE_VERSION);
+        writeRaw(newJournal, mConfig.seed);
+        writeRaw(newJournal, mConfig.runs);
+    }
+    else
+    {
+        if (outputEnd == 0) outputEnd = 4 + sizeof(uint32_t);
+        if (truncate(mConfig.outputPath.c_str(), outputEnd) || truncate(mConfig.journalPath.c_str(), journalEnd))
+            throw runtime_error("failed to roll back " + mConfig.outputPath + " to its journal");
+    }
+
+    if (!mOutput.open(mConfig.outputPath, false) || !mJournal.open(mConfig.journalPath, false))
+        throw runtime_error("failed to open " + mConfig.outputPath + " or " + mConfig.journalPath);
+
+    mCommitted = done.size();
+    vector<uint64_t> pending;
+    for (uint64_t id = 0; id < mConfig.runs; id++)
+        if (!done.count(id)) pending.push_back(id);
+    return pending;
+}
+
+uint64_t EnsembleRunner::run()
+{
+    vector<uint64_t> pending = resume();
+    mTotal = mConfig.runs;
+
+    int threads = mConfig.threads > 0 ? mConfig.threads : thread::hardware_concurrency();
+    if (threads < 1) threads = 1;
+
+    // deal the chunks round robin, stealing evens out whatever imbalance remains
+    vector<TaskDeque> deques(threads);
+    uint64_t chunks = (pending.size() + mConfig.chunkSize - 1) / mConfig.chunkSize;
+    for (uint64_t c = 0; c < chunks; c++)
+        deques[c % threads].push(c * mConfig.chunkSize);
+
+    vector<thread> workers;
+    for (int i = 0; i < threads; i++)
+        workers.push_back(thread(&EnsembleRunner::worker, this, i, ref(deques), cref(pending)));
+    for (auto &w : workers)
+        w.join();
+
+    mOutput.close();
+    mJournal.close();
+    return pending.size();
+}
+
+void EnsembleRunner::worker(int index, vector<TaskDeque> &deques, const vector<uint64_t> &pending)
+{
+    vector<RunSummary> block;
+    uint64_t task;
+    while (true)
+    {
+        bool found = deques[index].pop(task);
+        for (int k = 1; !found && k < deques.size(); k++)
+            found = deques[(index + k) % deques.size()].steal(task);
+        // every task is pushed before the workers start, so empty deques mean we are done
+        if (!found) break;
+
+        uint64_t end = min<uint64_t>(task + mConfig.chunkSize, pending.size());
+        for (uint64_t i = task; i < end; i++)
+        {
+            block.push_back(simulateRun(mConfig, mInitial, pending[i]));
+            if (block.size() >= mConfig.blockSize) commit(block);
+        }
+    }
+    if (!block.empty()) commit(block);
+}
+
+// appends a block to the output, then journals it, so a journaled run is always on disk
+void EnsembleRunner::commit(vector<RunSummary> &block)
+{
+    lock_guard<mutex> lock(mCommitMutex);
+
+    uint32_t count = block.size();
+    writeRaw(mOutput, count);
+    for (auto &s : block) writeRaw(mOutput, s.id);
+    for (auto &s : block) writeRaw(mOutput, s.outcome);
+    for (auto &s : block) writeRaw(mOutput, s.time);
+    for (auto &s : block) writeRaw(mOutput, s.escaper);
+    for (auto &s : block) writeRaw(mOutput, s.binaryA);
+    for (auto &s : block) writeRaw(mOutput, s.binaryB);
+    for (auto &s : block) writeRaw(mOutput, s.binaryEnergy);
+    // the journal may only point at blocks the kernel already has
+    mOutput.flush();
+
+    uint64_t offset = mOutput.tell();
+    writeRaw(mJournal, offset);
+    writeRaw(mJournal, count);
+    for (auto &s : block) writeRaw(mJournal, s.id);
+    mJournal.flush();
+
+    mCommitted += count;
+    cout << "\rcommitted " << mCommitted << " / " << mTotal << " runs" << flush;
+    block.clear();
+}
+
+// reads a whole output file back, e.g. for post-processing
+vector<RunSummary> loadEnsembleResults(const string &path)
+{
+    vector<RunSummary> results;
+    ifstream in(path, ios::binary);
+    char magic[4];
+    uint32_t version;
+    if (!in.read(magic, 4) || !readRaw(in, version) || memcmp(magic, "TBEN", 4) || version != ENSEMBLE_VERSION)
+        return results;
+
+    uint32_t count;
+    while (readRaw(in, count))
+    {
+        size_t base = results.size();
+        results.resize(base + count);
+        for (uint32_t i = 0; i < count; i++) readRaw(in, results[base + i].id);
+        for (uint32_t i = 0; i < count; i++) readRaw(in, results[base + i].outcome);
+        for (uint32_t i = 0; i < count; i++) readRaw(in, results[base + i].time);
+        for (uint32_t i = 0; i < count; i++) readRaw(in, results[base + i].escaper);
+        for (uint32_t i = 0; i < count; i++) readRaw(in, results[base + i].binaryA);
+        for (uint32_t i = 0; i < count; i++) readRaw(in, results[base + i].binaryB);
+        for (uint32_t i = 0; i < count; i++) readRaw(in, results[base + i].binaryEnergy);
+        if (!in)
+        {
+            results.resize(base);
+            break;
+        }
+    }
+    return results;
+}
+
+#endif
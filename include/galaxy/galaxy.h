@@ -0,0 +1,204 @@
+#ifndef GALAXY_H
+#define GALAXY_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <body/body.h>
+#include <pool/pool.h>
+#include <shader/shader.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+// systems of GALAXY_MIN bodies or more are drawn as points of light
+const size_t GALAXY_MIN = 16384;
+// world radius of the sprite of a body of the mean mass, growing as the cube root of the
+// mass; GALAXY_EXPOSURE is the light of such a body before tone mapping
+const float GALAXY_SPRITE_RADIUS = 0.05f;
+const float GALAXY_EXPOSURE = 1.0f;
+const float GALAXY_MAX_SPRITE = 64.0f;
+
+// Clusters and galaxies drawn as one point sprite per body.  Every frame the bodies are
+// written straight into a single mapped vertex buffer, 20 bytes each, by `threads`
+// threads (0 for all cores), and drawn in one call: sprites as wide as the body's mass
+// would make it, at least a pixel, whose light adds up in a floating-point framebuffer
+// (shader/galaxy.vs), then a full-screen pass tone maps the sum onto the screen
+// (shader/tonemap.fs).  Nothing is per body but the vertex, so the cost is the upload
+// and the fill, not the number of draw calls or textures.
+class GalaxyRenderer
+{
+public:
+    GalaxyRenderer(int threads = 0);
+    ~GalaxyRenderer();
+
+    // positions from `previous` to `current` at `alpha`, as Simulation::blend()
+    void update(const vector<Body> &previous, const vector<Body> &current, double alpha);
+    // adds the tone-mapped sprites to the bound framebuffer of `width` by `height`, seen
+    // through the Camera block; `pixels` is the height in pixels of one unit at unit distance
+    void draw(Shader &sprites, Shader &tonemap, int width, int height, float pixels);
+
+private:
+    struct Sprite
+    {
+        glm::vec3 position;
+        float mass;
+        unsigned char color[4];
+    };
+
+    ThreadPool mPool;
+    size_t mCount = 0;
+    float mMassScale = 1.0f;        // one over the mean mass
+    unsigned mVAO, mVBO;
+    unsigned mScreenVAO;            // no attributes, tonemap.vs makes the triangle
+    unsigned mFBO = 0, mTexture = 0;
+    int mWidth = 0, mHeight = 0;
+    float mMaxSize;
+
+    void resize(int width, int height);
+};
+
+GalaxyRenderer::GalaxyRenderer(int threads) : mPool(threads)
+{
+    glGenVertexArrays(1, &mVAO);
+    glGenBuffers(1, &mVBO);
+
+    glBindVertexArray(mVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, mVBO);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Sprite), (void*)0);  // position, mass
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Sprite), (void*)offsetof(Sprite, color));  // color
+    glEnableVertexAttribArray(1);
+
+    glGenVertexArrays(1, &mScreenVAO);
+    glBindVertexArray(0);
+
+    float range[2];
+    glGetFloatv(GL_POINT_SIZE_RANGE, range);
+    mMaxSize = min(range[1], GALAXY_MAX_SPRITE);
+}
+
+GalaxyRenderer::~GalaxyRenderer()
+{
+    if (mFBO)
+    {
+        glDeleteFramebuffers(1, &mFBO);
+        glDeleteTextures(1, &mTexture);
+    }
+    glDeleteVertexArrays(1, &mVAO);
+    glDeleteBuffers(1, &mVBO);
+    glDeleteVertexArrays(1, &mScreenVAO);
+}
+
+void GalaxyRenderer::update(const vector<Body> &previous, const vector<Body> &current, double alpha)
+{
+    bool blend = alpha < 1.0 && previous.size() == current.size();
+    mCount = current.size();
+
+    // orphaned, so the writes do not wait for the last frame's draw
+    glBindBuffer(GL_ARRAY_BUFFER, mVBO);
+    glBufferData(GL_ARRAY_BUFFER, mCount * sizeof(Sprite), NULL, GL_STREAM_DRAW);
+    if (!mCount) return;
+    Sprite *sprites = (Sprite *)glMapBufferRange(GL_ARRAY_BUFFER, 0, mCount * sizeof(Sprite), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!sprites)
+    {
+        mCount = 0;
+        return;
+    }
+
+    vector<double> masses(mPool.size(), 0.0);
+    mPool.run([&](int t) {
+        size_t begin = mCount * t / mPool.size(), end = mCount * (t + 1) / mPool.size();
+        for (size_t i = begin; i < end; i++)
+        {
+            const Body &b = current[i];
+            Sprite &s = sprites[i];
+            glm::dvec3 position = b.getPosition();
+            if (blend) position = glm::mix(previous[i].getPosition(), position, alpha);
+            s.position = glm::vec3(position);
+            s.mass = (float)b.getMass();
+            masses[t] += b.getMass();
+            glm::vec3 color = glm::clamp(b.getColor(), 0.0f, 1.0f);
+            for (int c = 0; c < 3; c++)
+                s.color[c] = (unsigned char)(color[c] * 255.0f + 0.5f);
+            s.color[3] = 255;
+        }
+    });
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+
+    double mass = 0.0;
+    for (double m : masses)
+        mass += m;
+    mMassScale = mass > 0.0 ? (float)(mCount / mass) : 1.0f;
+}
+
+void GalaxyRenderer::draw(Shader &sprites, Shader &tonemap, int width, int height, float pixels)
+{
+    if (width <= 0 || height <= 0) return;
+    if (width != mWidth || height != mHeight) resize(width, height);
+
+    GLint target;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+
+    // every sprite adds its light, in any order
+    glBindFramebuffer(GL_FRAMEBUFFER, mFBO);
+    const GLfloat black[] = {0.0f, 0.0f, 0.0f, 0.0f};
+    glClearBufferfv(GL_COLOR, 0, black);
+    glEnable(GL_PROGRAM_POINT_SIZE);
+    sprites.use();
+    sprites.setFloat("pixels", pixels);
+    sprites.setFloat("radius", GALAXY_SPRITE_RADIUS);
+    sprites.setFloat("maxSize", mMaxSize);
+    sprites.setFloat("exposure", GALAXY_EXPOSURE);
+    sprites.setFloat("massScale", mMassScale);
+    glBindVertexArray(mVAO);
+    glDrawArrays(GL_POINTS, 0, mCount);
+    glDisable(GL_PROGRAM_POINT_SIZE);
+
+    // the sum tone mapped over what is on screen already
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+    tonemap.use();
+    tonemap.setInt("hdr", 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, mTexture);
+    glBindVertexArray(mScreenVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    glBindVertexArray(0);
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+}
+
+void GalaxyRenderer::resize(int width, int height)
+{
+    mWidth = width;
+    mHeight = height;
+    if (!mFBO)
+    {
+        glGenFramebuffers(1, &mFBO);
+        glGenTextures(1, &mTexture);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, mTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    GLint target;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+    glBindFramebuffer(GL_FRAMEBUFFER, mFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mTexture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        cout << "ERROR::GALAXY::FRAMEBUFFER_INCOMPLETE" << endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+}
+
+#endif
@@ -0,0 +1,243 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <body/body.h>
+#include <shader/frame.h>
+#include <shader/shader.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+using namespace std;
+
+// the view split into CLUSTER_X by CLUSTER_Y tiles and CLUSTER_Z slices of log depth
+const int CLUSTER_X = 16;
+const int CLUSTER_Y = 9;
+const int CLUSTER_Z = 24;
+const int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+// the brightest MAX_LIGHTS stars shine, at most MAX_CLUSTER_LIGHTS of them on a fragment
+const size_t MAX_LIGHTS = 1024;
+const size_t MAX_CLUSTER_LIGHTS = 64;
+// bodies shine as their mass over the heaviest's to the 3.5 (main sequence), those
+// brighter than LIGHT_CUTOFF are stars; the heaviest is at half at LIGHT_FALLOFF, and
+// a star's light ends where it falls under LIGHT_CUTOFF
+const float LIGHT_FALLOFF = 10.0f;
+const float LIGHT_CUTOFF = 0.1f;
+
+// Stars as the point lights of the scene, binned for clustered forward shading.  Every
+// frame update() picks the bodies that shine and adds each to the clusters its range
+// reaches, brightest first, so a cluster keeps the MAX_CLUSTER_LIGHTS that matter most.
+// The lights, the (first, count) of every cluster and the light indices go to buffer
+// textures, and shader/sphere_lt.fs finds its cluster from the pixel and the depth and
+// loops over those lights only, not over every star.
+class LightClusters
+{
+public:
+    LightClusters();
+    ~LightClusters();
+
+    // the bodies that shine, binned for the camera of `view` and the projection given
+    void update(const vector<Body> &bodies, const glm::mat4 &view, float fovy, float aspect, float zNear, float zFar);
+    // the grid of the Lights block, for a viewport of `width` by `height`
+    void fill(LightsBlock &block, int width, int height);
+    // names the light buffers on `shader` as texture units `unit` to `unit` + 2
+    void attach(Shader &shader, int unit);
+    void bind(int unit);
+
+    // 1 for a body that shines, it glows by itself
+    float getGlow(size_t body);
+    size_t getLightCount();
+
+private:
+    struct Light
+    {
+        size_t body;
+        float luminosity;
+        float range;
+        glm::vec3 position;
+        glm::vec3 color;
+    };
+
+    vector<Light> mLights;
+    vector<float> mGlow;
+    float mNear = 0.1f, mFar = 100.0f;
+
+    // per cluster, the lights of that cluster in slots [cluster * MAX_CLUSTER_LIGHTS, ...)
+    vector<unsigned> mCounts, mSlots;
+    // what goes to the GPU: two texels per light, (first, count) per cluster, indices
+    vector<glm::vec4> mData;
+    vector<unsigned> mGrid, mIndices;
+    unsigned mBuffers[3], mTextures[3];
+
+    void upload(int which, const void *data, size_t bytes);
+};
+
+LightClusters::LightClusters()
+{
+    mCounts.resize(CLUSTER_COUNT);
+    mSlots.resize(CLUSTER_COUNT * MAX_CLUSTER_LIGHTS);
+    mGrid.resize(2 * CLUSTER_COUNT);
+    glGenBuffers(3, mBuffers);
+    glGenTextures(3, mTextures);
+    // a buffer texture needs storage, even for no lights
+    upload(0, NULL, 0);
+    upload(1, &mGrid[0], mGrid.size() * sizeof(unsigned));
+    upload(2, NULL, 0);
+    GLenum formats[] = {GL_RGBA32F, GL_RG32UI, GL_R32UI};
+    for (int i = 0; i < 3; i++)
+    {
+        glBindTexture(GL_TEXTURE_BUFFER, mTextures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, formats[i], mBuffers[i]);
+    }
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+LightClusters::~LightClusters()
+{
+    glDeleteTextures(3, mTextures);
+    glDeleteBuffers(3, mBuffers);
+}
+
+void LightClusters::update(const vector<Body> &bodies, const glm::mat4 &view, float fovy, float aspect, float zNear, float zFar)
+{
+    mNear = zNear;
+    mFar = zFar;
+
+    // the stars, brightest first
+    double heaviest = 0.0;
+    for (auto &b : bodies)
+        heaviest = max(heaviest, b.getMass());
+    mLights.clear();
+    mGlow.assign(bodies.size(), 0.0f);
+    for (size_t i = 0; i < bodies.size() && heaviest > 0.0; i++)
+    {
+        float luminosity = (float)pow(bodies[i].getMass() / heaviest, 3.5);
+        if (luminosity <= LIGHT_CUTOFF) continue;
+        Light light;
+        light.body = i;
+        light.luminosity = luminosity;
+        // where luminosity / (1 + (d / LIGHT_FALLOFF)^2) drops to LIGHT_CUTOFF
+        light.range = LIGHT_FALLOFF * sqrt(luminosity / LIGHT_CUTOFF - 1.0f);
+        light.position = glm::vec3(bodies[i].getPosition());
+        light.color = bodies[i].getColor() * luminosity;
+        mLights.push_back(light);
+    }
+    auto brighter = [](const Light &a, const Light &b) { return a.luminosity > b.luminosity; };
+    if (mLights.size() > MAX_LIGHTS)
+    {
+        nth_element(mLights.begin(), mLights.begin() + MAX_LIGHTS, mLights.end(), brighter);
+        mLights.resize(MAX_LIGHTS);
+    }
+    sort(mLights.begin(), mLights.end(), brighter);
+    for (auto &light : mLights)
+        mGlow[light.body] = 1.0f;
+
+    // every light into the clusters its sphere may reach, in view space with depth
+    // positive: slices by depth, then the tiles its extent spans at either end of the slice
+    mCounts.assign(CLUSTER_COUNT, 0);
+    float tanY = tan(fovy / 2.0f), tanX = tanY * aspect;
+    float logRatio = log(zFar / zNear);
+    for (size_t l = 0; l < mLights.size(); l++)
+    {
+        const Light &light = mLights[l];
+        glm::vec3 p = glm::vec3(view * glm::vec4(light.position, 1.0f));
+        float depth = -p.z, r = light.range;
+        if (depth + r < zNear || depth - r > zFar) continue;
+        int first = (int)floor(log(max(depth - r, zNear) / zNear) / logRatio * CLUSTER_Z);
+        int last = (int)floor(log(min(depth + r, zFar) / zNear) / logRatio * CLUSTER_Z);
+        first = max(first, 0);
+        last = min(last, CLUSTER_Z - 1);
+        for (int z = first; z <= last; z++)
+        {
+            // the part of the slice the sphere reaches
+            float d0 = max(zNear * exp(logRatio * z / CLUSTER_Z), depth - r);
+            float d1 = min(zNear * exp(logRatio * (z + 1) / CLUSTER_Z), depth + r);
+            d0 = max(d0, zNear);
+            // x / (d tan) is monotonic in d, so its ends bound it
+            float xMin = min((p.x - r) / (d0 * tanX), (p.x - r) / (d1 * tanX));
+            float xMax = max((p.x + r) / (d0 * tanX), (p.x + r) / (d1 * tanX));
+            float yMin = min((p.y - r) / (d0 * tanY), (p.y - r) / (d1 * tanY));
+            float yMax = max((p.y + r) / (d0 * tanY), (p.y + r) / (d1 * tanY));
+            int x0 = max((int)floor((xMin + 1.0f) / 2.0f * CLUSTER_X), 0);
+            int x1 = min((int)floor((xMax + 1.0f) / 2.0f * CLUSTER_X), CLUSTER_X - 1);
+            int y0 = max((int)floor((yMin + 1.0f) / 2.0f * CLUSTER_Y), 0);
+            int y1 = min((int)floor((yMax + 1.0f) / 2.0f * CLUSTER_Y), CLUSTER_Y - 1);
+            for (int y = y0; y <= y1; y++)
+                for (int x = x0; x <= x1; x++)
+                {
+                    int cluster = (z * CLUSTER_Y + y) * CLUSTER_X + x;
+                    unsigned &count = mCounts[cluster];
+                    if (count < MAX_CLUSTER_LIGHTS)
+                        mSlots[cluster * MAX_CLUSTER_LIGHTS + count++] = l;
+                }
+        }
+    }
+
+    mData.clear();
+    for (auto &light : mLights)
+    {
+        mData.push_back(glm::vec4(light.position, light.range));
+        mData.push_back(glm::vec4(light.color, 0.0f));
+    }
+    mIndices.clear();
+    for (int c = 0; c < CLUSTER_COUNT; c++)
+    {
+        mGrid[2 * c] = mIndices.size();
+        mGrid[2 * c + 1] = mCounts[c];
+        mIndices.insert(mIndices.end(), &mSlots[c * MAX_CLUSTER_LIGHTS], &mSlots[c * MAX_CLUSTER_LIGHTS] + mCounts[c]);
+    }
+    upload(0, mData.data(), mData.size() * sizeof(glm::vec4));
+    upload(1, &mGrid[0], mGrid.size() * sizeof(unsigned));
+    upload(2, mIndices.data(), mIndices.size() * sizeof(unsigned));
+}
+
+void LightClusters::fill(LightsBlock &block, int width, int height)
+{
+    float logRatio = log(mFar / mNear);
+    block.ambient = glm::vec3(0.1f);
+    block.falloff = LIGHT_FALLOFF;
+    block.clusters = glm::ivec4(CLUSTER_X, CLUSTER_Y, CLUSTER_Z, mLights.size());
+    // slice = log(depth) * scale + bias
+    block.depth = glm::vec4(CLUSTER_Z / logRatio, -CLUSTER_Z * log(mNear) / logRatio, width, height);
+}
+
+void LightClusters::attach(Shader &shader, int unit)
+{
+    shader.use();
+    shader.setInt("lightData", unit);
+    shader.setInt("clusterLights", unit + 1);
+    shader.setInt("lightIndices", unit + 2);
+}
+
+void LightClusters::bind(int unit)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit + i);
+        glBindTexture(GL_TEXTURE_BUFFER, mTextures[i]);
+    }
+}
+
+float LightClusters::getGlow(size_t body)
+{
+    return body < mGlow.size() ? mGlow[body] : 0.0f;
+}
+
+size_t LightClusters::getLightCount()
+{
+    return mLights.size();
+}
+
+// orphaned every frame, so the draw of the last frame is not waited for
+void LightClusters::upload(int which, const void *data, size_t bytes)
+{
+    glBindBuffer(GL_TEXTURE_BUFFER, mBuffers[which]);
+    glBufferData(GL_TEXTURE_BUFFER, max(bytes, (size_t)16), NULL, GL_STREAM_DRAW);
+    if (bytes) glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Fixed set of threads that run one task at a time, as task(0) ... task(size - 1).
+// The calling thread runs task(0), so a pool of size 1 starts no thread at all.
+class ThreadPool
+{
+public:
+    ThreadPool(int threads);
+    ~ThreadPool();
+
+    int size();
+    // blocks until every task(t) returned
+    void run(function<void(int)> task);
+
+private:
+    vector<thread> mWorkers;
+    mutex mMutex;
+    condition_variable mStart;
+    condition_variable mDone;
+    function<void(int)> mTask;
+    unsigned long long mGeneration = 0;
+    int mPending = 0;
+    bool mStop = false;
+
+    void worker(int index);
+};
+
+ThreadPool::ThreadPool(int threads)
+{
+    if (threads < 1) threads = max(1u, thread::hardware_concurrency());
+    for (int t = 1; t < threads; t++)
+        mWorkers.push_back(thread(&ThreadPool::worker, this, t));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> lock(mMutex);
+        mStop = true;
+    }
+    mStart.notify_all();
+    for (auto &w : mWorkers)
+        w.join();
+}
+
+int ThreadPool::size()
+{
+    return mWorkers.size() + 1;
+}
+
+void ThreadPool::run(function<void(int)> task)
+{
+    {
+        lock_guard<mutex> lock(mMutex);
+        mTask = task;
+        mPending = mWorkers.size();
+        mGeneration++;
+    }
+    mStart.notify_all();
+
+    task(0);
+
+    unique_lock<mutex> lock(mMutex);
+    mDone.wait(lock, [this] { return mPending == 0; });
+}
+
+void ThreadPool::worker(int index)
+{
+    unsigned long long seen = 0;
+    while (true)
+    {
+        function<void(int)> task;
+        {
+            unique_lock<mutex> lock(mMutex);
+            mStart.wait(lock, [&] { return mStop || mGeneration != seen; });
+            if (mStop) return;
+            seen = mGeneration;
+            task = mTask;
+        }
+
+        task(index);
+
+        lock_guard<mutex> lock(mMutex);
+        if (--mPending == 0) mDone.notify_one();
+    }
+}
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cmath>
+#include <cstdint>
+
+// Counter-based random numbers (Philox4x32-10, Salmon et al. 2011).
+// Every (seed, stream) pair names an independent sequence that needs no shared state,
+// so e.g. body i of a generated system draws from stream i on whatever thread builds it
+// and the result does not depend on how the bodies were split among threads.
+class Philox
+{
+public:
+    Philox(uint64_t seed = 0, uint64_t stream = 0);
+
+    uint32_t next();
+    // uniform in [0, 1) with 53 random bits
+    double uniform();
+    // uniform in (0, 1], safe for log()
+    double uniformPositive();
+    double normal();
+
+    // the full state is the tuple below, enough to save and restore a stream
+    uint64_t getSeed();
+    uint64_t getStream();
+    uint64_t getPosition();
+    void seek(uint64_t position);
+
+private:
+    uint64_t mSeed;
+    uint64_t mStream;
+    uint64_t mBlock;       // counter of the next block to generate
+    uint32_t mBuffer[4];
+    int mIndex;            // next unused word of mBuffer, 4 if empty
+
+    void generate(uint64_t block, uint32_t out[4]);
+};
+
+Philox::Philox(uint64_t seed, uint64_t stream)
+{
+    mSeed = seed;
+    mStream = stream;
+    mBlock = 0;
+    mIndex = 4;
+}
+
+void Philox::generate(uint64_t block, uint32_t out[4])
+{
+    const uint32_t M0 = 0xD2511F53u, M1 = 0xCD9E8D57u;
+    const uint32_t W0 = 0x9E3779B9u, W1 = 0xBB67AE85u;
+
+    uint32_t c0 = (uint32_t)block, c1 = (uint32_t)(block >> 32);
+    uint32_t c2 = (uint32_t)mStream, c3 = (uint32_t)(mStream >> 32);
+    uint32_t k0 = (uint32_t)mSeed, k1 = (uint32_t)(mSeed >> 32);
+    for (int round = 0; round < 10; round++)
+    {
+        uint64_t p0 = (uint64_t)M0 * c0;
+        uint64_t p1 = (uint64_t)M1 * c2;
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n1 = (uint32_t)p1;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        uint32_t n3 = (uint32_t)p0;
+        c0 = n0;
+        c1 = n1;
+        c2 = n2;
+        c3 = n3;
+        k0 += W0;
+        k1 += W1;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+uint32_t Philox::next()
+{
+    if (mIndex == 4)
+    {
+        generate(mBlock++, mBuffer);
+        mIndex = 0;
+    }
+    return mBuffer[mIndex++];
+}
+
+double Philox::uniform()
+{
+    uint64_t hi = next() >> 5, lo = next() >> 6;
+    return (hi * 67108864.0 + lo) * (1.0 / 9007199254740992.0);
+}
+
+double Philox::uniformPositive()
+{
+    return 1.0 - uniform();
+}
+
+double Philox::normal()
+{
+    // Box-Muller, one of the pair is dropped to keep the state a plain position
+    const double PI = 3.141592653589793238462643383279502884;
+    return sqrt(-2.0 * log(uniformPositive())) * cos(2.0 * PI * uniform());
+}
+
+uint64_t Philox::getSeed()
+{
+    return mSeed;
+}
+
+uint64_t Philox::getStream()
+{
+    return mStream;
+}
+
+// number of 32-bit words drawn so far
+uint64_t Philox::getPosition()
+{
+    return mBlock * 4 - (4 - mIndex);
+}
+
+void Philox::seek(uint64_t position)
+{
+    mBlock = position / 4;
+    mIndex = 4;
+    if (position % 4)
+    {
+        generate(mBlock++, mBuffer);
+        mIndex = position % 4;
+    }
+}
+
+#endif
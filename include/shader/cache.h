@@ -0,0 +1,127 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <glad/glad.h>
+
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// linked programs are kept in PROGRAM_CACHE_DIR, next to the executable's working directory
+const char *PROGRAM_CACHE_DIR = "shader_cache";
+const uint32_t PROGRAM_CACHE_MAGIC = 0x43505442;    // "BTPC"
+
+// Linked programs saved with glGetProgramBinary and given back to the driver with
+// glProgramBinary on the next launch, so nothing is compiled twice.  A binary is found by
+// a hash of the program's sources and of the driver's vendor, renderer and version
+// strings; a driver update changes the key, and a binary the driver rejects anyway is
+// simply compiled again and replaced.  Needs GL 4.1, without it every launch compiles.
+bool programBinaries()
+{
+    if (!GLAD_GL_VERSION_4_1) return false;
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+// FNV-1a over the sources and the driver strings
+uint64_t programKey(const std::vector<std::string> &sources)
+{
+    std::vector<std::string> parts = sources;
+    GLenum names[] = {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION};
+    for (GLenum name : names)
+    {
+        const GLubyte *value = glGetString(name);
+        parts.push_back(value ? (const char *)value : "");
+    }
+
+    uint64_t hash = 14695981039346656037ull;
+    for (auto &part : parts)
+    {
+        // the length first, so moving text from one part to the next changes the key
+        uint64_t length = part.size();
+        for (int i = 0; i < 8; i++)
+            hash = (hash ^ ((length >> (8 * i)) & 0xff)) * 1099511628211ull;
+        for (unsigned char c : part)
+            hash = (hash ^ c) * 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string programCachePath(uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+    return std::string(PROGRAM_CACHE_DIR) + "/" + name;
+}
+
+// a program linked from the cached binary of `key`, 0 if there is none or the driver
+// does not take it
+unsigned int loadProgramBinary(uint64_t key)
+{
+    if (!programBinaries()) return 0;
+    FILE *file = fopen(programCachePath(key).c_str(), "rb");
+    if (!file) return 0;
+
+    uint32_t magic = 0, format = 0, length = 0;
+    uint64_t stored = 0;
+    std::vector<char> binary;
+    bool ok = fread(&magic, sizeof(magic), 1, file) == 1 && magic == PROGRAM_CACHE_MAGIC
+        && fread(&stored, sizeof(stored), 1, file) == 1 && stored == key
+        && fread(&format, sizeof(format), 1, file) == 1
+        && fread(&length, sizeof(length), 1, file) == 1 && length > 0;
+    if (ok)
+    {
+        binary.resize(length);
+        ok = fread(&binary[0], 1, length, file) == length;
+    }
+    fclose(file);
+    if (!ok) return 0;
+
+    unsigned int program = glCreateProgram();
+    glProgramBinary(program, format, &binary[0], length);
+    GLint linked = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (linked) return program;
+    glDeleteProgram(program);
+    return 0;
+}
+
+// before linking, so the driver keeps what saveProgramBinary() needs
+void retrievableProgram(unsigned int program)
+{
+    if (programBinaries())
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+// the linked `program` under `key`, written to a temporary file and renamed so another
+// launch never reads half a binary
+void saveProgramBinary(unsigned int program, uint64_t key)
+{
+    if (!programBinaries()) return;
+    GLint linked = 0, length = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (!linked || length <= 0) return;
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, &binary[0]);
+
+    mkdir(PROGRAM_CACHE_DIR, 0755);
+    std::string path = programCachePath(key), tmp = path + ".tmp";
+    FILE *file = fopen(tmp.c_str(), "wb");
+    if (!file) return;
+    uint32_t magic = PROGRAM_CACHE_MAGIC, format32 = format, length32 = length;
+    bool ok = fwrite(&magic, sizeof(magic), 1, file) == 1
+        && fwrite(&key, sizeof(key), 1, file) == 1
+        && fwrite(&format32, sizeof(format32), 1, file) == 1
+        && fwrite(&length32, sizeof(length32), 1, file) == 1
+        && fwrite(&binary[0], 1, length, file) == (size_t)length;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) remove(tmp.c_str());
+}
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <shader/shader.h>
+
+#include <cstring>
+#include <vector>
+using namespace std;
+
+// as in shader/sphere_lt.fs
+const int NR_DIRECT_LIGHTS = 1;
+
+// binding points of the uniform blocks every shader shares
+const unsigned CAMERA_BLOCK = 0;
+const unsigned LIGHTS_BLOCK = 1;
+
+// std140 layouts of the blocks, a vec3 takes 16 bytes unless a float follows it
+struct CameraBlock
+{
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 viewPos;
+    float pad;
+};
+
+struct DirLightBlock
+{
+    glm::vec3 direction;
+    float pad0;
+    glm::vec3 ambient;
+    float pad1;
+    glm::vec3 diffuse;
+    float pad2;
+    glm::vec3 specular;
+    float pad3;
+};
+
+// the point lights themselves are in buffer textures, see include/light/cluster.h
+struct LightsBlock
+{
+    DirLightBlock dirLights[NR_DIRECT_LIGHTS];
+    glm::vec3 ambient;
+    float falloff;
+    glm::ivec4 clusters;    // tiles across and down, depth slices, lights
+    glm::vec4 depth;        // scale and bias from log depth to slice, viewport size
+};
+static_assert(sizeof(CameraBlock) == 144 && sizeof(DirLightBlock) == 64 && sizeof(LightsBlock) == 112, "not std140");
+
+// What every shader needs of the frame, in one uniform buffer: the Camera block and the
+// Lights block behind it.  Fill `camera` and `lights`, and upload() writes both with one
+// call; the shaders attach()ed read them from there instead of taking a dozen uniforms
+// each, every frame.
+class FrameUniforms
+{
+public:
+    FrameUniforms();
+    ~FrameUniforms();
+
+    CameraBlock camera;
+    LightsBlock lights;
+
+    // binds the shader's blocks, once after it is linked
+    void attach(Shader &shader);
+    void upload();
+
+private:
+    unsigned mUBO;
+    size_t mLightsOffset;
+    vector<char> mStaging;
+};
+
+FrameUniforms::FrameUniforms()
+{
+    memset(&camera, 0, sizeof(camera));
+    memset(&lights, 0, sizeof(lights));
+
+    // each block starts where a range may be bound
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    mLightsOffset = (sizeof(CameraBlock) + alignment - 1) / alignment * alignment;
+    mStaging.resize(mLightsOffset + sizeof(LightsBlock));
+
+    glGenBuffers(1, &mUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, mUBO);
+    glBufferData(GL_UNIFORM_BUFFER, mStaging.size(), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BLOCK, mUBO, 0, sizeof(CameraBlock));
+    glBindBufferRange(GL_UNIFORM_BUFFER, LIGHTS_BLOCK, mUBO, mLightsOffset, sizeof(LightsBlock));
+}
+
+FrameUniforms::~FrameUniforms()
+{
+    glDeleteBuffers(1, &mUBO);
+}
+
+void FrameUniforms::attach(Shader &shader)
+{
+    shader.setBlock("Camera", CAMERA_BLOCK);
+    shader.setBlock("Lights", LIGHTS_BLOCK);
+}
+
+void FrameUniforms::upload()
+{
+    memcpy(&mStaging[0], &camera, sizeof(camera));
+    memcpy(&mStaging[mLightsOffset], &lights, sizeof(lights));
+    glBindBuffer(GL_UNIFORM_BUFFER, mUBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, mStaging.size(), &mStaging[0]);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+#endif
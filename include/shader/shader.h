@@ -6,10 +6,14 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <shader/cache.h>
+
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
 
 class Shader
 {
@@ -43,8 +47,8 @@ public:
             vShaderFile.close();
             fShaderFile.close();
             // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
+            vertexCode = resolveIncludes(vShaderStream.str(), vertexPath);
+            fragmentCode = resolveIncludes(fShaderStream.str(), fragmentPath);
             // if geometry shader path is present, also load a geometry shader
             if(geometryPath != nullptr)
             {
@@ -52,16 +56,24 @@ public:
                 std::stringstream gShaderStream;
                 gShaderStream << gShaderFile.rdbuf();
                 gShaderFile.close();
-                geometryCode = gShaderStream.str();
+                geometryCode = resolveIncludes(gShaderStream.str(), geometryPath);
             }
         }
         catch (std::ifstream::failure& e)
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
+        // 2. the binary linked by an earlier launch, if the driver still takes it
+        uint64_t key = programKey({vertexCode, fragmentCode, geometryCode});
+        ID = loadProgramBinary(key);
+        if (ID)
+        {
+            cacheLocations();
+            return;
+        }
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
+        // 3. compile shaders
         unsigned int vertex, fragment;
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
@@ -89,8 +101,11 @@ public:
         glAttachShader(ID, fragment);
         if(geometryPath != nullptr)
             glAttachShader(ID, geometry);
+        retrievableProgram(ID);
         glLinkProgram(ID);
         checkCompileErrors(ID, "PROGRAM");
+        saveProgramBinary(ID, key);
+        cacheLocations();
         // delete the shaders as they're linked into our program now and no longer necessery
         glDeleteShader(vertex);
         glDeleteShader(fragment);
@@ -104,66 +119,146 @@ public:
     { 
         glUseProgram(ID); 
     }
+    // uniform location, looked up once at link time
+    // ------------------------------------------------------------------------
+    GLint location(const std::string &name) const
+    {
+        auto found = mLocations.find(name);
+        if (found != mLocations.end())
+            return found->second;
+        // inactive, or spelled differently from glGetActiveUniform
+        GLint result = glGetUniformLocation(ID, name.c_str());
+        mLocations[name] = result;
+        return result;
+    }
+    // ------------------------------------------------------------------------
+    void setBlock(const std::string &name, unsigned int binding) const
+    {
+        unsigned int index = glGetUniformBlockIndex(ID, name.c_str());
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, index, binding);
+    }
     // utility uniform functions
     // ------------------------------------------------------------------------
     void setBool(const std::string &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        glUniform1i(location(name), (int)value); 
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string &name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1i(location(name), value); 
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1f(location(name), value); 
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string &name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform2fv(location(name), 1, &value[0]); 
     }
     void setVec2(const std::string &name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        glUniform2f(location(name), x, y); 
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform3fv(location(name), 1, &value[0]); 
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        glUniform3f(location(name), x, y, z); 
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform4fv(location(name), 1, &value[0]); 
     }
     void setVec4(const std::string &name, float x, float y, float z, float w) 
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        glUniform4f(location(name), x, y, z, w); 
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
+    mutable std::unordered_map<std::string, GLint> mLocations;
+
+    // every active uniform by name, array elements too
+    // ------------------------------------------------------------------------
+    void cacheLocations()
+    {
+        GLint count = 0, length = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &length);
+        std::vector<GLchar> buffer(length + 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLint size;
+            GLenum type;
+            buffer[0] = 0;
+            glGetActiveUniform(ID, i, buffer.size(), NULL, &size, &type, &buffer[0]);
+            std::string name(&buffer[0]);
+            GLint found = glGetUniformLocation(ID, name.c_str());
+            // members of uniform blocks have none
+            if (found < 0)
+                continue;
+            mLocations[name] = found;
+            // an array is listed once, as its first element
+            if (name.size() < 3 || name.compare(name.size() - 3, 3, "[0]") != 0)
+                continue;
+            std::string array = name.substr(0, name.size() - 3);
+            mLocations[array] = found;
+            for (GLint e = 1; e < size; e++)
+            {
+                std::string element = array + "[" + std::to_string(e) + "]";
+                mLocations[element] = glGetUniformLocation(ID, element.c_str());
+            }
+        }
+    }
+    // the code with each line `#include "file"` replaced by that file, found next to `path`
+    // ------------------------------------------------------------------------
+    std::string resolveIncludes(const std::string &code, const std::string &path)
+    {
+        std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+        std::stringstream in(code), out;
+        std::string line;
+        while (std::getline(in, line))
+        {
+            size_t start = line.find_first_not_of(" \t");
+            if (start == std::string::npos || line.compare(start, 10, "#include \"") != 0)
+            {
+                out << line << "\n";
+                continue;
+            }
+            size_t end = line.find('"', start + 10);
+            std::string name = line.substr(start + 10, end == std::string::npos ? std::string::npos : end - start - 10);
+            std::ifstream included(directory + name);
+            if (!included)
+            {
+                std::cout << "ERROR::SHADER::INCLUDE_NOT_FOUND " << name << std::endl;
+                continue;
+            }
+            out << included.rdbuf() << "\n";
+        }
+        return out.str();
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
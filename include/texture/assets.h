@@ -0,0 +1,50 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+using namespace std;
+
+// planet textures, resampled to one size as the layers of a texture array; bodies past
+// the last one start over
+const int PLANET_TEXTURES = 6;
+const int PLANET_WIDTH = 1024;
+const int PLANET_HEIGHT = 512;
+
+// paths from the build directory, as everything else; the .tex files are written by texpack
+const char *PLANET_ROOT = "../asset/texture/planet/";
+const char *SKYBOX_PACKED = "../asset/texture/skybox/skybox.tex";
+
+// 01_<type>.png ~ <n>_<type>.png
+vector<string> planetFiles(const char *type, int n)
+{
+    vector<string> files;
+    for (int i = 1; i < n + 1; i++)
+    {
+        char name[64];
+        sprintf(name, "%.2d_%s.png", i, type);
+        files.push_back(string(PLANET_ROOT) + name);
+    }
+    return files;
+}
+
+string planetPacked(const char *type)
+{
+    return string(PLANET_ROOT) + type + ".tex";
+}
+
+// order: +X (right), -X (left), +Y (top), -Y (bottom), +Z (front), -Z (back)
+vector<string> skyboxFaces()
+{
+    return {
+        "../asset/texture/skybox/StarSkybox043.png",
+        "../asset/texture/skybox/StarSkybox044.png",
+        "../asset/texture/skybox/StarSkybox045.png",
+        "../asset/texture/skybox/StarSkybox046.png",
+        "../asset/texture/skybox/StarSkybox041.png",
+        "../asset/texture/skybox/StarSkybox042.png"
+    };
+}
+
+#endif
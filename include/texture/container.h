@@ -0,0 +1,187 @@
+#ifndef CONTAINER_H
+#define CONTAINER_H
+
+#include <texture/image.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+using namespace std;
+
+const uint32_t TEXTURE_VERSION = 1;
+const int TEXTURE_MAX_LEVELS = 16;
+// GL_COMPRESSED_RGB_S3TC_DXT1_EXT, the one format written so far
+const uint32_t TEXTURE_BC1 = 0x83F0;
+
+// "TBTX", then the header and every mip level, largest first, each level holding its
+// layers one after the other (the faces of a cube map in GL order)
+struct TextureHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t layers;
+    uint32_t levels;
+    uint32_t pad;
+    uint64_t offsets[TEXTURE_MAX_LEVELS];
+};
+
+// `layers` of the same size, mipmapped down to 1 x 1 and compressed to BC1
+bool writeTextureFile(const string &path, const vector<Image> &layers)
+{
+    if (layers.empty()) return false;
+    TextureHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "TBTX", 4);
+    header.version = TEXTURE_VERSION;
+    header.format = TEXTURE_BC1;
+    header.width = layers[0].width;
+    header.height = layers[0].height;
+    header.layers = layers.size();
+    header.levels = min(mipLevels(header.width, header.height), TEXTURE_MAX_LEVELS);
+
+    vector<unsigned char> data;
+    vector<Image> level = layers;
+    for (uint32_t l = 0; l < header.levels; l++)
+    {
+        header.offsets[l] = sizeof(header) + data.size();
+        size_t bytes = bc1Size(level[0].width, level[0].height);
+        for (auto &layer : level)
+        {
+            data.resize(data.size() + bytes);
+            compressBC1(layer, &data[data.size() - bytes]);
+            Image next;
+            halveImage(layer, next);
+            layer = move(next);
+        }
+    }
+
+    string tmp = path + ".tmp";
+    FILE *file = fopen(tmp.c_str(), "wb");
+    if (!file) return false;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(&data[0], 1, data.size(), file) == data.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// A texture file mapped read-only: levels are handed to GL straight from the mapping,
+// nothing is read or decoded up front
+class TextureFile
+{
+public:
+    TextureFile();
+    ~TextureFile();
+
+    bool open(const string &path);
+    void close();
+    // reads every page, so later copies out of the mapping do not wait for the disk
+    void prefetch();
+
+    const TextureHeader &header() const;
+    int levelWidth(int level) const;
+    int levelHeight(int level) const;
+    size_t layerSize(int level) const;
+    const unsigned char *layer(int level, int layer) const;
+
+private:
+    const unsigned char *mData = NULL;
+    size_t mSize = 0;
+    const TextureHeader *mHeader = NULL;
+
+    TextureFile(const TextureFile &);
+    TextureFile &operator=(const TextureFile &);
+};
+
+TextureFile::TextureFile() {}
+
+TextureFile::~TextureFile()
+{
+    close();
+}
+
+bool TextureFile::open(const string &path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(TextureHeader))
+    {
+        ::close(fd);
+        return false;
+    }
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) return false;
+    mData = (const unsigned char *)data;
+    mSize = info.st_size;
+    mHeader = (const TextureHeader *)mData;
+
+    // every level of every layer inside the file
+    bool ok = !memcmp(mHeader->magic, "TBTX", 4) && mHeader->version == TEXTURE_VERSION && mHeader->format == TEXTURE_BC1
+        && mHeader->width > 0 && mHeader->height > 0 && mHeader->layers > 0
+        && mHeader->levels > 0 && mHeader->levels <= (uint32_t)TEXTURE_MAX_LEVELS;
+    for (uint32_t l = 0; ok && l < mHeader->levels; l++)
+        ok = mHeader->offsets[l] <= mSize && (uint64_t)layerSize(l) * mHeader->layers <= mSize - mHeader->offsets[l];
+    if (!ok) close();
+    return ok;
+}
+
+void TextureFile::close()
+{
+    if (mData) munmap((void *)mData, mSize);
+    mData = NULL;
+    mSize = 0;
+    mHeader = NULL;
+}
+
+void TextureFile::prefetch()
+{
+    if (!mData) return;
+    madvise((void *)mData, mSize, MADV_WILLNEED);
+    volatile unsigned char sum = 0;
+    for (size_t i = 0; i < mSize; i += 4096)
+        sum += mData[i];
+}
+
+const TextureHeader &TextureFile::header() const
+{
+    return *mHeader;
+}
+
+int TextureFile::levelWidth(int level) const
+{
+    return max((int)mHeader->width >> level, 1);
+}
+
+int TextureFile::levelHeight(int level) const
+{
+    return max((int)mHeader->height >> level, 1);
+}
+
+size_t TextureFile::layerSize(int level) const
+{
+    return bc1Size(levelWidth(level), levelHeight(level));
+}
+
+const unsigned char *TextureFile::layer(int level, int layer) const
+{
+    return mData + mHeader->offsets[level] + layer * layerSize(level);
+}
+
+#endif
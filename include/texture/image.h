@@ -0,0 +1,212 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stb_image/stb_image.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+using namespace std;
+
+// 8-bit RGB pixels, rows top to bottom
+struct Image
+{
+    int width = 0;
+    int height = 0;
+    vector<unsigned char> pixels;
+};
+
+bool loadImage(const string &path, Image &image)
+{
+    int width, height, components;
+    unsigned char *data = stbi_load(path.c_str(), &width, &height, &components, 3);
+    if (!data) return false;
+    image.width = width;
+    image.height = height;
+    image.pixels.assign(data, data + (size_t)width * height * 3);
+    stbi_image_free(data);
+    return true;
+}
+
+// bilinear, to `width` x `height`
+void resampleImage(const Image &image, int width, int height, Image &result)
+{
+    result.width = width;
+    result.height = height;
+    result.pixels.resize((size_t)width * height * 3);
+    const unsigned char *src = &image.pixels[0];
+    for (int y = 0; y < height; y++)
+    {
+        float v = max((y + 0.5f) * image.height / height - 0.5f, 0.0f);
+        int y0 = min((int)v, image.height - 1), y1 = min(y0 + 1, image.height - 1);
+        float fy = v - y0;
+        for (int x = 0; x < width; x++)
+        {
+            float u = max((x + 0.5f) * image.width / width - 0.5f, 0.0f);
+            int x0 = min((int)u, image.width - 1), x1 = min(x0 + 1, image.width - 1);
+            float fx = u - x0;
+            for (int c = 0; c < 3; c++)
+            {
+                float top = src[(y0 * image.width + x0) * 3 + c] * (1 - fx) + src[(y0 * image.width + x1) * 3 + c] * fx;
+                float bottom = src[(y1 * image.width + x0) * 3 + c] * (1 - fx) + src[(y1 * image.width + x1) * 3 + c] * fx;
+                result.pixels[((size_t)y * width + x) * 3 + c] = (unsigned char)(top * (1 - fy) + bottom * fy + 0.5f);
+            }
+        }
+    }
+}
+
+// the next mip level, each pixel the mean of the 2 x 2 above it
+void halveImage(const Image &image, Image &result)
+{
+    result.width = max(image.width / 2, 1);
+    result.height = max(image.height / 2, 1);
+    result.pixels.resize((size_t)result.width * result.height * 3);
+    for (int y = 0; y < result.height; y++)
+    {
+        int y0 = min(2 * y, image.height - 1), y1 = min(2 * y + 1, image.height - 1);
+        for (int x = 0; x < result.width; x++)
+        {
+            int x0 = min(2 * x, image.width - 1), x1 = min(2 * x + 1, image.width - 1);
+            for (int c = 0; c < 3; c++)
+            {
+                int sum = image.pixels[((size_t)y0 * image.width + x0) * 3 + c] + image.pixels[((size_t)y0 * image.width + x1) * 3 + c]
+                        + image.pixels[((size_t)y1 * image.width + x0) * 3 + c] + image.pixels[((size_t)y1 * image.width + x1) * 3 + c];
+                result.pixels[((size_t)y * result.width + x) * 3 + c] = (unsigned char)((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+int mipLevels(int width, int height)
+{
+    int levels = 1;
+    while (width > 1 || height > 1)
+    {
+        width = max(width / 2, 1);
+        height = max(height / 2, 1);
+        levels++;
+    }
+    return levels;
+}
+
+// bytes of a BC1 (DXT1) image, 8 per block of 4 x 4
+size_t bc1Size(int width, int height)
+{
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 8;
+}
+
+static unsigned short packRGB565(const float color[3])
+{
+    int r = (int)(color[0] * 31.0f / 255.0f + 0.5f);
+    int g = (int)(color[1] * 63.0f / 255.0f + 0.5f);
+    int b = (int)(color[2] * 31.0f / 255.0f + 0.5f);
+    return (unsigned short)((min(max(r, 0), 31) << 11) | (min(max(g, 0), 63) << 5) | min(max(b, 0), 31));
+}
+
+static void unpackRGB565(unsigned short packed, float color[3])
+{
+    color[0] = ((packed >> 11) & 31) * 255.0f / 31.0f;
+    color[1] = ((packed >> 5) & 63) * 255.0f / 63.0f;
+    color[2] = (packed & 31) * 255.0f / 31.0f;
+}
+
+// one 4 x 4 block of RGB pixels: the endpoints are the extremes of the block along its
+// principal axis, found by a few power iterations on the covariance
+static void compressBlock(const unsigned char pixels[16][3], unsigned char block[8])
+{
+    float mean[3] = {0.0f, 0.0f, 0.0f};
+    for (int p = 0; p < 16; p++)
+        for (int c = 0; c < 3; c++)
+            mean[c] += pixels[p][c] / 16.0f;
+    float cov[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    for (int p = 0; p < 16; p++)
+    {
+        float d[3] = {pixels[p][0] - mean[0], pixels[p][1] - mean[1], pixels[p][2] - mean[2]};
+        cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+        cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+    }
+    float axis[3] = {1.0f, 1.0f, 1.0f};
+    for (int i = 0; i < 4; i++)
+    {
+        float next[3] = {cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                         cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                         cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]};
+        float length = sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if (length < 1e-6f) break;
+        for (int c = 0; c < 3; c++)
+            axis[c] = next[c] / length;
+    }
+
+    float lo = 1e30f, hi = -1e30f;
+    int loPixel = 0, hiPixel = 0;
+    for (int p = 0; p < 16; p++)
+    {
+        float t = (pixels[p][0] - mean[0]) * axis[0] + (pixels[p][1] - mean[1]) * axis[1] + (pixels[p][2] - mean[2]) * axis[2];
+        if (t < lo) { lo = t; loPixel = p; }
+        if (t > hi) { hi = t; hiPixel = p; }
+    }
+    float end0[3], end1[3];
+    for (int c = 0; c < 3; c++)
+    {
+        end0[c] = pixels[hiPixel][c];
+        end1[c] = pixels[loPixel][c];
+    }
+    unsigned short color0 = packRGB565(end0), color1 = packRGB565(end1);
+    // color0 > color1 selects the four color mode
+    if (color0 < color1) swap(color0, color1);
+
+    float palette[4][3];
+    unpackRGB565(color0, palette[0]);
+    unpackRGB565(color1, palette[1]);
+    for (int c = 0; c < 3; c++)
+    {
+        palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+        palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+    unsigned indices = 0;
+    if (color0 != color1)
+        for (int p = 0; p < 16; p++)
+        {
+            int best = 0;
+            float bestDistance = 1e30f;
+            for (int i = 0; i < 4; i++)
+            {
+                float d0 = pixels[p][0] - palette[i][0], d1 = pixels[p][1] - palette[i][1], d2 = pixels[p][2] - palette[i][2];
+                float distance = d0 * d0 + d1 * d1 + d2 * d2;
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    best = i;
+                }
+            }
+            indices |= (unsigned)best << (2 * p);
+        }
+
+    block[0] = color0 & 0xff;
+    block[1] = color0 >> 8;
+    block[2] = color1 & 0xff;
+    block[3] = color1 >> 8;
+    for (int i = 0; i < 4; i++)
+        block[4 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+// the image as BC1 blocks, row by row; edge blocks repeat the last row and column
+void compressBC1(const Image &image, unsigned char *blocks)
+{
+    int blocksX = (image.width + 3) / 4, blocksY = (image.height + 3) / 4;
+    unsigned char pixels[16][3];
+    for (int by = 0; by < blocksY; by++)
+        for (int bx = 0; bx < blocksX; bx++)
+        {
+            for (int p = 0; p < 16; p++)
+            {
+                int x = min(bx * 4 + p % 4, image.width - 1), y = min(by * 4 + p / 4, image.height - 1);
+                for (int c = 0; c < 3; c++)
+                    pixels[p][c] = image.pixels[((size_t)y * image.width + x) * 3 + c];
+            }
+            compressBlock(pixels, blocks + ((size_t)by * blocksX + bx) * 8);
+        }
+}
+
+#endif
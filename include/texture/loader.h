@@ -0,0 +1,354 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <pool/pool.h>
+#include <texture/container.h>
+#include <texture/image.h>
+
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// bytes handed to GL per update(), so a frame never stalls on a whole skybox
+const size_t TEXTURE_UPLOAD_BUDGET = 16 << 20;
+
+// true if the driver takes BC1 (S3TC) textures
+bool textureCompression()
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const GLubyte *name = glGetStringi(GL_EXTENSIONS, i);
+        if (name && !strcmp((const char *)name, "GL_EXT_texture_compression_s3tc"))
+            return true;
+    }
+    return false;
+}
+
+// Textures loaded behind the first frames instead of before them.  load*() returns at
+// once with a handle whose get() is a one-pixel placeholder; start() decodes every image
+// asked for on `threads` threads (0 for all cores), and update(), once per frame, streams
+// what is done to the GPU through a pixel buffer, a few MB at a time.  When the texture
+// file written by texpack is there and the driver takes BC1, its mip levels are copied
+// from the mapped file as they are, with no decoding and no mipmapping, in a sixth of the
+// memory; otherwise the PNGs are decoded and mipmapped as ever.
+class TextureLoader
+{
+public:
+    TextureLoader(int threads = 0);
+    ~TextureLoader();
+
+    // a texture array of `files`, resampled to `width` x `height`, or the first layers of `packed`
+    int loadArray(const vector<string> &files, int width, int height, const string &packed, glm::vec3 placeholder);
+    // a cube map of six `faces`, +X -X +Y -Y +Z -Z, or `packed`
+    int loadCubemap(const vector<string> &faces, const string &packed, glm::vec3 placeholder);
+    // decodes everything loaded so far in the background, nothing is loaded after
+    void start();
+    void update();
+
+    // the texture to bind for `texture`, its placeholder until all of it arrived
+    unsigned get(int texture);
+    bool isDone();
+
+private:
+    struct Texture
+    {
+        GLenum target;
+        unsigned id, placeholder;
+        int width, height, layers;
+        vector<string> files;
+        TextureFile file;
+        bool packed = false;
+        int pending = 0;                // layers not uploaded yet
+        size_t uploaded = 0;            // of a packed texture, levels times layers
+        bool ready = false;
+    };
+    // a decoded layer, or layer -1 for a packed texture whose file is in memory
+    struct Decoded
+    {
+        int texture;
+        int layer;
+        Image image;
+    };
+
+    ThreadPool mPool;
+    thread mWorker;
+    vector<pair<int, int>> mJobs;
+    atomic<size_t> mNext;
+    atomic<bool> mStop;
+
+    mutex mMutex;
+    deque<Decoded> mDecoded;    // from the workers
+    deque<Decoded> mReady;      // to upload, main thread only
+
+    vector<unique_ptr<Texture>> mTextures;
+    unsigned mPBO;
+    bool mCompression;
+
+    int create(GLenum target, int width, int height, int layers, const string &packed, glm::vec3 placeholder);
+    void decode(int texture, int layer);
+    size_t upload(Decoded &decoded);
+    const void *stage(const void *data, size_t bytes);
+    void finish(Texture &texture);
+};
+
+TextureLoader::TextureLoader(int threads) : mPool(threads), mNext(0), mStop(false)
+{
+    glGenBuffers(1, &mPBO);
+    mCompression = textureCompression();
+}
+
+TextureLoader::~TextureLoader()
+{
+    mStop = true;
+    if (mWorker.joinable()) mWorker.join();
+    for (auto &texture : mTextures)
+    {
+        glDeleteTextures(1, &texture->id);
+        if (!texture->ready) glDeleteTextures(1, &texture->placeholder);
+    }
+    glDeleteBuffers(1, &mPBO);
+}
+
+int TextureLoader::loadArray(const vector<string> &files, int width, int height, const string &packed, glm::vec3 placeholder)
+{
+    int index = create(GL_TEXTURE_2D_ARRAY, width, height, files.size(), packed, placeholder);
+    mTextures[index]->files = files;
+    return index;
+}
+
+int TextureLoader::loadCubemap(const vector<string> &faces, const string &packed, glm::vec3 placeholder)
+{
+    int index = create(GL_TEXTURE_CUBE_MAP, 0, 0, 6, packed, placeholder);
+    mTextures[index]->files = faces;
+    return index;
+}
+
+void TextureLoader::start()
+{
+    if (mWorker.joinable()) return;
+    mWorker = thread([this] {
+        mPool.run([this](int) {
+            for (size_t j = mNext++; j < mJobs.size() && !mStop; j = mNext++)
+                decode(mJobs[j].first, mJobs[j].second);
+        });
+    });
+}
+
+void TextureLoader::update()
+{
+    {
+        lock_guard<mutex> lock(mMutex);
+        while (!mDecoded.empty())
+        {
+            mReady.push_back(move(mDecoded.front()));
+            mDecoded.pop_front();
+        }
+    }
+    size_t bytes = 0;
+    while (!mReady.empty() && bytes < TEXTURE_UPLOAD_BUDGET)
+    {
+        bytes += upload(mReady.front());
+        Texture &texture = *mTextures[mReady.front().texture];
+        // a packed texture stays in front until its last level is in
+        if (mReady.front().layer >= 0 || texture.ready) mReady.pop_front();
+    }
+}
+
+unsigned TextureLoader::get(int texture)
+{
+    Texture &t = *mTextures[texture];
+    return t.ready ? t.id : t.placeholder;
+}
+
+bool TextureLoader::isDone()
+{
+    for (auto &texture : mTextures)
+        if (!texture->ready) return false;
+    return true;
+}
+
+// the texture and its placeholder; storage of a packed one is made here, of the others
+// when their layers arrive
+int TextureLoader::create(GLenum target, int width, int height, int layers, const string &packed, glm::vec3 placeholder)
+{
+    unique_ptr<Texture> texture(new Texture());
+    texture->target = target;
+    texture->width = width;
+    texture->height = height;
+    texture->layers = layers;
+    texture->pending = layers;
+    int index = mTextures.size();
+
+    unsigned char color[3];
+    for (int c = 0; c < 3; c++)
+        color[c] = (unsigned char)(glm::clamp(placeholder[c], 0.0f, 1.0f) * 255.0f + 0.5f);
+    glGenTextures(1, &texture->placeholder);
+    glBindTexture(target, texture->placeholder);
+    if (target == GL_TEXTURE_2D_ARRAY)
+        glTexImage3D(target, 0, GL_RGB8, 1, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, color);
+    else
+        for (int f = 0; f < 6; f++)
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, 0, GL_RGB8, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, color);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glGenTextures(1, &texture->id);
+    glBindTexture(target, texture->id);
+    GLenum wrap = target == GL_TEXTURE_2D_ARRAY ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, wrap);
+    glTexParameteri(target, GL_TEXTURE_WRAP_R, wrap);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // the file must hold at least the layers asked for, of the size asked for
+    TextureFile &file = texture->file;
+    texture->packed = mCompression && file.open(packed) && (int)file.header().layers >= layers
+        && (target == GL_TEXTURE_CUBE_MAP || ((int)file.header().width == width && (int)file.header().height == height));
+    if (texture->packed)
+    {
+        int levels = file.header().levels;
+        for (int l = 0; l < levels; l++)
+        {
+            if (target == GL_TEXTURE_2D_ARRAY)
+                glCompressedTexImage3D(target, l, TEXTURE_BC1, file.levelWidth(l), file.levelHeight(l), layers, 0, file.layerSize(l) * layers, NULL);
+            else
+                for (int f = 0; f < 6; f++)
+                    glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, l, TEXTURE_BC1, file.levelWidth(l), file.levelHeight(l), 0, file.layerSize(l), NULL);
+        }
+        glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        mJobs.push_back(make_pair(index, -1));
+    }
+    else
+    {
+        file.close();
+        if (target == GL_TEXTURE_2D_ARRAY)
+            glTexImage3D(target, 0, GL_RGB8, width, height, layers, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+        for (int l = 0; l < layers; l++)
+            mJobs.push_back(make_pair(index, l));
+    }
+    glBindTexture(target, 0);
+
+    mTextures.push_back(move(texture));
+    return index;
+}
+
+// on a worker
+void TextureLoader::decode(int texture, int layer)
+{
+    Texture &t = *mTextures[texture];
+    Decoded decoded;
+    decoded.texture = texture;
+    decoded.layer = layer;
+    if (layer < 0)
+        t.file.prefetch();
+    else if (!loadImage(t.files[layer], decoded.image))
+    {
+        cout << "Texture failed to load at path: " << t.files[layer] << endl;
+        // a missing face leaves the cube map incomplete, as it always did
+        if (t.target == GL_TEXTURE_2D_ARRAY)
+        {
+            Image gray;
+            gray.width = gray.height = 1;
+            gray.pixels.assign(3, 128);
+            resampleImage(gray, t.width, t.height, decoded.image);
+        }
+    }
+    else if (t.target == GL_TEXTURE_2D_ARRAY && (decoded.image.width != t.width || decoded.image.height != t.height))
+    {
+        Image resampled;
+        resampleImage(decoded.image, t.width, t.height, resampled);
+        decoded.image = move(resampled);
+    }
+
+    lock_guard<mutex> lock(mMutex);
+    mDecoded.push_back(move(decoded));
+}
+
+// one layer, or the next level of one layer of a packed texture; the bytes sent
+size_t TextureLoader::upload(Decoded &decoded)
+{
+    Texture &texture = *mTextures[decoded.texture];
+    size_t bytes = 0;
+    glBindTexture(texture.target, texture.id);
+    if (decoded.layer < 0)
+    {
+        TextureFile &file = texture.file;
+        int level = texture.uploaded / texture.layers, layer = texture.uploaded % texture.layers;
+        int width = file.levelWidth(level), height = file.levelHeight(level);
+        bytes = file.layerSize(level);
+        const void *data = stage(file.layer(level, layer), bytes);
+        if (texture.target == GL_TEXTURE_2D_ARRAY)
+            glCompressedTexSubImage3D(texture.target, level, 0, 0, layer, width, height, 1, TEXTURE_BC1, bytes, data);
+        else
+            glCompressedTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + layer, level, 0, 0, width, height, TEXTURE_BC1, bytes, data);
+        if (++texture.uploaded == (size_t)file.header().levels * texture.layers)
+        {
+            texture.pending = 0;
+            finish(texture);
+        }
+    }
+    else
+    {
+        Image &image = decoded.image;
+        bytes = image.pixels.size();
+        if (bytes)
+        {
+            const void *data = stage(&image.pixels[0], bytes);
+            if (texture.target == GL_TEXTURE_2D_ARRAY)
+                glTexSubImage3D(texture.target, 0, 0, 0, decoded.layer, image.width, image.height, 1, GL_RGB, GL_UNSIGNED_BYTE, data);
+            else
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + decoded.layer, 0, GL_RGB8, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+        }
+        if (--texture.pending == 0)
+        {
+            glGenerateMipmap(texture.target);
+            finish(texture);
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glBindTexture(texture.target, 0);
+    return bytes;
+}
+
+// `data` copied into the orphaned pixel buffer, so the copy to the GPU is the driver's
+// and not this frame's; what to pass GL for it, `data` itself if the buffer would not map
+const void *TextureLoader::stage(const void *data, size_t bytes)
+{
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mPBO);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+    void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!mapped)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return data;
+    }
+    memcpy(mapped, data, bytes);
+    if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)) return NULL;
+    // the store was lost, try again from client memory
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return data;
+}
+
+void TextureLoader::finish(Texture &texture)
+{
+    texture.ready = true;
+    texture.file.close();
+    texture.files.clear();
+    glDeleteTextures(1, &texture.placeholder);
+    texture.placeholder = 0;
+}
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef PROCEDURAL_H
+#define PROCEDURAL_H
+
+#include <glad/glad.h>
+
+#include <shader/shader.h>
+
+#include <algorithm>
+#include <iostream>
+using namespace std;
+
+// where the sphere shaders take the surface from, as in shader/sphere_lt.fs
+const int SURFACE_TEXTURES = 0;
+const int SURFACE_PROCEDURAL = 1;
+const int SURFACE_BAKED = 2;
+
+// procedural surfaces are baked, PROCEDURAL_BAKE_LAYERS bodies a frame, into a texture
+// array PROCEDURAL_CACHE_WIDTH wide and half as high when there are no more than
+// PROCEDURAL_CACHE_LAYERS bodies; a width of 0 leaves them to every fragment
+const int PROCEDURAL_CACHE_WIDTH = 512;
+const int PROCEDURAL_CACHE_LAYERS = 64;
+const int PROCEDURAL_BAKE_LAYERS = 4;
+
+// The surfaces of shader/planet.glsl, one layer per body seeded by its index, drawn once
+// into a mipmapped texture array laid out as the planet textures: color in RGB, the
+// specular strength in alpha.  Until the last layer is in, the shaders evaluate the
+// noise per fragment; after that, a texture fetch is all a fragment pays.
+class SurfaceCache
+{
+public:
+    SurfaceCache(int width, int layers);
+    ~SurfaceCache();
+
+    // bakes the next PROCEDURAL_BAKE_LAYERS layers with `bake` (shader/planet_bake.fs),
+    // the framebuffer and viewport are left as they were
+    void update(Shader &bake);
+    bool isDone();
+    unsigned getTexture();
+
+private:
+    unsigned mTexture, mFBO, mVAO;
+    int mWidth, mHeight, mLayers;
+    int mBaked = 0;
+};
+
+SurfaceCache::SurfaceCache(int width, int layers) : mWidth(width), mHeight(max(width / 2, 1)), mLayers(layers)
+{
+    glGenTextures(1, &mTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, mTexture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, mWidth, mHeight, mLayers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenFramebuffers(1, &mFBO);
+    // no attributes, tonemap.vs makes the triangle
+    glGenVertexArrays(1, &mVAO);
+}
+
+SurfaceCache::~SurfaceCache()
+{
+    glDeleteVertexArrays(1, &mVAO);
+    glDeleteFramebuffers(1, &mFBO);
+    glDeleteTextures(1, &mTexture);
+}
+
+void SurfaceCache::update(Shader &bake)
+{
+    if (isDone()) return;
+
+    GLint target, viewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, mFBO);
+    glViewport(0, 0, mWidth, mHeight);
+    glDisable(GL_DEPTH_TEST);
+    bake.use();
+    glBindVertexArray(mVAO);
+    for (int end = min(mBaked + PROCEDURAL_BAKE_LAYERS, mLayers); mBaked < end; mBaked++)
+    {
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, mTexture, 0, mBaked);
+        if (mBaked == 0 && glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            cout << "ERROR::SURFACE::FRAMEBUFFER_INCOMPLETE" << endl;
+        bake.setInt("seed", mBaked);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    if (isDone())
+    {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, mTexture);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+}
+
+bool SurfaceCache::isDone()
+{
+    return mBaked == mLayers;
+}
+
+unsigned SurfaceCache::getTexture()
+{
+    return mTexture;
+}
+
+#endif
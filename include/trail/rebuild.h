@@ -0,0 +1,260 @@
+#ifndef REBUILD_H
+#define REBUILD_H
+
+#include <glm/glm.hpp>
+
+#include <body/body.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <tuple>
+#include <vector>
+using namespace std;
+
+const size_t TRAIL_CACHE_BUDGET = 64 << 20;
+
+// Trails of a run that keeps none, for systems too large to keep a trail per body.  The
+// run only keeps keyframes (BodySystem::keyframes() without offsets); request() names
+// the bodies and frames in view, the stretches between keyframes that are not cached
+// are integrated again from their snapshot on worker threads, and the positions of the
+// requested bodies at every frame go to a cache.  Least recently used entries go first
+// once the cache is over its budget, so the memory follows what is looked at, not the
+// number of bodies times the length of the run.  The stretch after the newest keyframe
+// is still being integrated and is left out.
+class TrailRebuilder
+{
+public:
+    TrailRebuilder(int threads = 1, size_t budget = TRAIL_CACHE_BUDGET);
+    ~TrailRebuilder();
+
+    // queues what is missing of `bodies` over the frames [first, last]
+    void request(BodySystem &system, const vector<size_t> &bodies, long long first, long long last);
+    // what is cached of a requested body, oldest first; false while parts are missing
+    bool getTrail(size_t body, vector<glm::vec3> &points);
+    // after seekFrame() the history it rebuilt from is gone
+    void clear();
+
+    size_t getBytes();
+    size_t getPending();
+
+private:
+    // (first frame, last frame, body), a segment's frames include both its snapshots
+    typedef tuple<long long, long long, size_t> Key;
+    struct Entry
+    {
+        Key key;
+        vector<glm::vec3> points;
+    };
+    struct Job
+    {
+        unsigned generation;
+        HistorySegment segment;
+        vector<size_t> bodies;
+    };
+
+    size_t mBudget;
+    vector<thread> mWorkers;
+    mutex mMutex;
+    condition_variable mWake;
+    deque<Job> mJobs;
+    set<Key> mQueued;
+    list<Entry> mEntries;    // most recently used first
+    map<Key, list<Entry>::iterator> mIndex;
+    size_t mBytes = 0;
+    // also read without the lock by the integration of a job, which gives up on either
+    atomic<unsigned> mGeneration{0};
+    atomic<bool> mStop{false};
+
+    // segments of the last request, in order, clipped to its frames
+    vector<Key> mSpans;
+    long long mFirst = 0, mLast = -1;
+
+    void worker();
+    void store(const Key &key, vector<glm::vec3> &points);
+};
+
+TrailRebuilder::TrailRebuilder(int threads, size_t budget)
+{
+    mBudget = budget;
+    for (int t = 0; t < max(threads, 1); t++)
+        mWorkers.push_back(thread(&TrailRebuilder::worker, this));
+}
+
+TrailRebuilder::~TrailRebuilder()
+{
+    {
+        lock_guard<mutex> lock(mMutex);
+        mStop = true;
+    }
+    mWake.notify_all();
+    for (auto &w : mWorkers)
+        w.join();
+}
+
+void TrailRebuilder::request(BodySystem &system, const vector<size_t> &bodies, long long first, long long last)
+{
+    mFirst = first;
+    mLast = last;
+    mSpans.clear();
+
+    // the newest keyframe is still growing
+    int count = system.getKeyframeCount();
+    for (int s = 0; s + 1 < count; s++)
+    {
+        long long begin = system.getKeyframeFrame(s), end = system.getKeyframeFrame(s + 1);
+        if (end < first || begin > last) continue;
+        mSpans.push_back(Key(begin, end, 0));
+
+        vector<size_t> missing;
+        {
+            lock_guard<mutex> lock(mMutex);
+            for (size_t body : bodies)
+            {
+                Key key(begin, end, body);
+                if (!mIndex.count(key) && !mQueued.count(key)) missing.push_back(body);
+            }
+        }
+        if (missing.empty()) continue;
+
+        Job job;
+        system.getSegment(s, job.segment);
+        job.bodies = missing;
+        {
+            lock_guard<mutex> lock(mMutex);
+            job.generation = mGeneration;
+            for (size_t body : missing)
+                mQueued.insert(Key(begin, end, body));
+            mJobs.push_back(job);
+        }
+        mWake.notify_one();
+    }
+}
+
+bool TrailRebuilder::getTrail(size_t body, vector<glm::vec3> &points)
+{
+    points.clear();
+    bool complete = true;
+    lock_guard<mutex> lock(mMutex);
+    for (auto &span : mSpans)
+    {
+        long long begin = get<0>(span), end = get<1>(span);
+        auto found = mIndex.find(Key(begin, end, body));
+        if (found == mIndex.end())
+        {
+            complete = false;
+            continue;
+        }
+        // most recently used, and the frame shared with the previous segment only once
+        mEntries.splice(mEntries.begin(), mEntries, found->second);
+        const vector<glm::vec3> &segment = found->second->points;
+        long long from = max(begin, mFirst), to = min(end, mLast);
+        if (!points.empty() && from == begin) from++;
+        for (long long frame = from; frame <= to; frame++)
+            points.push_back(segment[frame - begin]);
+    }
+    return complete;
+}
+
+void TrailRebuilder::clear()
+{
+    lock_guard<mutex> lock(mMutex);
+    mGeneration++;
+    mJobs.clear();
+    mQueued.clear();
+    mEntries.clear();
+    mIndex.clear();
+    mBytes = 0;
+    mSpans.clear();
+}
+
+size_t TrailRebuilder::getBytes()
+{
+    lock_guard<mutex> lock(mMutex);
+    return mBytes;
+}
+
+size_t TrailRebuilder::getPending()
+{
+    lock_guard<mutex> lock(mMutex);
+    return mQueued.size();
+}
+
+void TrailRebuilder::worker()
+{
+    while (true)
+    {
+        Job job;
+        {
+            unique_lock<mutex> lock(mMutex);
+            mWake.wait(lock, [this] { return mStop || !mJobs.empty(); });
+            if (mStop) return;
+            job = mJobs.front();
+            mJobs.pop_front();
+        }
+        if (job.generation != mGeneration) continue;
+
+        // the same integrator on one thread gives the same frames as the run; a
+        // segment that starts collided never moves
+        HistorySegment &segment = job.segment;
+        BodySystem system(segment.bodies, false);
+        if (segment.parallel) system.parallel(1, segment.deterministic);
+        // a job outdated by clear() or shut down stops within a substep
+        system.abortWhen([this, &job] {
+            return mStop.load(memory_order_relaxed) || job.generation != mGeneration.load(memory_order_relaxed);
+        });
+
+        vector<vector<glm::vec3>> points(job.bodies.size());
+        for (size_t i = 0; i < job.bodies.size(); i++)
+            points[i].push_back(glm::vec3(segment.bodies[job.bodies[i]].getPosition()));
+        bool aborted = false;
+        for (size_t f = 0; f < segment.configs.size() && !aborted; f++)
+        {
+            if (!segment.collision)
+            {
+                system.config(segment.configs[f].x, segment.configs[f].y);
+                aborted = !system.update();
+            }
+            vector<Body> bodies = system.getBodies();
+            for (size_t i = 0; i < job.bodies.size(); i++)
+                points[i].push_back(glm::vec3(bodies[job.bodies[i]].getPosition()));
+        }
+
+        lock_guard<mutex> lock(mMutex);
+        if (mStop) return;
+        // clear() already forgot what an outdated job was queued for
+        if (aborted || job.generation != mGeneration) continue;
+        long long end = segment.frame + segment.configs.size();
+        for (size_t i = 0; i < job.bodies.size(); i++)
+        {
+            Key key(segment.frame, end, job.bodies[i]);
+            mQueued.erase(key);
+            store(key, points[i]);
+        }
+    }
+}
+
+// under the lock
+void TrailRebuilder::store(const Key &key, vector<glm::vec3> &points)
+{
+    mEntries.push_front(Entry());
+    mEntries.front().key = key;
+    mEntries.front().points.swap(points);
+    mIndex[key] = mEntries.begin();
+    mBytes += mEntries.front().points.size() * sizeof(glm::vec3);
+
+    while (mBytes > mBudget && mEntries.size() > 1)
+    {
+        Entry &oldest = mEntries.back();
+        mBytes -= oldest.points.size() * sizeof(glm::vec3);
+        mIndex.erase(oldest.key);
+        mEntries.pop_back();
+    }
+}
+
+#endif
@@ -0,0 +1,209 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <shader/shader.h>
+#include <trail/trail.h>
+
+#include <algorithm>
+#include <vector>
+using namespace std;
+
+// newest points of a trail kept on the GPU, at least the full-resolution part of it
+const size_t TRAIL_RING = 16384;
+
+// Trails drawn as line strips straight from GPU memory.  The newest points of every
+// trail sit in a ring of TRAIL_RING in one buffer, mapped once and for good where GL 4.4
+// allows it, and update() writes only the points pushed since the copy was last brought
+// up to date; the coarse history is uploaded when it changes, a few times per ring
+// length.  The fade with age is worked out in the shader (shader/trail.vs), so a trail
+// takes two draw calls and no per-point work on the CPU, whatever its length.
+class TrailRenderer
+{
+public:
+    TrailRenderer(size_t trails);
+    ~TrailRenderer();
+
+    // idempotent, updates that carry nothing new cost nothing
+    void update(size_t trail, const TrailUpdate &update);
+    // the first `count` trails, seen through the Camera block of `shader`
+    void draw(Shader &shader, size_t count);
+
+private:
+    struct Trail
+    {
+        unsigned generation = 0;
+        long long total = 0;     // points pushed up to the newest in the ring
+        long long start = 0;     // the oldest one the ring holds in order
+        size_t recent = 0;
+        unsigned version = 0;
+        bool hasHistory = false;
+        unsigned historyVAO = 0, historyVBO = 0;
+        size_t historyCount = 0;
+    };
+
+    vector<Trail> mTrails;
+    unsigned mRingVAO, mRingVBO, mRingEBO;
+    glm::vec3 *mMapped = nullptr;    // persistently mapped ring, else glBufferSubData
+    GLsync mFence = 0;               // the GPU's last read of the ring
+
+    void write(size_t trail, long long index, const glm::vec3 *points, size_t count);
+};
+
+TrailRenderer::TrailRenderer(size_t trails)
+{
+    mTrails.resize(trails);
+    size_t bytes = trails * TRAIL_RING * sizeof(glm::vec3);
+
+    glGenVertexArrays(1, &mRingVAO);
+    glGenBuffers(1, &mRingVBO);
+    glGenBuffers(1, &mRingEBO);
+
+    glBindVertexArray(mRingVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, mRingVBO);
+    if (GLAD_GL_VERSION_4_4)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, bytes, NULL, flags);
+        mMapped = (glm::vec3 *)glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, flags);
+    }
+    else
+    {
+        glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_DYNAMIC_DRAW);
+    }
+
+    // twice round the ring, so any run of points is one range of indices
+    vector<unsigned int> indices(2 * TRAIL_RING);
+    for (size_t i = 0; i < indices.size(); i++)
+        indices[i] = i % TRAIL_RING;
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mRingEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindVertexArray(0);
+}
+
+TrailRenderer::~TrailRenderer()
+{
+    if (mFence) glDeleteSync(mFence);
+    if (mMapped)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, mRingVBO);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+    for (auto &t : mTrails)
+    {
+        if (!t.historyVAO) continue;
+        glDeleteVertexArrays(1, &t.historyVAO);
+        glDeleteBuffers(1, &t.historyVBO);
+    }
+    glDeleteVertexArrays(1, &mRingVAO);
+    glDeleteBuffers(1, &mRingVBO);
+    glDeleteBuffers(1, &mRingEBO);
+}
+
+void TrailRenderer::update(size_t trail, const TrailUpdate &update)
+{
+    if (trail >= mTrails.size()) return;
+    Trail &t = mTrails[trail];
+    long long first = update.total - update.points.size();
+    if (t.generation != update.generation || update.total < t.total)
+    {
+        t.generation = update.generation;
+        t.total = t.start = first;
+        t.hasHistory = false;
+    }
+
+    // points that already left the full-resolution part leave a gap, the ring starts over
+    if (first > t.total) t.start = t.total = first;
+    long long from = max(t.total, update.total - (long long)TRAIL_RING);
+    if (from < update.total) write(trail, from, &update.points[from - first], update.total - from);
+    t.total = update.total;
+    t.start = max(t.start, t.total - (long long)TRAIL_RING);
+    t.recent = update.recent;
+
+    if (!update.hasHistory || (t.hasHistory && t.version == update.version)) return;
+    t.version = update.version;
+    t.hasHistory = true;
+    t.historyCount = update.history.size();
+    if (!t.historyVAO)
+    {
+        glGenVertexArrays(1, &t.historyVAO);
+        glGenBuffers(1, &t.historyVBO);
+        glBindVertexArray(t.historyVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, t.historyVBO);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        glEnableVertexAttribArray(0);
+        glBindVertexArray(0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, t.historyVBO);
+    glBufferData(GL_ARRAY_BUFFER, t.historyCount * sizeof(glm::vec3), update.history.data(), GL_DYNAMIC_DRAW);
+}
+
+void TrailRenderer::draw(Shader &shader, size_t count)
+{
+    shader.use();
+    shader.setInt("capacity", TRAIL_RING);
+    for (size_t i = 0; i < min(count, mTrails.size()); i++)
+    {
+        Trail &t = mTrails[i];
+        // the full-resolution part and the point before it, where the history ends
+        size_t ring = min<long long>(t.total - t.start, t.recent + 1);
+        size_t history = t.hasHistory ? t.historyCount : 0;
+        if (ring + history < 2) continue;
+        shader.setInt("total", ring + history);
+
+        if (history)
+        {
+            shader.setBool("ring", false);
+            glBindVertexArray(t.historyVAO);
+            glDrawArrays(GL_LINE_STRIP, 0, history);
+        }
+        if (ring)
+        {
+            size_t head = t.total % TRAIL_RING;
+            size_t first = (head + TRAIL_RING - ring) % TRAIL_RING;
+            shader.setBool("ring", true);
+            shader.setInt("base", i * TRAIL_RING);
+            shader.setInt("head", head);
+            glBindVertexArray(mRingVAO);
+            glDrawElementsBaseVertex(GL_LINE_STRIP, ring, GL_UNSIGNED_INT, (void*)(first * sizeof(unsigned int)), i * TRAIL_RING);
+        }
+    }
+    glBindVertexArray(0);
+
+    // the next write into the ring waits for these reads
+    if (!mMapped) return;
+    if (mFence) glDeleteSync(mFence);
+    mFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+// points numbered from `index` on, wrapping around the trail's ring
+void TrailRenderer::write(size_t trail, long long index, const glm::vec3 *points, size_t count)
+{
+    if (mMapped && mFence)
+    {
+        glClientWaitSync(mFence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        glDeleteSync(mFence);
+        mFence = 0;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, mRingVBO);
+    while (count)
+    {
+        size_t slot = index % TRAIL_RING;
+        size_t run = min(count, TRAIL_RING - slot);
+        size_t offset = trail * TRAIL_RING + slot;
+        if (mMapped)
+            copy(points, points + run, mMapped + offset);
+        else
+            glBufferSubData(GL_ARRAY_BUFFER, offset * sizeof(glm::vec3), run * sizeof(glm::vec3), points);
+        index += run;
+        points += run;
+        count -= run;
+    }
+}
+
+#endif
@@ -0,0 +1,841 @@
+#ifndef TRAIL_H
+#define TRAIL_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <queue>
+#include <vector>
+using namespace std;
+
+// coarser levels behind the full-resolution ring, each keeping 1/TRAIL_RATIO of the
+// points it takes from the level before
+const int TRAIL_LEVELS = 6;
+const int TRAIL_RATIO = 4;
+
+// a body gets a new trail point once its path turns TRAIL_ANGLE radians away from its
+// direction at the last point or strays TRAIL_TOLERANCE from that tangent line, and at
+// least every TRAIL_SPACING_MAX; never closer than TRAIL_SPACING_MIN to the last point
+const double TRAIL_ANGLE = 0.05;
+const double TRAIL_TOLERANCE = 0.01;
+const double TRAIL_SPACING_MIN = 0.01;
+const double TRAIL_SPACING_MAX = 2.0;
+
+// Trail points are stored in chunks of TRAIL_CHUNK: the first point of a chunk is its
+// double precision anchor, every point is a 16-bit offset from it per coordinate, in
+// steps of a power of two no finer than TRAIL_STEP_MIN.  A chunk's step per axis only
+// grows as far as its points need, so a trail point takes 7.5 bytes instead of 24 and
+// is off by half a step at most, 1/131072 within half a unit of the anchor.
+const int TRAIL_CHUNK = 32;
+const double TRAIL_STEP_MIN = 1.0 / 65536;
+
+struct TrailChunk
+{
+    glm::dvec3 anchor;
+    glm::dvec3 step;
+};
+
+// stores `point` at `slot` of a chunk whose points take [begin, slot), coarsening their
+// step if the new point is out of reach
+void packPoint(TrailChunk &chunk, int16_t *x, int16_t *y, int16_t *z, size_t begin, size_t slot, glm::dvec3 point);
+glm::dvec3 unpackPoint(const TrailChunk &chunk, int16_t x, int16_t y, int16_t z);
+
+// Read-only window on one body's trail inside a TrailBuffer, oldest point first.  It
+// points into the buffer, so it is valid until the next push or resize.
+class TrailView
+{
+public:
+    TrailView(const int16_t *x, const int16_t *y, const int16_t *z, const TrailChunk *chunks, size_t capacity,
+        size_t first, size_t count);
+
+    size_t size() const;
+    glm::dvec3 operator[](size_t i) const;
+    glm::dvec3 back() const;
+
+private:
+    const int16_t *mX;
+    const int16_t *mY;
+    const int16_t *mZ;
+    const TrailChunk *mChunks;
+    size_t mCapacity;
+    size_t mFirst;
+    size_t mCount;
+};
+
+// Last `capacity` trail points of every body, one ring per body.  Coordinates are kept
+// packed as separate x, y and z arrays laid out [body][slot]; a push is O(1) and
+// nothing is allocated after construction unless the capacity changes.  A chunk is
+// rewritten from its start, so refilling one forgets the old points left in it.
+class TrailBuffer
+{
+public:
+    TrailBuffer(size_t bodies = 0, size_t capacity = 0);
+
+    size_t getBodyCount() const;
+    size_t getCapacity() const;
+    // keeps the newest points of every body
+    void setCapacity(size_t capacity);
+    void clear();
+
+    // how many of the oldest points of a body the next push overwrites
+    size_t overflow(size_t body) const;
+    void push(size_t body, glm::dvec3 point);
+    // forgets the oldest `count` points of a body
+    void drop(size_t body, size_t count);
+    TrailView view(size_t body) const;
+
+private:
+    friend class CheckpointIO;
+
+    size_t mBodies;
+    size_t mCapacity;
+    size_t mChunkCount;    // per body
+    vector<int16_t> mX, mY, mZ;
+    vector<TrailChunk> mChunks;
+    vector<size_t> mHead;    // slot the next point goes to
+    vector<size_t> mCount;
+};
+
+// A trail packed the same way without the ring, points are appended and read back in
+// order.  The history levels are kept like this.  Dropping the oldest points frees whole
+// chunks only, so the points left are never packed again and keep their precision.
+class PackedTrail
+{
+public:
+    size_t size() const;
+    glm::dvec3 operator[](size_t i) const;
+    void decode(vector<glm::dvec3> &points) const;
+
+    void push(glm::dvec3 point);
+    void assign(const vector<glm::dvec3> &points);
+    void clear();
+    // forgets the oldest `count` points
+    void drop(size_t count);
+    size_t getChunkCount() const;
+    // how many of the oldest points the first `chunks` chunks hold
+    size_t frontPoints(size_t chunks) const;
+    // packs `points` in place of those, a multiple of TRAIL_CHUNK of them unless no
+    // chunk is left behind
+    void replaceFront(size_t chunks, const vector<glm::dvec3> &points);
+
+private:
+    friend class CheckpointIO;
+
+    size_t mFirst = 0;    // slot of the oldest point, the ones before it are dropped
+    vector<int16_t> mX, mY, mZ;
+    vector<TrailChunk> mChunks;
+};
+
+// What a renderer keeping its own copy of a trail needs to bring it up to date: the
+// newest points it does not have yet and, if that changed, the coarse history.  Within
+// one generation points are only appended; a new generation replaces everything.
+struct TrailUpdate
+{
+    unsigned generation = 0;
+    long long total = 0;          // points pushed in this generation
+    size_t recent = 0;            // of which the newest are still at full resolution
+    vector<glm::vec3> points;     // the newest pushed, the last is number `total`
+    unsigned version = 0;         // of the history
+    bool hasHistory = false;
+    vector<glm::vec3> history;    // all coarser levels, oldest first
+};
+
+// never 0, unique over all trails
+unsigned newTrailGeneration();
+
+// The whole trail history at bounded memory.  The newest points sit in a TrailBuffer at
+// full resolution; when a body's ring fills up, its older half is thinned by
+// Douglas-Peucker into the first history level, a full level spills its older half
+// into the next one the same way, and the last level thins its own oldest chunks in
+// place.  Every level holds at most `capacity` points per body and takes memory only as
+// points reach it, so the memory never grows past that, and the older the history the
+// coarser it is, keeping the points that carry the shape of the orbit.  A point is packed
+// again only when it moves down a level or the last level thins it.
+class TrailPyramid
+{
+public:
+    TrailPyramid(size_t bodies = 0, size_t capacity = 0);
+
+    size_t getBodyCount() const;
+    size_t getCapacity() const;
+    size_t getLevelCount() const;
+    void setCapacity(size_t capacity);
+    void clear();
+
+    void push(size_t body, glm::dvec3 point);
+    // the full-resolution part
+    TrailView view(size_t body) const;
+    // level 0 is the finest, points oldest first
+    const PackedTrail &history(size_t level, size_t body) const;
+    void setHistory(size_t level, size_t body, const vector<glm::dvec3> &points);
+
+    // the whole history of a body, oldest first, thinned to at most `budget` points and
+    // decoded to floats, ready to draw
+    void gather(size_t body, size_t budget, vector<glm::vec3> &points) const;
+    // what a copy holding the first `known` points of `generation` and the history at
+    // `version` is missing
+    void getUpdate(size_t body, unsigned generation, long long known, unsigned version, TrailUpdate &update) const;
+
+private:
+    friend class CheckpointIO;
+
+    TrailBuffer mRecent;
+    vector<PackedTrail> mHistory;    // [level][body]
+    unsigned mGeneration;
+    vector<long long> mPushed;
+    vector<unsigned> mVersions;      // bumped whenever a body's history changes
+
+    PackedTrail &packedLevel(size_t level, size_t body);
+    // moves the oldest `count` points of a level, -1 for the ring, into the next one
+    void spill(int level, size_t body, size_t count);
+    void append(size_t level, size_t body, const vector<glm::dvec3> &points);
+    // makes room for `room` points in the last level
+    void fitLast(size_t body, size_t room);
+    // thins the oldest whole chunks of the last level, up to half of it, false if too short
+    bool thinLast(size_t body);
+};
+
+// Decides per body when its trail needs a new point, so points go where the path bends:
+// a fast body on a straight line takes few, a slow one in a tight turn many.  The last
+// point and direction of motion there are kept per body as separate arrays and the
+// test runs without branches over all bodies, which the compiler vectorizes.
+class TrailSampler
+{
+public:
+    TrailSampler(size_t bodies = 0);
+
+    // last points from the trails, directions from their last segments
+    void reset(const TrailPyramid &trails);
+    // exactly as sampled, the trails keep it packed
+    glm::dvec3 getLast(size_t body) const;
+    void setLast(size_t body, glm::dvec3 last);
+    glm::dvec3 getDirection(size_t body) const;
+    // normalized, the body's velocity at its last trail point
+    void setDirection(size_t body, glm::dvec3 direction);
+
+    // current position of a body, then check() flags the bodies to take a point
+    void sample(size_t body, glm::dvec3 position);
+    size_t check();
+    bool flagged(size_t body) const;
+    // the body's trail took the sampled position, moving at `velocity`
+    void accept(size_t body, glm::dvec3 velocity);
+
+private:
+    vector<double> mX, mY, mZ;       // sampled positions
+    vector<double> mAX, mAY, mAZ;    // last trail points
+    vector<double> mDX, mDY, mDZ;    // unit direction of motion at the last points
+    vector<double> mFlags;           // 1.0 or 0.0, doubles keep the test one width
+};
+
+// Keeps the `target` points of a polyline that Douglas-Peucker picks first: the ends,
+// then always the point farthest from the segment it lies on.  Appends them to `out`.
+template <typename V>
+void decimateTrail(const V *points, size_t count, size_t target, vector<V> &out);
+
+void packPoint(TrailChunk &chunk, int16_t *x, int16_t *y, int16_t *z, size_t begin, size_t slot, glm::dvec3 point)
+{
+    if (slot == begin)
+    {
+        chunk.anchor = point;
+        chunk.step = glm::dvec3(TRAIL_STEP_MIN);
+        x[slot] = y[slot] = z[slot] = 0;
+        return;
+    }
+
+    int16_t *axes[3] = {x, y, z};
+    glm::dvec3 offset = point - chunk.anchor;
+    for (int a = 0; a < 3; a++)
+    {
+        double step = chunk.step[a];
+        while (fabs(offset[a]) / step > 32767.0 && step < 1e300)
+            step *= 2.0;
+        if (step != chunk.step[a])
+        {
+            // each doubling of the step costs the old points one bit
+            double ratio = chunk.step[a] / step;
+            for (size_t i = begin; i < slot; i++)
+                axes[a][i] = (int16_t)lround(axes[a][i] * ratio);
+            chunk.step[a] = step;
+        }
+        axes[a][slot] = (int16_t)lround(min(max(offset[a] / step, -32767.0), 32767.0));
+    }
+}
+
+glm::dvec3 unpackPoint(const TrailChunk &chunk, int16_t x, int16_t y, int16_t z)
+{
+    return chunk.anchor + chunk.step * glm::dvec3(x, y, z);
+}
+
+TrailView::TrailView(const int16_t *x, const int16_t *y, const int16_t *z, const TrailChunk *chunks, size_t capacity,
+    size_t first, size_t count)
+{
+    mX = x;
+    mY = y;
+    mZ = z;
+    mChunks = chunks;
+    mCapacity = capacity;
+    mFirst = first;
+    mCount = count;
+}
+
+size_t TrailView::size() const
+{
+    return mCount;
+}
+
+glm::dvec3 TrailView::operator[](size_t i) const
+{
+    size_t slot = mFirst + i;
+    if (slot >= mCapacity) slot -= mCapacity;
+    return unpackPoint(mChunks[slot / TRAIL_CHUNK], mX[slot], mY[slot], mZ[slot]);
+}
+
+glm::dvec3 TrailView::back() const
+{
+    return (*this)[mCount - 1];
+}
+
+TrailBuffer::TrailBuffer(size_t bodies, size_t capacity)
+{
+    mBodies = bodies;
+    mCapacity = capacity;
+    mChunkCount = (capacity + TRAIL_CHUNK - 1) / TRAIL_CHUNK;
+    mX.assign(bodies * capacity, 0);
+    mY.assign(bodies * capacity, 0);
+    mZ.assign(bodies * capacity, 0);
+    mChunks.resize(bodies * mChunkCount);
+    mHead.assign(bodies, 0);
+    mCount.assign(bodies, 0);
+}
+
+size_t TrailBuffer::getBodyCount() const
+{
+    return mBodies;
+}
+
+size_t TrailBuffer::getCapacity() const
+{
+    return mCapacity;
+}
+
+void TrailBuffer::setCapacity(size_t capacity)
+{
+    if (capacity == mCapacity) return;
+    TrailBuffer resized(mBodies, capacity);
+    for (size_t b = 0; b < mBodies; b++)
+    {
+        TrailView old = view(b);
+        size_t keep = min(old.size(), capacity);
+        for (size_t i = old.size() - keep; i < old.size(); i++)
+            resized.push(b, old[i]);
+    }
+    *this = resized;
+}
+
+void TrailBuffer::clear()
+{
+    fill(mHead.begin(), mHead.end(), 0);
+    fill(mCount.begin(), mCount.end(), 0);
+}
+
+size_t TrailBuffer::overflow(size_t body) const
+{
+    if (mCapacity == 0) return 0;
+    size_t head = mHead[body];
+    size_t length = head % TRAIL_CHUNK ? 1 : min((size_t)TRAIL_CHUNK, mCapacity - head);
+    return mCount[body] + length > mCapacity ? mCount[body] + length - mCapacity : 0;
+}
+
+void TrailBuffer::push(size_t body, glm::dvec3 point)
+{
+    if (mCapacity == 0) return;
+    size_t head = mHead[body], offset = body * mCapacity;
+    mCount[body] -= overflow(body);
+    packPoint(mChunks[body * mChunkCount + head / TRAIL_CHUNK], &mX[offset], &mY[offset], &mZ[offset],
+        head - head % TRAIL_CHUNK, head, point);
+    if (++mHead[body] == mCapacity) mHead[body] = 0;
+    mCount[body]++;
+}
+
+void TrailBuffer::drop(size_t body, size_t count)
+{
+    mCount[body] -= min(count, mCount[body]);
+}
+
+TrailView TrailBuffer::view(size_t body) const
+{
+    size_t offset = body * mCapacity;
+    size_t first = mHead[body] + mCapacity - mCount[body];
+    if (first >= mCapacity) first -= mCapacity;
+    return TrailView(mX.data() + offset, mY.data() + offset, mZ.data() + offset, mChunks.data() + body * mChunkCount,
+        mCapacity, first, mCount[body]);
+}
+
+size_t PackedTrail::size() const
+{
+    return mX.size() - mFirst;
+}
+
+glm::dvec3 PackedTrail::operator[](size_t i) const
+{
+    size_t slot = mFirst + i;
+    return unpackPoint(mChunks[slot / TRAIL_CHUNK], mX[slot], mY[slot], mZ[slot]);
+}
+
+void PackedTrail::decode(vector<glm::dvec3> &points) const
+{
+    points.resize(size());
+    for (size_t i = 0; i < size(); i++)
+        points[i] = (*this)[i];
+}
+
+void PackedTrail::push(glm::dvec3 point)
+{
+    size_t slot = mX.size();
+    if (slot % TRAIL_CHUNK == 0) mChunks.push_back(TrailChunk());
+    mX.push_back(0);
+    mY.push_back(0);
+    mZ.push_back(0);
+    packPoint(mChunks.back(), mX.data(), mY.data(), mZ.data(), slot - slot % TRAIL_CHUNK, slot, point);
+}
+
+void PackedTrail::assign(const vector<glm::dvec3> &points)
+{
+    clear();
+    for (auto &point : points)
+        push(point);
+}
+
+void PackedTrail::clear()
+{
+    mFirst = 0;
+    mX.clear();
+    mY.clear();
+    mZ.clear();
+    mChunks.clear();
+}
+
+void PackedTrail::drop(size_t count)
+{
+    mFirst += min(count, size());
+    if (mFirst == mX.size())
+    {
+        clear();
+        return;
+    }
+    size_t chunks = mFirst / TRAIL_CHUNK;
+    if (chunks == 0) return;
+    replaceFront(chunks, vector<glm::dvec3>());
+}
+
+void PackedTrail::replaceFront(size_t chunks, const vector<glm::dvec3> &points)
+{
+    size_t slots = min(chunks * TRAIL_CHUNK, mX.size());
+    PackedTrail front;
+    for (auto &point : points)
+        front.push(point);
+    for (vector<int16_t> *axis : {&mX, &mY, &mZ})
+        axis->erase(axis->begin(), axis->begin() + slots);
+    mX.insert(mX.begin(), front.mX.begin(), front.mX.end());
+    mY.insert(mY.begin(), front.mY.begin(), front.mY.end());
+    mZ.insert(mZ.begin(), front.mZ.begin(), front.mZ.end());
+    mChunks.erase(mChunks.begin(), mChunks.begin() + chunks);
+    mChunks.insert(mChunks.begin(), front.mChunks.begin(), front.mChunks.end());
+    mFirst = mFirst > slots ? mFirst - slots : 0;
+}
+
+size_t PackedTrail::getChunkCount() const
+{
+    return mChunks.size();
+}
+
+size_t PackedTrail::frontPoints(size_t chunks) const
+{
+    return min(chunks * TRAIL_CHUNK, mX.size()) - mFirst;
+}
+
+unsigned newTrailGeneration()
+{
+    static atomic<unsigned> generations(0);
+    return ++generations;
+}
+
+TrailPyramid::TrailPyramid(size_t bodies, size_t capacity) : mRecent(bodies, capacity)
+{
+    mGeneration = newTrailGeneration();
+    mPushed.assign(bodies, 0);
+    mVersions.assign(bodies, 0);
+    mHistory.resize(TRAIL_LEVELS * bodies);
+}
+
+size_t TrailPyramid::getBodyCount() const
+{
+    return mRecent.getBodyCount();
+}
+
+size_t TrailPyramid::getCapacity() const
+{
+    return mRecent.getCapacity();
+}
+
+size_t TrailPyramid::getLevelCount() const
+{
+    return TRAIL_LEVELS;
+}
+
+void TrailPyramid::setCapacity(size_t capacity)
+{
+    if (capacity == getCapacity()) return;
+    // nothing is lost, shrinking moves the surplus down the levels
+    for (size_t b = 0; b < getBodyCount(); b++)
+    {
+        size_t size = mRecent.view(b).size();
+        if (size > capacity) spill(-1, b, size - capacity);
+    }
+    mRecent.setCapacity(capacity);
+    for (int l = 0; l < TRAIL_LEVELS; l++)
+    {
+        for (size_t b = 0; b < getBodyCount(); b++)
+        {
+            size_t size = history(l, b).size();
+            if (size <= capacity) continue;
+            mVersions[b]++;
+            if (l + 1 < TRAIL_LEVELS) spill(l, b, size - capacity);
+            else fitLast(b, 0);
+        }
+    }
+}
+
+void TrailPyramid::clear()
+{
+    mRecent.clear();
+    for (auto &level : mHistory)
+        level.clear();
+    mGeneration = newTrailGeneration();
+    mPushed.assign(getBodyCount(), 0);
+}
+
+void TrailPyramid::push(size_t body, glm::dvec3 point)
+{
+    size_t lost = mRecent.overflow(body);
+    if (lost) spill(-1, body, max(lost, getCapacity() / 2));
+    mRecent.push(body, point);
+    mPushed[body]++;
+}
+
+TrailView TrailPyramid::view(size_t body) const
+{
+    return mRecent.view(body);
+}
+
+const PackedTrail &TrailPyramid::history(size_t level, size_t body) const
+{
+    return mHistory[level * getBodyCount() + body];
+}
+
+PackedTrail &TrailPyramid::packedLevel(size_t level, size_t body)
+{
+    return mHistory[level * getBodyCount() + body];
+}
+
+void TrailPyramid::setHistory(size_t level, size_t body, const vector<glm::dvec3> &points)
+{
+    mVersions[body]++;
+    if (points.size() <= getCapacity())
+    {
+        mHistory[level * getBodyCount() + body].assign(points);
+        return;
+    }
+    vector<glm::dvec3> thinned;
+    decimateTrail(&points[0], points.size(), getCapacity(), thinned);
+    mHistory[level * getBodyCount() + body].assign(thinned);
+}
+
+void TrailPyramid::gather(size_t body, size_t budget, vector<glm::vec3> &points) const
+{
+    points.clear();
+    for (int l = TRAIL_LEVELS - 1; l >= 0; l--)
+    {
+        const PackedTrail &level = history(l, body);
+        for (size_t i = 0; i < level.size(); i++)
+            points.push_back(glm::vec3(level[i]));
+    }
+    TrailView recent = view(body);
+    for (size_t i = 0; i < recent.size(); i++)
+        points.push_back(glm::vec3(recent[i]));
+
+    if (points.size() <= budget) return;
+    vector<glm::vec3> all;
+    all.swap(points);
+    decimateTrail(&all[0], all.size(), budget, points);
+}
+
+void TrailPyramid::getUpdate(size_t body, unsigned generation, long long known, unsigned version, TrailUpdate &update) const
+{
+    bool same = generation == mGeneration;
+    TrailView recent = view(body);
+    update.generation = mGeneration;
+    update.total = mPushed[body];
+    update.recent = recent.size();
+    // points already moved down the levels are only in the history
+    size_t fresh = min<long long>(update.total - (same ? known : 0), recent.size());
+    update.points.clear();
+    for (size_t i = recent.size() - fresh; i < recent.size(); i++)
+        update.points.push_back(glm::vec3(recent[i]));
+
+    update.version = mVersions[body];
+    update.hasHistory = !same || version != update.version;
+    update.history.clear();
+    if (!update.hasHistory) return;
+    for (int l = TRAIL_LEVELS - 1; l >= 0; l--)
+    {
+        const PackedTrail &level = history(l, body);
+        for (size_t i = 0; i < level.size(); i++)
+            update.history.push_back(glm::vec3(level[i]));
+    }
+}
+
+void TrailPyramid::spill(int level, size_t body, size_t count)
+{
+    mVersions[body]++;
+    vector<glm::dvec3> oldest;
+    if (level < 0)
+    {
+        TrailView recent = mRecent.view(body);
+        count = min(count, recent.size());
+        for (size_t i = 0; i < count; i++)
+            oldest.push_back(recent[i]);
+        mRecent.drop(body, count);
+    }
+    else
+    {
+        PackedTrail &from = packedLevel(level, body);
+        count = min(count, from.size());
+        for (size_t i = 0; i < count; i++)
+            oldest.push_back(from[i]);
+        from.drop(count);
+    }
+
+    vector<glm::dvec3> thinned;
+    decimateTrail(oldest.data(), oldest.size(), max<size_t>(count / TRAIL_RATIO, 2), thinned);
+    append(level + 1, body, thinned);
+}
+
+void TrailPyramid::append(size_t level, size_t body, const vector<glm::dvec3> &points)
+{
+    size_t capacity = getCapacity();
+    size_t size = history(level, body).size();
+    if (level + 1 == TRAIL_LEVELS) fitLast(body, points.size());
+    else if (size + points.size() > capacity && size)
+        spill(level, body, max(size / 2, size + points.size() - capacity));
+    PackedTrail &to = packedLevel(level, body);
+    for (auto &point : points)
+        to.push(point);
+}
+
+void TrailPyramid::fitLast(size_t body, size_t room)
+{
+    PackedTrail &last = packedLevel(TRAIL_LEVELS - 1, body);
+    size_t capacity = getCapacity();
+    while (last.size() + room > capacity && thinLast(body))
+        ;
+    if (last.size() + room <= capacity) return;
+
+    // a level too short for whole chunks to thin is packed again, down to half of what
+    // fits so this stays rare
+    vector<glm::dvec3> points, thinned;
+    last.decode(points);
+    size_t target = capacity > room ? (capacity - room) / 2 : 0;
+    if (target >= 2) decimateTrail(points.data(), points.size(), target, thinned);
+    last.assign(thinned);
+}
+
+bool TrailPyramid::thinLast(size_t body)
+{
+    // a multiple of TRAIL_RATIO chunks thins to whole chunks, the newer ones stay as packed
+    PackedTrail &last = packedLevel(TRAIL_LEVELS - 1, body);
+    size_t chunks = 0;
+    for (size_t c = TRAIL_RATIO; c <= last.getChunkCount() && last.frontPoints(c) <= last.size() / 2; c += TRAIL_RATIO)
+        chunks = c;
+    if (chunks == 0) return false;
+
+    size_t count = last.frontPoints(chunks);
+    vector<glm::dvec3> oldest, thinned;
+    for (size_t i = 0; i < count; i++)
+        oldest.push_back(last[i]);
+    decimateTrail(oldest.data(), count, chunks * TRAIL_CHUNK / TRAIL_RATIO, thinned);
+    last.replaceFront(chunks, thinned);
+    return true;
+}
+
+TrailSampler::TrailSampler(size_t bodies)
+{
+    mX.assign(bodies, 0.0);
+    mY.assign(bodies, 0.0);
+    mZ.assign(bodies, 0.0);
+    mAX.assign(bodies, 0.0);
+    mAY.assign(bodies, 0.0);
+    mAZ.assign(bodies, 0.0);
+    mDX.assign(bodies, 0.0);
+    mDY.assign(bodies, 0.0);
+    mDZ.assign(bodies, 0.0);
+    mFlags.assign(bodies, 0.0);
+}
+
+void TrailSampler::reset(const TrailPyramid &trails)
+{
+    for (size_t b = 0; b < mX.size(); b++)
+    {
+        TrailView trail = trails.view(b);
+        // an empty trail takes the next position, however close
+        glm::dvec3 direction(0.0);
+        if (trail.size() > 1) direction = trail.back() - trail[trail.size() - 2];
+        setLast(b, trail.size() ? trail.back() : glm::dvec3(HUGE_VAL));
+        setDirection(b, direction);
+    }
+}
+
+glm::dvec3 TrailSampler::getLast(size_t body) const
+{
+    return glm::dvec3(mAX[body], mAY[body], mAZ[body]);
+}
+
+void TrailSampler::setLast(size_t body, glm::dvec3 last)
+{
+    mAX[body] = last.x;
+    mAY[body] = last.y;
+    mAZ[body] = last.z;
+}
+
+glm::dvec3 TrailSampler::getDirection(size_t body) const
+{
+    return glm::dvec3(mDX[body], mDY[body], mDZ[body]);
+}
+
+void TrailSampler::setDirection(size_t body, glm::dvec3 direction)
+{
+    if (direction != glm::dvec3(0.0)) direction = glm::normalize(direction);
+    mDX[body] = direction.x;
+    mDY[body] = direction.y;
+    mDZ[body] = direction.z;
+}
+
+void TrailSampler::sample(size_t body, glm::dvec3 position)
+{
+    mX[body] = position.x;
+    mY[body] = position.y;
+    mZ[body] = position.z;
+}
+
+size_t TrailSampler::check()
+{
+    const double cos2 = cos(TRAIL_ANGLE) * cos(TRAIL_ANGLE);
+    const double tolerance2 = TRAIL_TOLERANCE * TRAIL_TOLERANCE;
+    const double min2 = TRAIL_SPACING_MIN * TRAIL_SPACING_MIN;
+    const double max2 = TRAIL_SPACING_MAX * TRAIL_SPACING_MAX;
+
+    size_t n = mX.size();
+    double count = 0.0;
+    const double *x = mX.data(), *y = mY.data(), *z = mZ.data();
+    const double *ax = mAX.data(), *ay = mAY.data(), *az = mAZ.data();
+    const double *dx = mDX.data(), *dy = mDY.data(), *dz = mDZ.data();
+    double *flags = mFlags.data();
+    for (size_t i = 0; i < n; i++)
+    {
+        // chord from the last point, its projection on the direction there and the
+        // distance off that tangent line
+        double cx = x[i] - ax[i], cy = y[i] - ay[i], cz = z[i] - az[i];
+        double length2 = cx * cx + cy * cy + cz * cz;
+        double along = cx * dx[i] + cy * dy[i] + cz * dz[i];
+        double off2 = length2 - along * along;
+        // positive once any limit is passed; the angle to the last segment is over
+        // TRAIL_ANGLE when along < cos(TRAIL_ANGLE) * |chord|, squared keeping the sign
+        double over = max(max(length2 - max2, off2 - tolerance2), cos2 * length2 - along * fabs(along));
+        double flag = length2 > min2 && over > 0.0 ? 1.0 : 0.0;
+        flags[i] = flag;
+        count += flag;
+    }
+    return (size_t)count;
+}
+
+bool TrailSampler::flagged(size_t body) const
+{
+    return mFlags[body] != 0.0;
+}
+
+void TrailSampler::accept(size_t body, glm::dvec3 velocity)
+{
+    mAX[body] = mX[body];
+    mAY[body] = mY[body];
+    mAZ[body] = mZ[body];
+    setDirection(body, velocity);
+}
+
+// squared distance from p to the segment ab
+template <typename V>
+double segmentDistance2(V p, V a, V b)
+{
+    V d = b - a;
+    double length2 = glm::dot(d, d);
+    double t = length2 > 0.0 ? glm::dot(p - a, d) / length2 : 0.0;
+    V e = p - (a + (typename V::value_type)min(max(t, 0.0), 1.0) * d);
+    return glm::dot(e, e);
+}
+
+struct TrailSegment
+{
+    double error;
+    size_t first, last, split;
+
+    bool operator<(const TrailSegment &other) const { return error < other.error; }
+};
+
+template <typename V>
+TrailSegment farthestPoint(const V *points, size_t first, size_t last)
+{
+    TrailSegment segment = {-1.0, first, last, first};
+    for (size_t i = first + 1; i < last; i++)
+    {
+        double error = segmentDistance2(points[i], points[first], points[last]);
+        if (error > segment.error)
+        {
+            segment.error = error;
+            segment.split = i;
+        }
+    }
+    return segment;
+}
+
+template <typename V>
+void decimateTrail(const V *points, size_t count, size_t target, vector<V> &out)
+{
+    if (count <= target || count <= 2)
+    {
+        out.insert(out.end(), points, points + count);
+        return;
+    }
+
+    vector<bool> keep(count, false);
+    keep[0] = keep[count - 1] = true;
+    size_t kept = 2;
+    priority_queue<TrailSegment> segments;
+    segments.push(farthestPoint(points, 0, count - 1));
+    while (kept < target && !segments.empty())
+    {
+        TrailSegment segment = segments.top();
+        segments.pop();
+        if (segment.split == segment.first) continue;
+        keep[segment.split] = true;
+        kept++;
+        segments.push(farthestPoint(points, segment.first, segment.split));
+        segments.push(farthestPoint(points, segment.split, segment.last));
+    }
+    for (size_t i = 0; i < count; i++)
+        if (keep[i]) out.push_back(points[i]);
+}
+
+#endif
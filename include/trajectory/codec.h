@@ -0,0 +1,403 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <queue>
+#include <vector>
+using namespace std;
+
+// Predictive coding of trajectory columns.
+//
+// Each value is predicted from the previous samples of the same body (constant, linear
+// or quadratic extrapolation of the reconstructed values).  The residual is
+//   lossless:  the difference of the order-preserving integer images of the doubles
+//   lossy:     the difference quantized to steps of 2 * errorBound, so every decoded
+//              value is within errorBound of the original
+// and is stored as its bit length, Huffman coded per column, followed by the bits
+// below the leading one.  Values the quantizer cannot represent (non-finite, or
+// residuals beyond 2^50 steps) are escaped and stored raw.
+
+const int CODEC_SYMBOLS = 66;           // bit lengths 0 ... 64, and the escape
+const int CODEC_ESCAPE = 65;
+const int CODEC_MAX_LENGTH = 24;        // longest Huffman code
+const int CODEC_LOOKUP_BITS = 11;
+
+struct TrajectoryCodec
+{
+    int order = 2;             // 0: previous value, 1: linear, 2: quadratic
+    double errorBound = 0.0;   // 0: lossless
+};
+
+class BitWriter
+{
+public:
+    vector<uint8_t> &bytes;
+
+    BitWriter(vector<uint8_t> &out) : bytes(out) {}
+
+    // n <= 32
+    void put(uint32_t value, int n)
+    {
+        mBuffer |= (uint64_t)value << mCount;
+        mCount += n;
+        while (mCount >= 8)
+        {
+            bytes.push_back((uint8_t)mBuffer);
+            mBuffer >>= 8;
+            mCount -= 8;
+        }
+    }
+
+    void put64(uint64_t value, int n)
+    {
+        if (n > 32)
+        {
+            put((uint32_t)value, 32);
+            value >>= 32;
+            n -= 32;
+        }
+        if (n > 0) put((uint32_t)value & (uint32_t)((1ULL << n) - 1), n);
+    }
+
+    void flush()
+    {
+        if (mCount > 0) bytes.push_back((uint8_t)mBuffer);
+        mBuffer = 0;
+        mCount = 0;
+    }
+
+private:
+    uint64_t mBuffer = 0;
+    int mCount = 0;
+};
+
+class BitReader
+{
+public:
+    BitReader(const uint8_t *data, size_t size) : mData(data), mEnd(data + size) {}
+
+    // the next n <= 32 bits without consuming them, zero past the end
+    uint32_t peek(int n)
+    {
+        refill();
+        return (uint32_t)(mBuffer & ((1ULL << n) - 1));
+    }
+
+    void skip(int n)
+    {
+        mBuffer >>= n;
+        mCount -= n;
+    }
+
+    uint32_t get(int n)
+    {
+        uint32_t value = peek(n);
+        skip(n);
+        return value;
+    }
+
+    uint64_t get64(int n)
+    {
+        if (n > 32)
+        {
+            uint64_t low = get(32);
+            return low | ((uint64_t)get(n - 32) << 32);
+        }
+        return n > 0 ? get(n) : 0;
+    }
+
+private:
+    const uint8_t *mData;
+    const uint8_t *mEnd;
+    uint64_t mBuffer = 0;
+    int mCount = 0;
+
+    void refill()
+    {
+        while (mCount <= 56)
+        {
+            uint64_t byte = mData < mEnd ? *mData++ : 0;
+            mBuffer |= byte << mCount;
+            mCount += 8;
+        }
+    }
+};
+
+// canonical Huffman code over CODEC_SYMBOLS symbols
+class Huffman
+{
+public:
+    uint8_t lengths[CODEC_SYMBOLS];
+    uint32_t codes[CODEC_SYMBOLS];   // bit reversed, ready for the LSB-first BitWriter
+
+    void build(const uint64_t *counts);
+    void assign();
+    void buildDecoder();
+    int decode(BitReader &in);
+
+private:
+    // CODEC_LOOKUP_BITS prefix -> symbol << 8 | length, 0 if the code is longer
+    vector<uint16_t> mLookup;
+    int mFirstCode[CODEC_MAX_LENGTH + 2];
+    int mFirstIndex[CODEC_MAX_LENGTH + 2];
+    int mCount[CODEC_MAX_LENGTH + 2];
+    vector<int> mSorted;
+};
+
+void Huffman::build(const uint64_t *counts)
+{
+    vector<uint64_t> weights(counts, counts + CODEC_SYMBOLS);
+    while (true)
+    {
+        memset(lengths, 0, sizeof(lengths));
+        typedef pair<uint64_t, int> Node;
+        priority_queue<Node, vector<Node>, greater<Node>> heap;
+        vector<int> parent;
+        for (int s = 0; s < CODEC_SYMBOLS; s++)
+        {
+            if (!weights[s]) continue;
+            heap.push(Node(weights[s], parent.size()));
+            parent.push_back(-1);
+        }
+        if (parent.size() == 1) heap.push(Node(0, parent.size())), parent.push_back(-1);
+        while (heap.size() > 1)
+        {
+            Node a = heap.top();
+            heap.pop();
+            Node b = heap.top();
+            heap.pop();
+            parent[a.second] = parent[b.second] = parent.size();
+            heap.push(Node(a.first + b.first, parent.size()));
+            parent.push_back(-1);
+        }
+
+        int leaf = 0, longest = 0;
+        for (int s = 0; s < CODEC_SYMBOLS; s++)
+        {
+            if (!weights[s]) continue;
+            int depth = 0;
+            for (int node = leaf++; parent[node] >= 0; node = parent[node])
+                depth++;
+            lengths[s] = depth;
+            longest = max(longest, depth);
+        }
+        if (longest <= CODEC_MAX_LENGTH) break;
+        // flatten the distribution until the code fits
+        for (auto &w : weights)
+            if (w) w = (w + 1) / 2;
+    }
+    assign();
+}
+
+// codes from lengths, in canonical order
+void Huffman::assign()
+{
+    int code = 0;
+    for (int length = 1; length <= CODEC_MAX_LENGTH; length++)
+    {
+        for (int s = 0; s < CODEC_SYMBOLS; s++)
+        {
+            if (lengths[s] != length) continue;
+            uint32_t reversed = 0;
+            for (int b = 0; b < length; b++)
+                reversed |= ((code >> b) & 1) << (length - 1 - b);
+            codes[s] = reversed;
+            code++;
+        }
+        code <<= 1;
+    }
+}
+
+void Huffman::buildDecoder()
+{
+    assign();
+    mLookup.assign(1 << CODEC_LOOKUP_BITS, 0);
+    mSorted.clear();
+    int code = 0;
+    for (int length = 1; length <= CODEC_MAX_LENGTH; length++)
+    {
+        mFirstCode[length] = code;
+        mFirstIndex[length] = mSorted.size();
+        mCount[length] = 0;
+        for (int s = 0; s < CODEC_SYMBOLS; s++)
+        {
+            if (lengths[s] != length) continue;
+            mSorted.push_back(s);
+            mCount[length]++;
+            if (length <= CODEC_LOOKUP_BITS)
+                for (uint32_t fill = codes[s]; fill < (1u << CODEC_LOOKUP_BITS); fill += 1u << length)
+                    mLookup[fill] = (s << 8) | length;
+            code++;
+        }
+        code <<= 1;
+    }
+}
+
+int Huffman::decode(BitReader &in)
+{
+    uint16_t entry = mLookup[in.peek(CODEC_LOOKUP_BITS)];
+    if (entry)
+    {
+        in.skip(entry & 0xFF);
+        return entry >> 8;
+    }
+    int code = 0;
+    for (int length = 1; length <= CODEC_MAX_LENGTH; length++)
+    {
+        code = (code << 1) | in.get(1);
+        if (code >= mFirstCode[length] && code - mFirstCode[length] < mCount[length])
+            return mSorted[mFirstIndex[length] + code - mFirstCode[length]];
+    }
+    return CODEC_ESCAPE;
+}
+
+// order-preserving map of doubles to unsigned integers
+uint64_t orderedBits(double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, 8);
+    return (bits >> 63) ? ~bits : bits | (1ULL << 63);
+}
+
+double fromOrderedBits(uint64_t bits)
+{
+    bits = (bits >> 63) ? bits & ~(1ULL << 63) : ~bits;
+    double value;
+    memcpy(&value, &bits, 8);
+    return value;
+}
+
+double predict(const double *previous, int available, int order)
+{
+    // previous[0] is the last sample, previous[1] the one before ...
+    if (available == 0) return 0.0;
+    if (order >= 2 && available >= 3) return 3.0 * previous[0] - 3.0 * previous[1] + previous[2];
+    if (order >= 1 && available >= 2) return 2.0 * previous[0] - previous[1];
+    return previous[0];
+}
+
+int bitLength(uint64_t value)
+{
+    return value ? 64 - __builtin_clzll(value) : 0;
+}
+
+// Encodes `samples` x `bodies` values stored [sample][body], appends to `out`.
+void encodeColumn(const double *values, uint32_t samples, uint32_t bodies, const TrajectoryCodec &codec, vector<uint8_t> &out)
+{
+    const double step = 2.0 * codec.errorBound;
+    const double LIMIT = 1125899906842624.0;   // 2^50
+    size_t count = (size_t)samples * bodies;
+    vector<uint64_t> residuals(count);
+    vector<uint8_t> symbols(count);
+    vector<double> history(3 * (size_t)bodies);   // last three reconstructed values per body
+    uint64_t counts[CODEC_SYMBOLS] = {0};
+
+    for (uint32_t s = 0; s < samples; s++)
+    {
+        for (uint32_t b = 0; b < bodies; b++)
+        {
+            size_t i = (size_t)s * bodies + b;
+            double *h = &history[3 * b];
+            double x = values[i];
+            double p = predict(h, min<uint32_t>(s, 3), codec.order);
+            double reconstructed = x;
+            uint64_t r;
+            int symbol;
+            if (step == 0.0)
+            {
+                uint64_t d = orderedBits(x) - orderedBits(p);
+                r = (d << 1) ^ (uint64_t)((int64_t)d >> 63);
+                symbol = bitLength(r);
+            }
+            else
+            {
+                double q = floor((x - p) / step + 0.5);
+                if (std::isfinite(q) && fabs(q) < LIMIT)
+                {
+                    int64_t qi = (int64_t)q;
+                    r = ((uint64_t)qi << 1) ^ (uint64_t)(qi >> 63);
+                    symbol = bitLength(r);
+                    reconstructed = p + q * step;
+                }
+                else
+                {
+                    memcpy(&r, &x, 8);
+                    symbol = CODEC_ESCAPE;
+                }
+            }
+            residuals[i] = r;
+            symbols[i] = symbol;
+            counts[symbol]++;
+            h[2] = h[1];
+            h[1] = h[0];
+            h[0] = reconstructed;
+        }
+    }
+
+    Huffman huffman;
+    huffman.build(counts);
+    out.insert(out.end(), huffman.lengths, huffman.lengths + CODEC_SYMBOLS);
+
+    BitWriter writer(out);
+    for (size_t i = 0; i < count; i++)
+    {
+        int symbol = symbols[i];
+        writer.put(huffman.codes[symbol], huffman.lengths[symbol]);
+        if (symbol == CODEC_ESCAPE)
+            writer.put64(residuals[i], 64);
+        else if (symbol > 1)
+            writer.put64(residuals[i], symbol - 1);   // the leading one is implied
+    }
+    writer.flush();
+}
+
+// Inverse of encodeColumn, reads `size` bytes.  Returns false on malformed input.
+bool decodeColumn(const uint8_t *data, size_t size, uint32_t samples, uint32_t bodies, const TrajectoryCodec &codec, double *values)
+{
+    if (size < CODEC_SYMBOLS) return false;
+    Huffman huffman;
+    for (int s = 0; s < CODEC_SYMBOLS; s++)
+    {
+        huffman.lengths[s] = data[s];
+        if (data[s] > CODEC_MAX_LENGTH) return false;
+    }
+    huffman.buildDecoder();
+
+    const double step = 2.0 * codec.errorBound;
+    vector<double> history(3 * (size_t)bodies);
+    BitReader reader(data + CODEC_SYMBOLS, size - CODEC_SYMBOLS);
+    for (uint32_t s = 0; s < samples; s++)
+    {
+        for (uint32_t b = 0; b < bodies; b++)
+        {
+            double *h = &history[3 * b];
+            double p = predict(h, min<uint32_t>(s, 3), codec.order);
+            int symbol = huffman.decode(reader);
+            double x;
+            if (symbol == CODEC_ESCAPE)
+            {
+                uint64_t bits = reader.get64(64);
+                memcpy(&x, &bits, 8);
+            }
+            else
+            {
+                uint64_t r = symbol == 0 ? 0 : (1ULL << (symbol - 1)) | reader.get64(symbol - 1);
+                uint64_t d = (r >> 1) ^ (0 - (r & 1));
+                if (step == 0.0)
+                    x = fromOrderedBits(orderedBits(p) + d);
+                else
+                    x = p + (double)(int64_t)d * step;
+            }
+            values[(size_t)s * bodies + b] = x;
+            h[2] = h[1];
+            h[1] = h[0];
+            h[0] = x;
+        }
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,229 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <body/body.h>
+#include <pool/pool.h>
+#include <trajectory/trajectory.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+using namespace std;
+
+// a trail pyramid of the player that follows no body
+const size_t NO_TRAIL_BODY = (size_t)-1;
+
+// Plays a recorded trajectory at any speed, in either direction.  No physics runs:
+// between two samples each body follows the cubic Hermite curve through the stored
+// positions and velocities, so the motion stays smooth however sparse the samples.
+// Bodies are interpolated on `threads` threads (0 for all cores).
+class TrajectoryPlayer
+{
+public:
+    TrajectoryPlayer(int threads = 0);
+    ~TrajectoryPlayer();
+
+    bool open(string path);
+    uint32_t getBodyCount();
+    double getStartTime();
+    double getEndTime();
+    double getTime();
+    // mean time between two samples
+    double getSampleSpacing();
+
+    // both clamp to the recording, advance() goes backwards for dt < 0
+    void seek(double time);
+    void advance(double dt);
+
+    // the bodies at the current time, masses, radii and colors from the metadata
+    void getBodies(vector<Body> &bodies);
+    // Trails of `bodies`, one per pyramid of `trails` (each of one body): the recorded
+    // samples playback went through, behind the bodies in its `direction`.  A body keeps
+    // its pyramid while it stays among `bodies` and only the samples passed since the
+    // last call are pushed to it; a pyramid is refilled with as many samples as its
+    // full-resolution part holds for a new body, after a seek back or further than
+    // that, and when the direction turns.
+    void updateTrails(vector<TrailPyramid> &trails, const vector<size_t> &bodies, int direction);
+
+private:
+    TrajectoryReader mReader;
+    ThreadPool mPool;
+    double mTime = 0.0;
+
+    // body of each pyramid, NO_TRAIL_BODY for none, and where the trails are up to
+    vector<size_t> mTrailBodies;
+    uint64_t mTrailSample = 0;
+    int mTrailDirection = 0;
+
+    // position and velocity columns of a sample, offset to its first body
+    bool getRow(uint64_t sample, const double *columns[6]);
+    // pushes samples `from` to `to` in their direction to the pyramids `slots`
+    void pushSamples(vector<TrailPyramid> &trails, const vector<size_t> &slots, uint64_t from, uint64_t to);
+};
+
+TrajectoryPlayer::TrajectoryPlayer(int threads) : mPool(threads) {}
+
+TrajectoryPlayer::~TrajectoryPlayer() {}
+
+bool TrajectoryPlayer::open(string path)
+{
+    if (!mReader.open(path) || mReader.getSampleCount() == 0) return false;
+    mTime = getStartTime();
+    return true;
+}
+
+uint32_t TrajectoryPlayer::getBodyCount()
+{
+    return mReader.getBodyCount();
+}
+
+double TrajectoryPlayer::getStartTime()
+{
+    return mReader.getChunks().front().firstTime;
+}
+
+double TrajectoryPlayer::getEndTime()
+{
+    return mReader.getChunks().back().lastTime;
+}
+
+double TrajectoryPlayer::getTime()
+{
+    return mTime;
+}
+
+double TrajectoryPlayer::getSampleSpacing()
+{
+    uint64_t samples = mReader.getSampleCount();
+    return samples > 1 ? (getEndTime() - getStartTime()) / (samples - 1) : 0.0;
+}
+
+void TrajectoryPlayer::seek(double time)
+{
+    mTime = min(max(time, getStartTime()), getEndTime());
+}
+
+void TrajectoryPlayer::advance(double dt)
+{
+    seek(mTime + dt);
+}
+
+bool TrajectoryPlayer::getRow(uint64_t sample, const double *columns[6])
+{
+    int chunk = mReader.findChunk(sample);
+    if (chunk < 0) return false;
+    uint64_t offset = (sample - mReader.getChunks()[chunk].firstSample) * mReader.getBodyCount();
+    for (int c = 0; c < 6; c++)
+    {
+        columns[c] = mReader.getColumn(chunk, c);
+        if (!columns[c]) return false;
+        columns[c] += offset;
+    }
+    return true;
+}
+
+void TrajectoryPlayer::getBodies(vector<Body> &bodies)
+{
+    uint32_t n = mReader.getBodyCount();
+    uint64_t i = mReader.findSample(mTime);
+    uint64_t j = min(i + 1, mReader.getSampleCount() - 1);
+    double t0 = mReader.getTime(i), h = mReader.getTime(j) - t0;
+    double s = h > 0.0 ? min(max((mTime - t0) / h, 0.0), 1.0) : 0.0;
+
+    // Hermite basis for positions and its derivative for velocities
+    double h00 = (1 + 2 * s) * (1 - s) * (1 - s), h10 = s * (1 - s) * (1 - s);
+    double h01 = s * s * (3 - 2 * s), h11 = s * s * (s - 1);
+    double d00 = 6 * s * (s - 1), d10 = (1 - s) * (1 - 3 * s);
+    double d01 = -d00, d11 = s * (3 * s - 2);
+
+    // both rows stay valid together, the reader keeps two chunks decoded
+    const double *a[6], *b[6];
+    if (!getRow(i, a) || !getRow(j, b))
+    {
+        bodies.clear();
+        return;
+    }
+    bodies.resize(n, Body(0.0));
+    int threads = mPool.size();
+    mPool.run([&](int t) {
+        for (uint32_t k = n * (uint64_t)t / threads; k < n * (uint64_t)(t + 1) / threads; k++)
+        {
+            glm::dvec3 p0(a[0][k], a[1][k], a[2][k]), v0(a[3][k], a[4][k], a[5][k]);
+            glm::dvec3 p1(b[0][k], b[1][k], b[2][k]), v1(b[3][k], b[4][k], b[5][k]);
+            glm::dvec3 position = h00 * p0 + h10 * h * v0 + h01 * p1 + h11 * h * v1;
+            glm::dvec3 velocity = h > 0.0 ? (d00 * p0 + d01 * p1) / h + d10 * v0 + d11 * v1 : v0;
+
+            if (mReader.hasMetadata())
+            {
+                BodyMetadata meta = mReader.getMetadata(k);
+                glm::vec3 color(meta.color[0], meta.color[1], meta.color[2]);
+                bodies[k] = Body(meta.mass, meta.radius, color, position, velocity);
+            }
+            else
+            {
+                bodies[k] = Body(1.0, 1.0, glm::vec3(1.0f), position, velocity);
+            }
+        }
+    });
+}
+
+void TrajectoryPlayer::updateTrails(vector<TrailPyramid> &trails, const vector<size_t> &bodies, int direction)
+{
+    // a refill takes the samples behind the current one, as far back as a pyramid holds
+    uint64_t last = mReader.findSample(mTime);
+    uint64_t rows = trails.empty() ? 0 : max<size_t>(trails[0].getCapacity(), 1) - 1;
+    uint64_t end = mReader.getSampleCount() - 1;
+    uint64_t behind = direction >= 0 ? (last > rows ? last - rows : 0) : min(last + rows, end);
+    bool restart = direction != mTrailDirection || (last > mTrailSample ? last - mTrailSample : mTrailSample - last) > rows;
+    if (direction > 0) restart = restart || last < mTrailSample;
+    if (direction < 0) restart = restart || last > mTrailSample;
+
+    // bodies no longer asked for give up their pyramids, new ones take the free ones
+    mTrailBodies.resize(trails.size(), NO_TRAIL_BODY);
+    vector<size_t> fresh, kept;
+    for (size_t s = 0; s < trails.size(); s++)
+    {
+        if (mTrailBodies[s] == NO_TRAIL_BODY || find(bodies.begin(), bodies.end(), mTrailBodies[s]) != bodies.end()) continue;
+        mTrailBodies[s] = NO_TRAIL_BODY;
+        trails[s].clear();
+    }
+    for (size_t b : bodies)
+    {
+        if (b >= mReader.getBodyCount() || find(mTrailBodies.begin(), mTrailBodies.end(), b) != mTrailBodies.end()) continue;
+        size_t s = find(mTrailBodies.begin(), mTrailBodies.end(), NO_TRAIL_BODY) - mTrailBodies.begin();
+        if (s == trails.size()) break;
+        mTrailBodies[s] = b;
+        fresh.push_back(s);
+    }
+    for (size_t s = 0; s < trails.size(); s++)
+    {
+        if (mTrailBodies[s] == NO_TRAIL_BODY || find(fresh.begin(), fresh.end(), s) != fresh.end()) continue;
+        (restart ? fresh : kept).push_back(s);
+    }
+
+    for (size_t s : fresh)
+        trails[s].clear();
+    pushSamples(trails, fresh, behind, last);
+    if (last != mTrailSample) pushSamples(trails, kept, direction >= 0 ? mTrailSample + 1 : mTrailSample - 1, last);
+    mTrailSample = last;
+    mTrailDirection = direction;
+}
+
+void TrajectoryPlayer::pushSamples(vector<TrailPyramid> &trails, const vector<size_t> &slots, uint64_t from, uint64_t to)
+{
+    if (slots.empty()) return;
+    int step = to >= from ? 1 : -1;
+    for (uint64_t sample = from;; sample += step)
+    {
+        const double *columns[6];
+        if (!getRow(sample, columns)) break;
+        for (size_t s : slots)
+        {
+            size_t k = mTrailBodies[s];
+            trails[s].push(0, glm::dvec3(columns[0][k], columns[1][k], columns[2][k]));
+        }
+        if (sample == to) break;
+    }
+}
+
+#endif
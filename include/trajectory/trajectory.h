@@ -0,0 +1,660 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <aio/aio.h>
+#include <body/body.h>
+#include <trajectory/codec.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Chunked, columnar trajectory file.
+//
+//   header:   "TBTR" u32 version u32 bodies u32 flags u32 samples per chunk u32 0
+//   metadata: (if TRAJECTORY_METADATA) per body f64 mass f64 radius f32 color[3] f32 0
+//   chunks:   "CHNK" u32 samples u32 codec u32 0 u64 payload size, payload
+//             raw payload: f64 time[samples], then the columns px py pz vx vy vz,
+//             each f64 [samples][bodies]
+//             predictive payload: f64 time[samples], u32 order u32 0 f64 error bound, then
+//             per column u64 size and the encoded bytes (codec.h), padded to 8 bytes
+//   index:    per chunk u64 offset u64 first sample u32 samples u32 0 f64 first time f64 last time
+//   footer:   u64 index offset u64 chunks "TBTI" u32 version
+//
+// Every record is a multiple of 8 bytes, so a mapped file can be read in place.  A file
+// without footer (e.g. after a crash) is indexed by walking its chunks.
+
+const uint32_t TRAJECTORY_VERSION = 1;
+const uint32_t TRAJECTORY_METADATA = 1;
+const uint32_t CODEC_RAW = 0;
+const uint32_t CODEC_PREDICTIVE = 1;
+
+// chunks hold about this many bytes, whatever the number of bodies
+const size_t TRAJECTORY_CHUNK_BYTES = 16 << 20;
+// chunks queued for the writer thread before append() blocks
+const int TRAJECTORY_QUEUE = 4;
+// compressed chunks the reader keeps decoded
+const int TRAJECTORY_DECODED = 2;
+
+struct TrajectoryChunk
+{
+    uint64_t offset;       // of the chunk header
+    uint64_t firstSample;
+    uint32_t samples;
+    uint32_t codec;
+    double firstTime;
+    double lastTime;
+};
+
+struct TrajectoryStats
+{
+    uint64_t rawBytes = 0;      // payload bytes uncompressed
+    uint64_t storedBytes = 0;   // payload bytes written
+    double encodeSeconds = 0.0;
+};
+
+struct BodyMetadata
+{
+    double mass;
+    double radius;
+    float color[3];
+    float unused;
+};
+
+class TrajectoryWriter
+{
+public:
+    TrajectoryWriter(string path, vector<Body> bodies, bool metadata = true, uint32_t codec = CODEC_RAW, TrajectoryCodec options = TrajectoryCodec());
+    ~TrajectoryWriter();
+
+    bool isOpen();
+    // copies one sample into the current chunk, hands full chunks to the writer thread
+    void append(double time, vector<Body> &bodies);
+    // flushes, writes the index and closes the file
+    void close();
+    // compression ratio and encode time so far, complete after close()
+    TrajectoryStats getStats();
+
+private:
+    struct Chunk
+    {
+        vector<double> times;
+        vector<double> columns;   // [6][samples][bodies]
+    };
+
+    AsyncFile mFile;
+    uint32_t mBodies;
+    uint32_t mSamplesPerChunk;
+    uint64_t mOffset = 0;
+    uint64_t mSamples = 0;
+    Chunk mCurrent;
+    vector<TrajectoryChunk> mIndex;
+    uint32_t mCodec;
+    TrajectoryCodec mOptions;
+    TrajectoryStats mStats;
+    vector<uint8_t> mEncoded;
+
+    thread mWriter;
+    mutex mMutex;
+    condition_variable mQueued;
+    condition_variable mTaken;
+    deque<Chunk> mQueue;
+    bool mClosing = false;
+
+    void reset(Chunk &chunk);
+    void submit();
+    void writer();
+    void writeChunk(Chunk &chunk);
+};
+
+TrajectoryWriter::TrajectoryWriter(string path, vector<Body> bodies, bool metadata, uint32_t codec, TrajectoryCodec options)
+{
+    mBodies = bodies.size();
+    mCodec = codec;
+    mOptions = options;
+    mSamplesPerChunk = max<size_t>(1, TRAJECTORY_CHUNK_BYTES / (8 + 48 * max<size_t>(1, mBodies)));
+    reset(mCurrent);
+
+    // written once and read back later if at all, so kept out of the page cache
+    if (!mFile.open(path, true, true))
+    {
+        cout << "Failed to open trajectory " << path << endl;
+        return;
+    }
+
+    uint32_t header[6] = {0, TRAJECTORY_VERSION, mBodies, metadata ? TRAJECTORY_METADATA : 0, mSamplesPerChunk, 0};
+    memcpy(header, "TBTR", 4);
+    mFile.write(header, sizeof(header));
+    mOffset = sizeof(header);
+    if (metadata)
+    {
+        vector<BodyMetadata> meta(mBodies);
+        for (int i = 0; i < mBodies; i++)
+        {
+            meta[i].mass = bodies[i].getMass();
+            meta[i].radius = bodies[i].getRadius();
+            for (int c = 0; c < 3; c++)
+                meta[i].color[c] = bodies[i].getColor()[c];
+            meta[i].unused = 0.0f;
+        }
+        mFile.write(&meta[0], meta.size() * sizeof(BodyMetadata));
+        mOffset += meta.size() * sizeof(BodyMetadata);
+    }
+
+    mWriter = thread(&TrajectoryWriter::writer, this);
+}
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+    close();
+}
+
+bool TrajectoryWriter::isOpen()
+{
+    return mFile.isOpen();
+}
+
+void TrajectoryWriter::reset(Chunk &chunk)
+{
+    chunk.times.clear();
+    chunk.times.reserve(mSamplesPerChunk);
+    chunk.columns.assign(6 * (size_t)mSamplesPerChunk * mBodies, 0.0);
+}
+
+void TrajectoryWriter::append(double time, vector<Body> &bodies)
+{
+    if (!mFile.isOpen()) return;
+
+    size_t sample = mCurrent.times.size();
+    size_t column = (size_t)mSamplesPerChunk * mBodies;
+    double *p = &mCurrent.columns[sample * mBodies];
+    for (int i = 0; i < mBodies; i++)
+    {
+        glm::dvec3 position = bodies[i].getPosition(), velocity = bodies[i].getVelocity();
+        for (int c = 0; c < 3; c++)
+        {
+            p[c * column + i] = position[c];
+            p[(3 + c) * column + i] = velocity[c];
+        }
+    }
+    mCurrent.times.push_back(time);
+
+    if (mCurrent.times.size() == mSamplesPerChunk) submit();
+}
+
+void TrajectoryWriter::submit()
+{
+    unique_lock<mutex> lock(mMutex);
+    mTaken.wait(lock, [this] { return mQueue.size() < TRAJECTORY_QUEUE; });
+    mQueue.push_back(Chunk());
+    mQueue.back().times.swap(mCurrent.times);
+    mQueue.back().columns.swap(mCurrent.columns);
+    lock.unlock();
+    mQueued.notify_one();
+    reset(mCurrent);
+}
+
+void TrajectoryWriter::writer()
+{
+    while (true)
+    {
+        Chunk chunk;
+        {
+            unique_lock<mutex> lock(mMutex);
+            mQueued.wait(lock, [this] { return mClosing || !mQueue.empty(); });
+            if (mQueue.empty()) return;
+            chunk.times.swap(mQueue.front().times);
+            chunk.columns.swap(mQueue.front().columns);
+            mQueue.pop_front();
+        }
+        mTaken.notify_one();
+        writeChunk(chunk);
+    }
+}
+
+// writes the filled part of each column, a partial last chunk is stored compacted
+void TrajectoryWriter::writeChunk(Chunk &chunk)
+{
+    uint32_t samples = chunk.times.size();
+    size_t column = (size_t)mSamplesPerChunk * mBodies;
+    uint64_t payload = (uint64_t)samples * 8 * (1 + 6 * mBodies);
+    mStats.rawBytes += payload;
+
+    if (mCodec == CODEC_PREDICTIVE)
+    {
+        auto start = chrono::steady_clock::now();
+        mEncoded.clear();
+        uint32_t order[2] = {(uint32_t)mOptions.order, 0};
+        mEncoded.insert(mEncoded.end(), (uint8_t *)order, (uint8_t *)(order + 2));
+        mEncoded.insert(mEncoded.end(), (uint8_t *)&mOptions.errorBound, (uint8_t *)(&mOptions.errorBound + 1));
+        for (int c = 0; c < 6; c++)
+        {
+            size_t at = mEncoded.size();
+            mEncoded.resize(at + 8);
+            encodeColumn(&chunk.columns[c * column], samples, mBodies, mOptions, mEncoded);
+            uint64_t size = mEncoded.size() - at - 8;
+            memcpy(&mEncoded[at], &size, 8);
+            mEncoded.resize((mEncoded.size() + 7) / 8 * 8, 0);
+        }
+        mStats.encodeSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        payload = samples * sizeof(double) + mEncoded.size();
+    }
+    mStats.storedBytes += payload;
+
+    uint32_t header[4] = {0, samples, mCodec, 0};
+    memcpy(header, "CHNK", 4);
+    mFile.write(header, sizeof(header));
+    mFile.write(&payload, sizeof(payload));
+    mFile.write(&chunk.times[0], samples * sizeof(double));
+    if (mCodec == CODEC_PREDICTIVE)
+        mFile.write(&mEncoded[0], mEncoded.size());
+    else
+        for (int c = 0; c < 6; c++)
+            mFile.write(&chunk.columns[c * column], (size_t)samples * mBodies * sizeof(double));
+
+    TrajectoryChunk entry;
+    entry.offset = mOffset;
+    entry.firstSample = mSamples;
+    entry.samples = samples;
+    entry.codec = mCodec;
+    entry.firstTime = chunk.times.front();
+    entry.lastTime = chunk.times.back();
+    mIndex.push_back(entry);
+
+    mOffset += sizeof(header) + sizeof(payload) + payload;
+    mSamples += samples;
+}
+
+void TrajectoryWriter::close()
+{
+    if (!mFile.isOpen()) return;
+    if (!mCurrent.times.empty()) submit();
+    {
+        lock_guard<mutex> lock(mMutex);
+        mClosing = true;
+    }
+    mQueued.notify_one();
+    mWriter.join();
+
+    uint64_t indexOffset = mOffset;
+    for (auto &entry : mIndex)
+    {
+        uint32_t counts[2] = {entry.samples, 0};
+        mFile.write(&entry.offset, 8);
+        mFile.write(&entry.firstSample, 8);
+        mFile.write(counts, 8);
+        mFile.write(&entry.firstTime, 8);
+        mFile.write(&entry.lastTime, 8);
+    }
+    uint64_t footer[2] = {indexOffset, mIndex.size()};
+    uint32_t tail[2] = {0, TRAJECTORY_VERSION};
+    memcpy(tail, "TBTI", 4);
+    mFile.write(footer, sizeof(footer));
+    mFile.write(tail, sizeof(tail));
+
+    mFile.close();
+}
+
+TrajectoryStats TrajectoryWriter::getStats()
+{
+    return mStats;
+}
+
+// Random access to a trajectory file through a read-only mapping.  Raw chunks are read
+// in place; a compressed chunk is decoded whole on first access, the TRAJECTORY_DECODED
+// most recently used ones stay decoded.
+class TrajectoryReader
+{
+public:
+    TrajectoryReader();
+    ~TrajectoryReader();
+
+    bool open(string path);
+    void close();
+
+    uint32_t getBodyCount();
+    uint64_t getSampleCount();
+    bool hasMetadata();
+    BodyMetadata getMetadata(int body);
+    vector<TrajectoryChunk> &getChunks();
+
+    // NAN for a sample out of the recording
+    double getTime(uint64_t sample);
+    // last sample at or before `time` (the first sample if `time` precedes all)
+    uint64_t findSample(double time);
+    // samples [first, last) with t0 <= time <= t1
+    void findRange(double t0, double t1, uint64_t &first, uint64_t &last);
+    // false for a sample or body out of the recording, or a corrupt chunk
+    bool getPosition(uint64_t sample, int body, glm::dvec3 &position);
+    bool getVelocity(uint64_t sample, int body, glm::dvec3 &velocity);
+
+    // chunk holding a sample, -1 if none does
+    int findChunk(uint64_t sample);
+    // column c (px py pz vx vy vz) of a chunk, [samples][bodies]; for compressed chunks
+    // valid while the chunk is among the TRAJECTORY_DECODED last used, NULL if corrupt
+    const double *getColumn(int chunk, int c);
+    const double *getTimes(int chunk);
+
+private:
+    const char *mData = NULL;
+    size_t mSize = 0;
+    uint32_t mBodies = 0;
+    const BodyMetadata *mMetadata = NULL;
+    vector<TrajectoryChunk> mChunks;
+
+    struct DecodedChunk
+    {
+        int chunk = -1;
+        uint64_t used = 0;
+        vector<double> columns;   // [6][samples][bodies]
+    };
+    DecodedChunk mDecoded[TRAJECTORY_DECODED];
+    uint64_t mUses = 0;
+
+    bool decodeChunk(int chunk, DecodedChunk &decoded);
+    // columns first to first + 2 of a sample's row
+    bool getVector(uint64_t sample, int body, int first, glm::dvec3 &value);
+    bool checkChunk(uint64_t offset, uint64_t end, uint32_t &samples, uint32_t &codec, uint64_t &payload);
+    bool readIndex(uint64_t start);
+    void scanChunks(uint64_t offset);
+};
+
+TrajectoryReader::TrajectoryReader() {}
+
+TrajectoryReader::~TrajectoryReader()
+{
+    close();
+}
+
+bool TrajectoryReader::open(string path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < 24)
+    {
+        ::close(fd);
+        return false;
+    }
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) return false;
+    mData = (const char *)data;
+    mSize = info.st_size;
+
+    const uint32_t *header = (const uint32_t *)mData;
+    if (memcmp(mData, "TBTR", 4) || header[1] != TRAJECTORY_VERSION)
+    {
+        close();
+        return false;
+    }
+    mBodies = header[2];
+    uint64_t offset = 24;
+    if (header[3] & TRAJECTORY_METADATA)
+    {
+        if ((uint64_t)mBodies * sizeof(BodyMetadata) > mSize - offset)
+        {
+            close();
+            return false;
+        }
+        mMetadata = (const BodyMetadata *)(mData + offset);
+        offset += (uint64_t)mBodies * sizeof(BodyMetadata);
+    }
+    if (!readIndex(offset)) scanChunks(offset);
+    return true;
+}
+
+void TrajectoryReader::close()
+{
+    if (mData) munmap((void *)mData, mSize);
+    mData = NULL;
+    mSize = 0;
+    mMetadata = NULL;
+    mChunks.clear();
+    for (auto &decoded : mDecoded)
+    {
+        decoded.chunk = -1;
+        decoded.columns.clear();
+    }
+}
+
+// true if a whole chunk with at least its times, and all its columns if raw, lies at
+// `offset` before `end`
+bool TrajectoryReader::checkChunk(uint64_t offset, uint64_t end, uint32_t &samples, uint32_t &codec, uint64_t &payload)
+{
+    if (offset % 8 || offset > end || end - offset < 24 || memcmp(mData + offset, "CHNK", 4)) return false;
+    const uint32_t *header = (const uint32_t *)(mData + offset);
+    samples = header[1];
+    codec = header[2];
+    memcpy(&payload, mData + offset + 16, 8);
+    if (samples == 0 || payload > end - offset - 24 || payload / 8 / samples == 0) return false;
+    return codec != CODEC_RAW || payload / 8 / samples >= 1 + 6 * (uint64_t)mBodies;
+}
+
+// the chunks listed by the footer's index, if every one of them checks out; the chunks
+// start at `start`
+bool TrajectoryReader::readIndex(uint64_t start)
+{
+    if (mSize < start + 24) return false;
+    const char *tail = mData + mSize - 24;
+    const uint64_t *footer = (const uint64_t *)tail;
+    if (memcmp(tail + 16, "TBTI", 4)) return false;
+
+    uint64_t indexOffset = footer[0], count = footer[1];
+    if (indexOffset < start || count > (mSize - 24 - indexOffset) / 40 || indexOffset + count * 40 != mSize - 24) return false;
+    uint64_t samples = 0;
+    for (uint64_t i = 0; i < count; i++)
+    {
+        const char *p = mData + indexOffset + i * 40;
+        TrajectoryChunk entry;
+        memcpy(&entry.offset, p, 8);
+        memcpy(&entry.firstSample, p + 8, 8);
+        memcpy(&entry.samples, p + 16, 4);
+        memcpy(&entry.firstTime, p + 24, 8);
+        memcpy(&entry.lastTime, p + 32, 8);
+        uint32_t chunkSamples;
+        uint64_t payload;
+        if (entry.offset < start || !checkChunk(entry.offset, indexOffset, chunkSamples, entry.codec, payload)
+            || chunkSamples != entry.samples || entry.firstSample != samples)
+        {
+            mChunks.clear();
+            return false;
+        }
+        mChunks.push_back(entry);
+        samples += entry.samples;
+    }
+    return true;
+}
+
+void TrajectoryReader::scanChunks(uint64_t offset)
+{
+    uint64_t samples = 0;
+    TrajectoryChunk entry;
+    uint64_t payload;
+    while (checkChunk(offset, mSize, entry.samples, entry.codec, payload))
+    {
+        entry.offset = offset;
+        entry.firstSample = samples;
+        const double *times = (const double *)(mData + offset + 24);
+        entry.firstTime = times[0];
+        entry.lastTime = times[entry.samples - 1];
+        mChunks.push_back(entry);
+
+        samples += entry.samples;
+        offset += 24 + payload;
+    }
+}
+
+uint32_t TrajectoryReader::getBodyCount()
+{
+    return mBodies;
+}
+
+uint64_t TrajectoryReader::getSampleCount()
+{
+    return mChunks.empty() ? 0 : mChunks.back().firstSample + mChunks.back().samples;
+}
+
+bool TrajectoryReader::hasMetadata()
+{
+    return mMetadata != NULL;
+}
+
+BodyMetadata TrajectoryReader::getMetadata(int body)
+{
+    return mMetadata[body];
+}
+
+vector<TrajectoryChunk> &TrajectoryReader::getChunks()
+{
+    return mChunks;
+}
+
+int TrajectoryReader::findChunk(uint64_t sample)
+{
+    if (sample >= getSampleCount()) return -1;
+    int lo = 0, hi = mChunks.size() - 1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (mChunks[mid].firstSample <= sample) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
+}
+
+const double *TrajectoryReader::getTimes(int chunk)
+{
+    return (const double *)(mData + mChunks[chunk].offset + 24);
+}
+
+const double *TrajectoryReader::getColumn(int chunk, int c)
+{
+    uint64_t column = (uint64_t)mChunks[chunk].samples * mBodies;
+    if (mChunks[chunk].codec == CODEC_RAW)
+        return getTimes(chunk) + mChunks[chunk].samples + c * column;
+
+    DecodedChunk *slot = &mDecoded[0];
+    for (auto &decoded : mDecoded)
+    {
+        if (decoded.chunk == chunk)
+        {
+            slot = &decoded;
+            break;
+        }
+        if (decoded.used < slot->used) slot = &decoded;
+    }
+    if (slot->chunk != chunk && !decodeChunk(chunk, *slot)) return NULL;
+    slot->used = ++mUses;
+    return &slot->columns[c * column];
+}
+
+bool TrajectoryReader::decodeChunk(int chunk, DecodedChunk &decoded)
+{
+    decoded.chunk = -1;
+    TrajectoryChunk &entry = mChunks[chunk];
+    if (entry.codec != CODEC_PREDICTIVE) return false;
+
+    uint64_t payload;
+    memcpy(&payload, mData + entry.offset + 16, 8);
+    const char *p = mData + entry.offset + 24 + entry.samples * sizeof(double);
+    const char *end = mData + entry.offset + 24 + payload;
+    if (p + 16 > end) return false;
+
+    TrajectoryCodec options;
+    uint32_t order;
+    memcpy(&order, p, 4);
+    memcpy(&options.errorBound, p + 8, 8);
+    options.order = order;
+    p += 16;
+
+    uint64_t column = (uint64_t)entry.samples * mBodies;
+    decoded.columns.resize(6 * column);
+    for (int c = 0; c < 6; c++)
+    {
+        uint64_t size;
+        if (p + 8 > end) return false;
+        memcpy(&size, p, 8);
+        p += 8;
+        if (size > (uint64_t)(end - p)) return false;
+        if (!decodeColumn((const uint8_t *)p, size, entry.samples, mBodies, options, &decoded.columns[c * column]))
+            return false;
+        p += (size + 7) / 8 * 8;
+    }
+    decoded.chunk = chunk;
+    return true;
+}
+
+double TrajectoryReader::getTime(uint64_t sample)
+{
+    int chunk = findChunk(sample);
+    if (chunk < 0) return NAN;
+    return getTimes(chunk)[sample - mChunks[chunk].firstSample];
+}
+
+uint64_t TrajectoryReader::findSample(double time)
+{
+    if (mChunks.empty()) return 0;
+    int lo = 0, hi = mChunks.size() - 1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (mChunks[mid].firstTime <= time) lo = mid;
+        else hi = mid - 1;
+    }
+    const double *times = getTimes(lo);
+    uint32_t i = upper_bound(times, times + mChunks[lo].samples, time) - times;
+    return mChunks[lo].firstSample + (i ? i - 1 : 0);
+}
+
+void TrajectoryReader::findRange(double t0, double t1, uint64_t &first, uint64_t &last)
+{
+    first = findSample(t0);
+    if (getSampleCount() && getTime(first) < t0) first++;
+    last = findSample(t1) + 1;
+    if (last > getSampleCount()) last = getSampleCount();
+    if (last < first) last = first;
+}
+
+bool TrajectoryReader::getPosition(uint64_t sample, int body, glm::dvec3 &position)
+{
+    return getVector(sample, body, 0, position);
+}
+
+bool TrajectoryReader::getVelocity(uint64_t sample, int body, glm::dvec3 &velocity)
+{
+    return getVector(sample, body, 3, velocity);
+}
+
+bool TrajectoryReader::getVector(uint64_t sample, int body, int first, glm::dvec3 &value)
+{
+    int chunk = findChunk(sample);
+    if (chunk < 0 || body < 0 || (uint32_t)body >= mBodies) return false;
+    uint64_t row = (sample - mChunks[chunk].firstSample) * mBodies + body;
+    // all three columns come from the same decoded chunk
+    for (int c = 0; c < 3; c++)
+    {
+        const double *column = getColumn(chunk, first + c);
+        if (!column) return false;
+        value[c] = column[row];
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,14 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 Color;
+in float Energy;
+
+void main()
+{
+    vec2 offset = 2.0 * gl_PointCoord - 1.0;
+    float r2 = dot(offset, offset);
+    if (r2 > 1.0)
+        discard;
+    FragColor = vec4(Color * Energy * exp(-4.0 * r2), 1.0);
+}
@@ -0,0 +1,34 @@
+#version 330 core
+layout (location = 0) in vec4 aPositionMass;
+layout (location = 1) in vec4 aColor;
+
+out vec3 Color;
+out float Energy;
+
+// per frame, shared by all shaders (include/shader/frame.h)
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
+
+uniform float pixels;
+uniform float radius;
+uniform float maxSize;
+uniform float exposure;
+uniform float massScale;
+
+void main()
+{
+    // relative to the mean mass
+    float weight = aPositionMass.w * massScale;
+    gl_Position = projection * view * vec4(aPositionMass.xyz, 1.0);
+    // as wide as a body of this mass would look, but never less than a pixel
+    float size = 2.0 * radius * pow(weight, 1.0 / 3.0) * pixels / max(gl_Position.w, 1e-6);
+    gl_PointSize = clamp(size, 1.0, maxSize);
+    // the body's light spread over the pixels it covers, about 0.19 size^2 of the
+    // profile in galaxy.fs, so it stays the same at any size
+    Energy = exposure * weight / max(0.19 * gl_PointSize * gl_PointSize, 1.0);
+    Color = aColor.rgb;
+}
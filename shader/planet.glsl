@@ -0,0 +1,130 @@
+// Procedural planet surfaces, included by sphere_lt.fs and planet_bake.fs.  surface()
+// gives the color and the specular strength at a point of the unit sphere, in the body's
+// own coordinates, for the body seeded `seed`: gas giants in bands, rocky worlds with
+// oceans and continents, or cratered moons, each with its own colors and noise.
+
+uint hashUint(uint x)
+{
+    x ^= x >> 16u;
+    x *= 0x7feb352du;
+    x ^= x >> 15u;
+    x *= 0x846ca68bu;
+    x ^= x >> 16u;
+    return x;
+}
+
+// in [0, 1)
+float hashFloat(uint x)
+{
+    return float(hashUint(x) >> 8u) / 16777216.0;
+}
+
+float latticeValue(ivec3 cell, uint seed)
+{
+    uvec3 c = uvec3(cell);
+    return hashFloat(c.x ^ hashUint(c.y ^ hashUint(c.z ^ hashUint(seed))));
+}
+
+// smooth value noise in [0, 1]
+float valueNoise(vec3 p, uint seed)
+{
+    ivec3 cell = ivec3(floor(p));
+    vec3 f = fract(p);
+    vec3 w = f * f * (3.0 - 2.0 * f);
+    float n000 = latticeValue(cell, seed);
+    float n100 = latticeValue(cell + ivec3(1, 0, 0), seed);
+    float n010 = latticeValue(cell + ivec3(0, 1, 0), seed);
+    float n110 = latticeValue(cell + ivec3(1, 1, 0), seed);
+    float n001 = latticeValue(cell + ivec3(0, 0, 1), seed);
+    float n101 = latticeValue(cell + ivec3(1, 0, 1), seed);
+    float n011 = latticeValue(cell + ivec3(0, 1, 1), seed);
+    float n111 = latticeValue(cell + ivec3(1, 1, 1), seed);
+    return mix(mix(mix(n000, n100, w.x), mix(n010, n110, w.x), w.y),
+               mix(mix(n001, n101, w.x), mix(n011, n111, w.x), w.y), w.z);
+}
+
+// octaves of value noise, each twice as fine and half as strong, in [0, 1]
+float fbm(vec3 p, uint seed, int octaves)
+{
+    float sum = 0.0;
+    float amplitude = 0.5;
+    for (int i = 0; i < octaves; i++)
+    {
+        sum += amplitude * valueNoise(p, seed + uint(i));
+        p = p * 2.03 + vec3(17.1, 5.3, 11.7);
+        amplitude *= 0.5;
+    }
+    return sum / (1.0 - 2.0 * amplitude);
+}
+
+// 1 away from craters, darker in their bowls and brighter on their rims; one crater of
+// random size around a random point of every cell
+float craters(vec3 p, uint seed)
+{
+    ivec3 cell = ivec3(floor(p));
+    float shade = 1.0;
+    for (int z = -1; z <= 1; z++)
+        for (int y = -1; y <= 1; y++)
+            for (int x = -1; x <= 1; x++)
+            {
+                ivec3 c = cell + ivec3(x, y, z);
+                vec3 center = vec3(c) + vec3(latticeValue(c, seed), latticeValue(c, seed + 1u), latticeValue(c, seed + 2u));
+                float radius = 0.15 + 0.35 * latticeValue(c, seed + 3u);
+                float d = length(p - center) / radius;
+                if (d < 1.3)
+                    shade *= mix(0.7, 1.0, smoothstep(0.3, 1.0, d)) + 0.25 * exp(-(d - 1.0) * (d - 1.0) / 0.01);
+            }
+    return shade;
+}
+
+// a color of the seed, `saturation` of the way from sandy gray to fully saturated
+vec3 paletteColor(uint seed, float saturation)
+{
+    vec3 hue = 0.5 + 0.5 * cos(6.2831853 * (hashFloat(seed) + vec3(0.0, 0.33, 0.67)));
+    return mix(vec3(0.7, 0.62, 0.5), hue, saturation);
+}
+
+void surface(vec3 dir, uint seed, out vec3 color, out float specular)
+{
+    uint s = hashUint(seed);
+    float kind = hashFloat(s);
+    if (kind < 0.35)
+    {
+        // gas giant: bands of latitude, bent by turbulence
+        float turbulence = fbm(dir * 4.0, s, 4) - 0.5;
+        float bands = 4.0 + 10.0 * hashFloat(s + 4u);
+        float t = 0.5 + 0.5 * sin((dir.y + 0.15 * turbulence) * bands * 3.14159265);
+        color = mix(paletteColor(s + 5u, 0.5), paletteColor(s + 6u, 0.3), t) * (0.85 + 0.3 * fbm(dir * 16.0, s + 7u, 3));
+        specular = 0.05;
+    }
+    else if (kind < 0.7)
+    {
+        // rocky: continents where the noise rises above the sea
+        float height = fbm(dir * 2.5, s, 6);
+        float sea = 0.45 + 0.15 * hashFloat(s + 4u);
+        if (height < sea)
+        {
+            vec3 ocean = mix(vec3(0.02, 0.08, 0.25), paletteColor(s + 5u, 1.0) * 0.3, 0.3);
+            color = ocean * (0.6 + 0.4 * height / sea);
+            specular = 0.8;
+        }
+        else
+        {
+            vec3 low = mix(vec3(0.15, 0.35, 0.1), paletteColor(s + 6u, 0.5), 0.4);
+            vec3 high = vec3(0.45, 0.38, 0.3);
+            color = mix(low, high, smoothstep(0.0, 0.6, (height - sea) / (1.0 - sea)));
+            specular = 0.05;
+        }
+        // ice toward the poles
+        float ice = smoothstep(0.9, 0.95, abs(dir.y) + 0.1 * (fbm(dir * 8.0, s + 7u, 3) - 0.5));
+        color = mix(color, vec3(0.9), ice);
+        specular = mix(specular, 0.4, ice);
+    }
+    else
+    {
+        // airless rock, craters on craters
+        vec3 base = mix(vec3(0.5), paletteColor(s + 5u, 0.3), 0.5);
+        color = base * (0.7 + 0.5 * fbm(dir * 6.0, s, 4)) * craters(dir * 4.0, s + 8u) * craters(dir * 11.0, s + 9u);
+        specular = 0.1;
+    }
+}
@@ -0,0 +1,22 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// the body of the layer drawn, see include/texture/procedural.h
+uniform int seed;
+
+#include "planet.glsl"
+
+void main()
+{
+    // the point of the sphere at this texel, as createSphereVertices lays textures on it
+    float theta = TexCoords.x * 2.0 * 3.14159265;
+    float phi = TexCoords.y * 3.14159265;
+    vec3 dir = vec3(cos(theta) * sin(phi), cos(phi), sin(theta) * sin(phi));
+
+    vec3 color;
+    float specular;
+    surface(dir, uint(seed), color, specular);
+    FragColor = vec4(color, specular);
+}
@@ -0,0 +1,46 @@
+#version 330 core
+layout (location = 0) in vec2 aCorner;
+// per body, as for sphere_lt.vs
+layout (location = 3) in vec4 aCenterRadius;
+layout (location = 4) in vec3 aSpinLayerGlow;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;
+out vec3 Local;
+flat out float Layer;
+flat out vec4 CenterRadius;
+flat out float Spin;
+flat out float Glow;
+
+// per frame, shared by all shaders (include/shader/frame.h)
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
+
+void main()
+{
+    // a square through the center facing the eye, just wide enough for the silhouette
+    vec3 center = aCenterRadius.xyz;
+    float radius = aCenterRadius.w;
+    vec3 toward = center - viewPos;
+    float distance = length(toward);
+    float size = radius * distance / sqrt(max(distance * distance - radius * radius, 1e-6));
+    vec3 forward = toward / distance;
+    vec3 right = normalize(cross(forward, vec3(view[0][1], view[1][1], view[2][1])));
+    vec3 up = cross(right, forward);
+
+    FragPos = center + size * (aCorner.x * right + aCorner.y * up);
+    Normal = -forward;
+    TexCoords = vec2(0.0);
+    Local = vec3(0.0);
+    Layer = aSpinLayerGlow.y;
+    CenterRadius = aCenterRadius;
+    Spin = aSpinLayerGlow.x;
+    Glow = aSpinLayerGlow.z;
+
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -2,8 +2,8 @@
 out vec4 FragColor;
 
 struct Material {
-    sampler2D diffuse;
-    sampler2D specular;
+    sampler2DArray diffuse;
+    sampler2DArray specular;
     vec3 emission;
     float shininess;
 };
@@ -16,18 +16,6 @@ struct DirLight {
     vec3 specular;
 };
 
-struct PointLight {
-    vec3 position;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-
 struct SpotLight {
     vec3 position;
     vec3 direction;
@@ -43,43 +31,132 @@ struct SpotLight {
     float quadratic;
 };
 #define NR_DIRECT_LIGHTS 1
-#define NR_POINT_LIGHTS 2
 #define NR_SPOT_LIGHTS 1
 
 in vec3 Normal;
 in vec3 FragPos;
 in vec2 TexCoords;
-
-uniform vec3 viewPos;
+in vec3 Local;
+// texture layer, or the seed of a procedural surface
+flat in float Layer;
+// impostors only
+flat in vec4 CenterRadius;
+flat in float Spin;
+// stars shine by themselves
+flat in float Glow;
+
+// per frame, shared by all shaders (include/shader/frame.h)
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
+// a quad in front of the sphere, the surface is found by casting the view ray
+uniform bool impostor;
 uniform Material material;
-uniform DirLight dirLights[NR_DIRECT_LIGHTS];
-uniform PointLight pointLights[NR_POINT_LIGHTS];
+// where the surface comes from (include/texture/procedural.h): the material's textures,
+// planet.glsl for every fragment, or planet.glsl baked into the diffuse layers, with
+// the specular strength in alpha
+const int SURFACE_TEXTURES = 0;
+const int SURFACE_PROCEDURAL = 1;
+const int SURFACE_BAKED = 2;
+uniform int surfaces;
+layout (std140) uniform Lights
+{
+    DirLight dirLights[NR_DIRECT_LIGHTS];
+    vec3 ambient;
+    float falloff;
+    ivec4 clusters;
+    vec4 depth;
+};
+// the stars as point lights, binned per cluster (include/light/cluster.h)
+uniform samplerBuffer lightData;        // position and range, color, per light
+uniform usamplerBuffer clusterLights;   // first index and count, per cluster
+uniform usamplerBuffer lightIndices;
 uniform SpotLight spotLights[NR_SPOT_LIGHTS];
 
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcStarLight(int light, vec3 normal, vec3 fragPos, vec3 viewDir);
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 
+const float PI = 3.14159265;
+// texture coordinates and layer of the fragment
+vec3 Texel;
+// the surface at the fragment
+vec3 Diffuse;
+vec3 Specular;
+
+#include "planet.glsl"
+
 void main()
 {
+    vec3 fragPos = FragPos;
     vec3 norm = normalize(Normal);
-    vec3 viewDir = normalize(viewPos - FragPos);
-
-    vec3 result = vec3(0.0);
+    vec3 local = normalize(Local);
+    Texel = vec3(TexCoords, Layer);
+    gl_FragDepth = gl_FragCoord.z;
+    if (impostor)
+    {
+        vec3 ray = normalize(FragPos - viewPos);
+        vec3 offset = viewPos - CenterRadius.xyz;
+        float b = dot(ray, offset);
+        float disc = b * b - dot(offset, offset) + CenterRadius.w * CenterRadius.w;
+        if (disc < 0.0)
+            discard;
+        fragPos = viewPos + (-b - sqrt(disc)) * ray;
+        norm = (fragPos - CenterRadius.xyz) / CenterRadius.w;
+
+        // back to the mesh's own coordinates, see sphere_lt.vs and createSphereVertices
+        float s = sin(Spin);
+        float c = cos(Spin);
+        mat3 tilt = mat3(1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0, -1.0, 0.0);
+        mat3 spin = mat3(c, 0.0, -s, 0.0, 1.0, 0.0, s, 0.0, c);
+        local = transpose(tilt * spin) * norm;
+        Texel.xy = vec2(fract(atan(local.z, local.x) / (2.0 * PI)), acos(clamp(local.y, -1.0, 1.0)) / PI);
+
+        vec4 clip = projection * view * vec4(fragPos, 1.0);
+        gl_FragDepth = 0.5 * clip.z / clip.w + 0.5;
+    }
+    vec3 viewDir = normalize(viewPos - fragPos);
+
+    if (surfaces == SURFACE_PROCEDURAL)
+    {
+        float specular;
+        surface(local, uint(Layer), Diffuse, specular);
+        Specular = vec3(specular);
+    }
+    else if (surfaces == SURFACE_BAKED)
+    {
+        vec4 texel = texture(material.diffuse, Texel);
+        Diffuse = texel.rgb;
+        Specular = vec3(texel.a);
+    }
+    else
+    {
+        Diffuse = texture(material.diffuse, Texel).rgb;
+        Specular = texture(material.specular, Texel).rgb;
+    }
+
+    vec3 result = ambient * Diffuse;
     // for (int i = 0; i < NR_DIRECT_LIGHTS; i++)
     //     result += CalcDirLight(dirLights[i], norm, viewDir);
 
-    for (int i = 0; i < NR_POINT_LIGHTS; i++)
-        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
+    // only the stars that reach this fragment's cluster
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / depth.zw * vec2(clusters.xy)), ivec2(0), clusters.xy - 1);
+    float z = max(-(view * vec4(fragPos, 1.0)).z, 1e-4);
+    int slice = clamp(int(log(z) * depth.x + depth.y), 0, clusters.z - 1);
+    uvec2 range = texelFetch(clusterLights, (slice * clusters.y + tile.y) * clusters.x + tile.x).rg;
+    for (uint i = 0u; i < range.y; i++)
+        result += CalcStarLight(int(texelFetch(lightIndices, int(range.x + i)).r), norm, fragPos, viewDir);
     
     // for (int i = 0; i < NR_SPOT_LIGHTS; i++)
     //     result += CalcSpotLight(spotLights[i], norm, FragPos, viewDir);
     
-    // result += CalcPointLight(pointLight, norm, FragPos, viewDir);
-    
     // result += CalcSpotLight(spotLight, norm, FragPos, viewDir);
     
     // result += material.emission;
+    result += Glow * Diffuse;
 
     FragColor = vec4(result, 1.0);
 }
@@ -88,58 +165,55 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
 {
     vec3 lightDir = normalize(-light.direction);
 
-    vec3 ambient = light.ambient * texture(material.diffuse, TexCoords).rgb;
+    vec3 ambient = light.ambient * Diffuse;
     
     float diff = max(dot(normal, lightDir), 0.0);
-    vec3 diffuse = light.diffuse * diff * texture(material.diffuse, TexCoords).rgb;
+    vec3 diffuse = light.diffuse * diff * Diffuse;
 
     // vec3 reflectDir = reflect(-lightDir, normal);
     // float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     vec3 halfwayDir = normalize(lightDir + viewDir);
     float spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
-    vec3 specular = light.specular * spec * texture(material.specular, TexCoords).rgb;
+    vec3 specular = light.specular * spec * Specular;
 
     return (ambient + diffuse + specular);
 }
 
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec3 CalcStarLight(int light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
-    vec3 lightDir = normalize(light.position - fragPos);
-
-    vec3 ambient = light.ambient * texture(material.diffuse, TexCoords).rgb;
+    vec4 positionRange = texelFetch(lightData, 2 * light);
+    vec3 color = texelFetch(lightData, 2 * light + 1).rgb;
+    vec3 lightDir = normalize(positionRange.xyz - fragPos);
 
     float diff = max(dot(normal, lightDir), 0.0);
-    vec3 diffuse = light.diffuse * diff * texture(material.diffuse, TexCoords).rgb;
+    vec3 diffuse = diff * Diffuse;
 
-    // vec3 reflectDir = reflect(-lightDir, normal);
-    // float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     vec3 halfwayDir = normalize(lightDir + viewDir);
     float spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
-    vec3 specular = light.specular * spec * texture(material.specular, TexCoords).rgb;
+    vec3 specular = spec * Specular;
 
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
-    ambient *= attenuation;
-    diffuse *= attenuation;
-    specular *= attenuation;
+    // inverse square, faded to nothing at the light's range
+    float distance = length(positionRange.xyz - fragPos);
+    float window = clamp(1.0 - pow(distance / positionRange.w, 4.0), 0.0, 1.0);
+    float attenuation = window * window / (1.0 + (distance * distance) / (falloff * falloff));
 
-    return (ambient + diffuse + specular);
+    return color * attenuation * (diffuse + specular);
 }
 
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
     vec3 lightDir = normalize(light.position - fragPos);
 
-    vec3 ambient = light.ambient * texture(material.diffuse, TexCoords).rgb;
+    vec3 ambient = light.ambient * Diffuse;
 
     float diff = max(dot(normal, lightDir), 0.0);
-    vec3 diffuse = light.diffuse * diff * texture(material.diffuse, TexCoords).rgb;
+    vec3 diffuse = light.diffuse * diff * Diffuse;
     
     // vec3 reflectDir = reflect(-lightDir, normal);
     // float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     vec3 halfwayDir = normalize(lightDir + viewDir);
     float spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
-    vec3 specular = light.specular * spec * texture(material.specular, TexCoords).rgb;
+    vec3 specular = light.specular * spec * Specular;
 
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
@@ -2,20 +2,45 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// per body
+layout (location = 3) in vec4 aCenterRadius;
+layout (location = 4) in vec3 aSpinLayerGlow;
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+// the point of the unit sphere, unturned
+out vec3 Local;
+flat out float Layer;
+flat out vec4 CenterRadius;
+flat out float Spin;
+flat out float Glow;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// per frame, shared by all shaders (include/shader/frame.h)
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    // poles on the y axis, turning about them; a rotation is its own normal matrix
+    float s = sin(aSpinLayerGlow.x);
+    float c = cos(aSpinLayerGlow.x);
+    mat3 tilt = mat3(1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0, -1.0, 0.0);
+    mat3 spin = mat3(c, 0.0, -s, 0.0, 1.0, 0.0, s, 0.0, c);
+    mat3 rotation = tilt * spin;
+
+    FragPos = aCenterRadius.xyz + aCenterRadius.w * (rotation * aPos);
+    Normal = rotation * aNormal;
     TexCoords = aTexCoords;
+    Local = aPos;
+    Layer = aSpinLayerGlow.y;
+    CenterRadius = aCenterRadius;
+    Spin = aSpinLayerGlow.x;
+    Glow = aSpinLayerGlow.z;
 
-    gl_Position = projection * view * model * vec4(aPos, 1.0f);
-}
\ No newline at end of file
+    gl_Position = projection * view * vec4(FragPos, 1.0f);
+}
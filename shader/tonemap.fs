@@ -0,0 +1,13 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D hdr;
+
+void main()
+{
+    // any amount of light to [0, 1), dense cores saturate smoothly
+    vec3 light = texture(hdr, TexCoords).rgb;
+    FragColor = vec4(1.0 - exp(-light), 1.0);
+}
@@ -0,0 +1,9 @@
+#version 330 core
+out vec4 FragColor;
+
+in float Brightness;
+
+void main()
+{
+    FragColor = vec4(vec3(Brightness), 1.0);
+}
@@ -0,0 +1,31 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+out float Brightness;
+
+// per frame, shared by all shaders (include/shader/frame.h)
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
+
+// points drawn of the trail, the history first and then the ring
+uniform int total;
+// the ring: its first vertex, the slot after the newest point, its size
+uniform bool ring;
+uniform int base;
+uniform int head;
+uniform int capacity;
+
+void main()
+{
+    // older points fade out, whatever the trail length
+    int order = gl_VertexID;
+    if (ring)
+        order = total - 1 - (head - 1 - (gl_VertexID - base) + capacity) % capacity;
+    Brightness = 0.5 * float(order + 1) / float(total);
+
+    gl_Position = projection * view * vec4(aPos, 1.0);
+}
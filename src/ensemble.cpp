@@ -0,0 +1,46 @@
+#include <ensemble/ensemble.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+using namespace std;
+
+// usage: ensemble <runs> <seed> [maxTime] [threads] [output] [journal]
+// re-running with the same arguments resumes an interrupted ensemble
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        cout << "usage: " << argv[0] << " <runs> <seed> [maxTime] [threads] [output] [journal]" << endl;
+        return -1;
+    }
+
+    EnsembleConfig config;
+    config.runs = strtoull(argv[1], NULL, 10);
+    config.seed = strtoull(argv[2], NULL, 10);
+    if (argc > 3) config.maxTime = atof(argv[3]);
+    if (argc > 4) config.threads = atoi(argv[4]);
+    if (argc > 5) config.outputPath = argv[5];
+    if (argc > 6) config.journalPath = argv[6];
+
+    EnsembleRunner runner(config);
+    uint64_t simulated;
+    try
+    {
+        simulated = runner.run();
+    }
+    catch (const runtime_error &e)
+    {
+        cout << "Failed to run the ensemble: " << e.what() << endl;
+        return -1;
+    }
+    cout << "\nsimulated " << simulated << " runs" << endl;
+
+    vector<RunSummary> results = loadEnsembleResults(config.outputPath);
+    uint64_t counts[3] = {0, 0, 0};
+    for (auto &s : results) counts[s.outcome]++;
+    cout << "escape: " << counts[RUN_ESCAPE] << "\tcollision: " << counts[RUN_COLLISION]
+         << "\ttimeout: " << counts[RUN_TIMEOUT] << endl;
+
+    return 0;
+}
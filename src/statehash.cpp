@@ -0,0 +1,105 @@
+#include <body/body.h>
+#include <body/scenario.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+// integrated as by the viewer
+const double T_PER_FRAME = 0.01;
+const int STEPS = 100;
+
+bool writeHashes(const char *path, const vector<StateHash> &hashes)
+{
+    FILE *file = fopen(path, "w");
+    if (!file) return false;
+    for (auto &h : hashes)
+        fprintf(file, "%lld %016llx\n", h.step, (unsigned long long)h.hash);
+    return fclose(file) == 0;
+}
+
+bool readHashes(const char *path, vector<StateHash> &hashes)
+{
+    FILE *file = fopen(path, "r");
+    if (!file) return false;
+    long long step;
+    unsigned long long hash;
+    while (fscanf(file, "%lld %llx", &step, &hash) == 2)
+        hashes.push_back({step, hash});
+    fclose(file);
+    return true;
+}
+
+int run(int argc, char *argv[])
+{
+    unsigned int mode = atoi(argv[2]);
+    size_t n = strtoull(argv[3], NULL, 10);
+    uint64_t seed = strtoull(argv[4], NULL, 10);
+    long long frames = atoll(argv[5]);
+    int threads = atoi(argv[6]);
+    bool deterministic = atoi(argv[7]) != 0;
+    int every = argc > 8 ? atoi(argv[8]) : STEPS;
+    const char *output = argc > 9 ? argv[9] : "hashes.txt";
+
+    vector<Body> bodies;
+    if (mode == RANDOM) bodies = randomBodies(n, seed);
+    else if (mode <= DOUBLE_DOUBLE) bodies = createScenario(mode);
+    else bodies = createCluster(mode, n, seed);
+    if (bodies.empty())
+    {
+        cout << "No bodies for mode " << mode << endl;
+        return -1;
+    }
+
+    BodySystem system(bodies, false);
+    system.parallel(threads, deterministic);
+    system.hashEvery(max(every, 1));
+    system.config(T_PER_FRAME, STEPS);
+    for (long long f = 0; f < frames && !system.hasCollided(); f++)
+        system.update();
+
+    vector<StateHash> hashes = system.getHashes();
+    if (!writeHashes(output, hashes))
+    {
+        cout << "Failed to write " << output << endl;
+        return -1;
+    }
+    cout << hashes.size() << " hashes written to " << output;
+    if (system.hasCollided()) cout << ", stopped by a collision at t = " << system.getTime();
+    cout << endl;
+    return 0;
+}
+
+int compare(char *argv[])
+{
+    vector<StateHash> a, b;
+    if (!readHashes(argv[2], a) || !readHashes(argv[3], b))
+    {
+        cout << "Failed to read " << argv[2] << " or " << argv[3] << endl;
+        return -1;
+    }
+    long long step = findDivergence(a, b);
+    if (step >= 0)
+    {
+        cout << "runs diverge at step " << step << endl;
+        return 1;
+    }
+    cout << "runs agree on all common steps" << endl;
+    return 0;
+}
+
+// usage: statehash run <mode> <bodies> <seed> <frames> <threads> <deterministic> [every] [output]
+//        statehash compare <a> <b>
+// threads: 0 for the serial scheme, -1 for one per hardware thread; mode as in the viewer
+int main(int argc, char *argv[])
+{
+    if (argc >= 8 && !strcmp(argv[1], "run")) return run(argc, argv);
+    if (argc == 4 && !strcmp(argv[1], "compare")) return compare(argv);
+
+    cout << "usage: " << argv[0] << " run <mode> <bodies> <seed> <frames> <threads> <deterministic> [every] [output]" << endl;
+    cout << "       " << argv[0] << " compare <a> <b>" << endl;
+    return -1;
+}
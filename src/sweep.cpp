@@ -0,0 +1,137 @@
+#include <batch/batch.h>
+#include <body/scenario.h>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// systems integrated together, one per SIMD lane
+const int LANES = 8;
+
+// comet velocity window around the SUN_PLANET_COMET preset (-2.0, -5.5)
+const double VX_MIN = -8.0, VX_MAX = 4.0;
+const double VY_MIN = -11.5, VY_MAX = 0.5;
+
+struct Pixel
+{
+    int outcome;
+    int body;
+    double time;
+};
+
+vector<Body> cometAt(int width, int height, long long index)
+{
+    vector<Body> bodies = createScenario(SUN_PLANET_COMET);
+    double vx = VX_MIN + (VX_MAX - VX_MIN) * (index % width + 0.5) / width;
+    double vy = VY_MAX - (VY_MAX - VY_MIN) * (index / width + 0.5) / height;
+    Body comet = bodies[2];
+    bodies[2] = Body(comet.getMass(), comet.getRadius(), comet.getColor(), comet.getPosition(), glm::dvec3(vx, vy, 0.0));
+    return bodies;
+}
+
+void sweepWorker(int width, int height, double maxTime, atomic<long long> &next, vector<Pixel> &pixels)
+{
+    long long total = (long long)width * height;
+    BatchSystem<LANES> batch(3);
+    batch.config(0.01, 100);
+    batch.limits(maxTime, 100.0);
+
+    long long task[LANES];
+    for (int l = 0; l < LANES; l++)
+        task[l] = -1;
+
+    while (true)
+    {
+        // harvest retired lanes and refill them, so slow systems never hold the others back
+        for (int l = 0; l < LANES; l++)
+        {
+            if (batch.isActive(l)) continue;
+            if (task[l] >= 0)
+            {
+                Pixel &pixel = pixels[task[l]];
+                pixel.outcome = batch.getOutcome(l);
+                pixel.body = batch.getBody(l);
+                pixel.time = batch.getTime(l);
+                task[l] = -1;
+            }
+            long long t = next++;
+            if (t < total)
+            {
+                batch.setLane(l, cometAt(width, height, t));
+                task[l] = t;
+            }
+        }
+        if (batch.getActiveCount() == 0) break;
+        batch.update();
+    }
+}
+
+// bound: black, escape: blue fading with escape time, collision: orange with the sun, green with the planet
+void writeImage(const char *path, int width, int height, double maxTime, vector<Pixel> &pixels)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        cout << "Failed to open " << path << endl;
+        return;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    for (auto &pixel : pixels)
+    {
+        double c = 1.0 - 0.8 * log(1.0 + pixel.time) / log(1.0 + maxTime);
+        float rgb[3] = {0.0f, 0.0f, 0.0f};
+        if (pixel.outcome == RUN_ESCAPE)
+        {
+            rgb[0] = 0.2f * c;
+            rgb[1] = 0.5f * c;
+            rgb[2] = 1.0f * c;
+        }
+        else if (pixel.outcome == RUN_COLLISION)
+        {
+            rgb[0] = pixel.body == 0 ? 1.0f * c : 0.2f * c;
+            rgb[1] = pixel.body == 0 ? 0.6f * c : 1.0f * c;
+            rgb[2] = 0.1f * c;
+        }
+        for (int c = 0; c < 3; c++)
+            fputc((int)(rgb[c] * 255.0f + 0.5f), file);
+    }
+    fclose(file);
+}
+
+// usage: sweep <width> <height> [maxTime] [threads] [output.ppm]
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        cout << "usage: " << argv[0] << " <width> <height> [maxTime] [threads] [output.ppm]" << endl;
+        return -1;
+    }
+    int width = atoi(argv[1]);
+    int height = atoi(argv[2]);
+    double maxTime = argc > 3 ? atof(argv[3]) : 100.0;
+    int threads = argc > 4 ? atoi(argv[4]) : 0;
+    const char *output = argc > 5 ? argv[5] : "sweep.ppm";
+    if (threads < 1) threads = max(1u, thread::hardware_concurrency());
+
+    vector<Pixel> pixels((long long)width * height);
+    atomic<long long> next(0);
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (int i = 0; i < threads; i++)
+        workers.push_back(thread(sweepWorker, width, height, maxTime, ref(next), ref(pixels)));
+    for (auto &w : workers)
+        w.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    writeImage(output, width, height, maxTime, pixels);
+    cout << pixels.size() << " systems in " << seconds << " s (" << pixels.size() / seconds << " systems/s)" << endl;
+
+    return 0;
+}
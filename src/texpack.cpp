@@ -0,0 +1,51 @@
+#define STB_IMAGE_IMPLEMENTATION
+
+#include <texture/assets.h>
+#include <texture/container.h>
+#include <texture/image.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// the images of `files`, resampled to `width` x `height` unless that is 0
+bool pack(const vector<string> &files, int width, int height, const string &output)
+{
+    vector<Image> layers(files.size());
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        Image image;
+        if (!loadImage(files[i], image))
+        {
+            cout << "Failed to load " << files[i] << endl;
+            return false;
+        }
+        if (width && height)
+            resampleImage(image, width, height, layers[i]);
+        else
+            layers[i] = image;
+        if (layers[i].width != layers[0].width || layers[i].height != layers[0].height)
+        {
+            cout << files[i] << " is not the size of " << files[0] << endl;
+            return false;
+        }
+    }
+    if (!writeTextureFile(output, layers))
+    {
+        cout << "Failed to write " << output << endl;
+        return false;
+    }
+    cout << output << ": " << layers.size() << " x " << layers[0].width << " x " << layers[0].height << endl;
+    return true;
+}
+
+// usage: texpack, from the build directory
+// writes the planet and skybox textures as mipmapped BC1, for the simulator to map as they are
+int main()
+{
+    bool ok = pack(planetFiles("diffuse", PLANET_TEXTURES), PLANET_WIDTH, PLANET_HEIGHT, planetPacked("diffuse"));
+    ok = pack(planetFiles("specular", PLANET_TEXTURES), PLANET_WIDTH, PLANET_HEIGHT, planetPacked("specular")) && ok;
+    ok = pack(skyboxFaces(), 0, 0, SKYBOX_PACKED) && ok;
+    return ok ? 0 : -1;
+}
@@ -8,12 +8,27 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <shader/shader.h>
+#include <shader/frame.h>
 #include <camera/camera.h>
 #include <body/body.h>
-#include <stb_image/stb_image.h>
-
+#include <body/scenario.h>
+#include <body/generator.h>
+#include <body/simulation.h>
+#include <checkpoint/checkpoint.h>
+#include <galaxy/galaxy.h>
+#include <light/cluster.h>
+#include <trajectory/trajectory.h>
+#include <trajectory/replay.h>
+#include <trail/rebuild.h>
+#include <trail/renderer.h>
+#include <texture/assets.h>
+#include <texture/loader.h>
+#include <texture/procedural.h>
+
+#include <algorithm>
 #include <iostream>
 #include <cmath>
+#include <memory>
 #include <vector>
 using namespace std;
 
@@ -21,16 +36,10 @@ void processInput(GLFWwindow* window);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-unsigned int loadTexture(const char *path);
-unsigned int loadCubemap(vector<std::string> faces);
 
 vector<float> createSphereVertices();
 vector<int> createSphereIndices();
-vector<Body> creatBodies(int n);
-glm::mat4 drawSphere(glm::dvec3 center_hp, double radius_hp);
-glm::mat4 cvtMat4Lp(glm::dmat4 mat4Hp);
 glm::vec3 cvtVec3Lp(glm::dvec3 vec3Hp);
-vector<unsigned int> loadTextures(const int n, const char* rootPath, const char* textureType);
 
 // PI
 const double PI = 3.141592653589793238462643383279502884;
@@ -43,6 +52,25 @@ const int SCR_HEIGHT = 1080;
 const unsigned int Y_SEGMENTS = 50;
 const unsigned int X_SEGMENTS = 50;
 
+// depth range of the view
+const float Z_NEAR = 0.1f;
+const float Z_FAR = 100.0f;
+// the star lights take texture units LIGHT_UNIT to LIGHT_UNIT + 2
+const int LIGHT_UNIT = 2;
+
+// spheres smaller than IMPOSTOR_PIXELS in radius on screen are drawn as ray-cast quads
+const float IMPOSTOR_PIXELS = 48.0f;
+
+// per body data of the instanced sphere passes
+struct SphereInstance
+{
+    glm::vec3 center;
+    float radius;
+    float spin;
+    float layer;
+    float glow;
+};
+
 // camera setting
 Camera camera(glm::vec3(0.0f, 0.0f, 50.0f));
 
@@ -59,29 +87,57 @@ double tPerFrame = 0.01;
 // steps of calculation each frame
 const int steps = 100;
 
-enum DisplayMode
-{
-    RANDOM,
-    SUN_PLANET,
-    SUN_PLANET_MOON,
-    SUN_PLANET_COMET,
-    BINARY_STAR_PLANET,
-    TROJAN_ASTERIODS,
-    FOUR_STAR_BALLET,
-    SLINGSHOT,
-    DOUBLE_SLINGSHOT,
-    HYPERBOLICS,
-    ELLIPSES,
-    DOUBLE_DOUBLE
-};
-
+// frames integrated per second by the simulation thread, whatever the display rate
+const double SIM_RATE = 60.0;
+
+// checkpoint written every CHECKPOINT_INTERVAL seconds, resumed by mode 12
+const char *CHECKPOINT_PATH = "three_body.ckpt";
+const double CHECKPOINT_INTERVAL = 60.0;
+
+// one sample per frame, if recording is enabled; played back by mode 13
+const char *TRAJECTORY_PATH = "three_body.traj";
+
+// rewind history: a snapshot every KEYFRAME_EVERY frames within KEYFRAME_BUDGET bytes,
+// holding B or F scrubs through it at SCRUB_RATE frames per second
+const int KEYFRAME_EVERY = 60;
+const size_t KEYFRAME_BUDGET = 64 << 20;
+// a snapshot holds three vectors per body; systems too large for this many of them
+// within the budget run without rewind
+const size_t KEYFRAME_MIN = 8;
+const double SCRUB_RATE = 180.0;
+int scrubDirection = 0;
+
+// replay controls
+int replayDirection = 1;
+bool replayPaused = false;
+double replaySeek = 0.0;   // fraction of the recording to skip, consumed every frame
+
+// trail points kept per body, halved and doubled by COMMA and PERIOD
+size_t trailLength = PATH_LENGTH;
+const size_t TRAIL_MIN = 16;
+const size_t TRAIL_MAX = 16384;
+// systems of LAZY_TRAILS_MIN bodies or more keep no trails: those of the nearest
+// LAZY_TRAIL_BODIES bodies in view over the last LAZY_TRAIL_FRAMES frames are integrated
+// again from the keyframes on LAZY_TRAIL_THREADS threads
+const size_t LAZY_TRAILS_MIN = 64;
+const size_t LAZY_TRAIL_BODIES = 16;
+const long long LAZY_TRAIL_FRAMES = 600;
+const int LAZY_TRAIL_THREADS = 2;
+// systems of PARALLEL_MIN bodies or more are integrated on all cores, bit for bit alike
+// for any number of them unless PARALLEL_DETERMINISTIC is false (see BodySystem)
+const size_t PARALLEL_MIN = 64;
+const bool PARALLEL_DETERMINISTIC = true;
+// galaxies take the fast parallel scheme and as many steps per frame, up to `steps`, as
+// keep them within GALAXY_PAIRS force evaluations, at least one: every frame moves, by
+// less time, so the step stays that of tPerFrame / steps
+const double GALAXY_PAIRS = 1e8;
 
 int main()
 {
     int numberOfBodies;
     unsigned int seed, mode;
     cout << "\nWelcome to the Three-Body Simulator...\n";
-    cout << "\nSelect the display mode (0 ~ 10)\n";
+    cout << "\nSelect the display mode (0 ~ 17)\n";
     cout << "0: generate randomly\t";
     cout << "1: Sun and planet\n";
     cout << "2: Sun, planet, moon\t";
@@ -93,15 +149,27 @@ int main()
     cout << "8: Double slingshot\t";
     cout << "9: Hyperbolics\n";
     cout << "10: Ellipses\t\t";
-    cout << "11: Double double\n\n";
+    cout << "11: Double double\t";
+    cout << "12: Resume from checkpoint\t";
+    cout << "13: Replay trajectory\n";
+    cout << "14: Uniform cube\t\t";
+    cout << "15: Plummer cluster\t";
+    cout << "16: Disk galaxy\t\t";
+    cout << "17: Cold collapse\n\n";
     cin >> mode;
-    if (mode == 0)
+    bool cluster = mode >= UNIFORM_CUBE && mode <= COLD_COLLAPSE;
+    if (mode == 0 || cluster)
     {
         cout << "Input the number of body: ";
         cin >> numberOfBodies;
         cout << "Input the random seed [uint]: ";
         cin >> seed;
-        srand(seed);
+    }
+    int record = 0;
+    if (mode != REPLAY)
+    {
+        cout << "Record the trajectory to " << TRAJECTORY_PATH << "? [0: no, 1: raw, 2: compressed]: ";
+        cin >> record;
     }
 
     // glfw: initialize and configure
@@ -170,9 +238,18 @@ int main()
     // load shaders
     // ------------
     Shader sphereShader("../shader/sphere_lt.vs", "../shader/sphere_lt.fs");
-    Shader pathShader("../shader/path.vs", "../shader/path.fs");
+    Shader impostorShader("../shader/sphere_impostor.vs", "../shader/sphere_lt.fs");
+    Shader trailShader("../shader/trail.vs", "../shader/trail.fs");
     Shader skyboxShader("../shader/skybox.vs", "../shader/skybox.fs");
     Shader lightcubeShader("../shader/lightcube.vs", "../shader/lightcube.fs");
+    Shader galaxyShader("../shader/galaxy.vs", "../shader/galaxy.fs");
+    Shader tonemapShader("../shader/tonemap.vs", "../shader/tonemap.fs");
+    Shader planetBakeShader("../shader/tonemap.vs", "../shader/planet_bake.fs");
+
+    // camera and lights, written once per frame for all shaders
+    unique_ptr<FrameUniforms> frameUniforms(new FrameUniforms());
+    for (Shader *shader : {&sphereShader, &impostorShader, &trailShader, &skyboxShader, &lightcubeShader, &galaxyShader})
+        frameUniforms->attach(*shader);
 
     // calculate sphere vertices and indices
     // -------------------------------------
@@ -200,9 +277,52 @@ int main()
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));  // texture
     glEnableVertexAttribArray(2);
 
-    sphereShader.use();
-    sphereShader.setInt("material.diffuse", 0);
-    sphereShader.setInt("material.specular", 1);
+    // one instance per body, refilled every frame
+    unsigned int instanceVBO;
+    vector<SphereInstance> sphereInstances, impostorInstances;
+
+    glGenBuffers(1, &instanceVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(SphereInstance), (void*)0);  // center, radius
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(SphereInstance), (void*)offsetof(SphereInstance, spin));  // spin, layer, glow
+    glEnableVertexAttribArray(4);
+    glVertexAttribDivisor(4, 1);
+
+    // impostor quad, the instances follow the meshes' in the same buffer
+    float quadVertices[] = {
+        -1.0f, -1.0f,
+         1.0f, -1.0f,
+        -1.0f,  1.0f,
+         1.0f,  1.0f
+    };
+    unsigned int impostorVAO, impostorVBO;
+
+    glGenVertexArrays(1, &impostorVAO);
+    glGenBuffers(1, &impostorVBO);
+
+    glBindVertexArray(impostorVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, impostorVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
+    glEnableVertexAttribArray(4);
+    glVertexAttribDivisor(4, 1);
+
+    for (Shader *shader : {&sphereShader, &impostorShader})
+    {
+        shader->use();
+        shader->setInt("material.diffuse", 0);
+        shader->setInt("material.specular", 1);
+        // shader->setVec3("material.diffuse", glm::vec3(1.0f));
+        // shader->setVec3("material.specular", glm::vec3(0.2f));
+        shader->setVec3("material.emission", glm::vec3(0.0f));
+        shader->setFloat("material.shininess", 64.0f);
+        shader->setBool("impostor", shader == &impostorShader);
+    }
 
     // path
     // TODO: maybe use loop to generate.
@@ -250,23 +370,18 @@ int main()
          1.0f, -1.0f,  1.0f
     };
 
-    // path VAO, VBO
-    // -------------
-    unsigned int pathVAO, pathVBO;
-
-    glGenVertexArrays(1, &pathVAO);
-    glGenBuffers(1, &pathVBO);
-
-    glBindVertexArray(pathVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, pathVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), cubeVertices, GL_STATIC_DRAW);
-    
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    vector<glm::vec3> pointLightPositions;
-    pointLightPositions.push_back(glm::vec3(20.0f, 0.0f, 0.0f));
-    pointLightPositions.push_back(glm::vec3(-12.0f, 12.0f, 0.0f));
+    // light
+    // -----
+    // direct light
+    DirLightBlock &dirLight = frameUniforms->lights.dirLights[0];
+    dirLight.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    dirLight.ambient = glm::vec3(0.2f, 0.2f, 0.2f);
+    dirLight.diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
+    dirLight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+    // point light: the stars themselves, binned every frame
+    unique_ptr<LightClusters> lightClusters(new LightClusters());
+    lightClusters->attach(sphereShader, LIGHT_UNIT);
+    lightClusters->attach(impostorShader, LIGHT_UNIT);
 
     // skybox VAO
     unsigned int skyboxVAO, skyboxVBO;
@@ -281,17 +396,9 @@ int main()
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
-    vector<std::string> faces
-    {
-        "../asset/texture/skybox/StarSkybox043.png",
-        "../asset/texture/skybox/StarSkybox044.png",
-        "../asset/texture/skybox/StarSkybox045.png",
-        "../asset/texture/skybox/StarSkybox046.png",
-        "../asset/texture/skybox/StarSkybox041.png",
-        "../asset/texture/skybox/StarSkybox042.png"
-    };
-
-    unsigned int cubemapTexture = loadCubemap(faces);
+    // textures arrive over the first frames, decoded in the background
+    unique_ptr<TextureLoader> textureLoader(new TextureLoader());
+    int cubemapTexture = textureLoader->loadCubemap(skyboxFaces(), SKYBOX_PACKED, glm::vec3(0.0f));
 
     // shader configuration
     // --------------------
@@ -308,148 +415,151 @@ int main()
     // ------
     // vector<Body> bodies = creatBodies(numberOfBodies);
     vector<Body> bodies;
+    TrajectoryPlayer player;
 
     if (mode == RANDOM)
     {
-        if (numberOfBodies > 6) numberOfBodies = 6;
-        bodies = creatBodies(numberOfBodies);
-    }
-    else if (mode == SUN_PLANET)
-    {
-        // sun and planet
-        Body sun(20.0, 3.0, glm::vec3(1.0f, 0.7f, 0.0f), glm::dvec3(0.0, 0.0, 0.0), glm::dvec3(0.0, -0.6, 0.0));
-        bodies.push_back(sun);
-        Body planet(1.0, 1.0, glm::vec3(0.0f, 0.4f, 1.0f), glm::dvec3(15.0, 0.0, 0.0), glm::dvec3(0.0, 12.0, 0.0));
-        bodies.push_back(planet);
-    }
-    else if (mode == SUN_PLANET_MOON)
-    {
-        // sun, planet and moon
-        Body sun(20.0, 3.0, glm::vec3(1.0f, 0.7f, 0.0f), glm::dvec3(0.0, 0.0, 0.0), glm::dvec3(0.0, -0.6, 0.0));
-        bodies.push_back(sun);
-        Body planet(1.0, 1.0, glm::vec3(0.0f, 0.4f, 1.0f), glm::dvec3(16.0, 0.0, 0.0), glm::dvec3(0.0, 12.0, 0.0));
-        bodies.push_back(planet);
-        Body moon(0.0001, 0.2, glm::vec3(1.0f, 1.0f, 1.0f), glm::dvec3(14.0, 0.0, 0.0), glm::dvec3(0.0, 5.3, 0.0));
-        bodies.push_back(moon);
-    }
-    else if (mode == SUN_PLANET_COMET)
-    {
-        // sun, planet and comet
-        Body sun(20.0, 3.0, glm::vec3(1.0f, 0.7f, 0.0f), glm::dvec3(0.0, 0.0, 0.0), glm::dvec3(0.0, -0.6, 0.0));
-        bodies.push_back(sun);
-        Body planet(1.0, 1.0, glm::vec3(0.0f, 0.4f, 1.0f), glm::dvec3(15.0, 0.0, 0.0), glm::dvec3(0.0, 12.0, 0.0));
-        bodies.push_back(planet);
-        Body comet(0.0001, 0.2, glm::vec3(0.0f, 1.0f, 1.0f), glm::dvec3(-20.0, 10.0, 0.0), glm::dvec3(-2.0, -5.5, 0.0));
-        bodies.push_back(comet);
-    }
-    else if (mode == BINARY_STAR_PLANET)
-    {
-        // binary star and planet
-        Body star1(15.0, 1.0, glm::vec3(1.0f, 1.0f, 0.0f), glm::dvec3(-10.0, 0.0, 0.0), glm::dvec3(0.0, -6.0, 0.0));
-        bodies.push_back(star1);
-        Body star2(15.0, 1.0, glm::vec3(1.0f, 0.0f, 1.0f), glm::dvec3(10.0, 0.0, 0.0), glm::dvec3(0.0, 6.0, 0.0));
-        bodies.push_back(star2);
-        Body star3(0.001, 0.2, glm::vec3(0.0f, 1.0f, 1.0f), glm::dvec3(-5.0, 0.0, 0.0), glm::dvec3(0.0, 12.0, 0.0));
-        bodies.push_back(star3);
+        bodies = randomBodies(numberOfBodies, seed);
     }
-    else if (mode == TROJAN_ASTERIODS)
+    else if (mode <= DOUBLE_DOUBLE)
     {
-        // trojan asteriods
-        Body star1(20.0, 3.0, glm::vec3(1.0f, 1.0f, 0.0f), glm::dvec3(0.0, 0.0, 0.0), glm::dvec3(0.0, 0.0, 0.0));
-        bodies.push_back(star1);
-        Body star2(0.5, 1.0, glm::vec3(1.0f, 0.0f, 1.0f), glm::dvec3(15.0, 0.0, 0.0), glm::dvec3(0.0, 11.9, 0.0));
-        bodies.push_back(star2);
-        Body star3(0.001, 0.5, glm::vec3(0.0f, 1.0f, 1.0f), glm::dvec3(7.5, -13.0, 0.0), glm::dvec3(10.3, 6.0, 0.0));
-        bodies.push_back(star3);
-        Body star4(0.001, 0.5, glm::vec3(1.0f, 1.0f, 1.0f), glm::dvec3(7.5, 13.0, 0.0), glm::dvec3(-10.3, 6.0, 0.0));
-        bodies.push_back(star4);
+        bodies = createScenario(mode);
     }
-    else if (mode == FOUR_STAR_BALLET)
+    else if (cluster)
     {
-        // four star ballet
-        Body star1(12.0, 1.0, glm::vec3(1.0f, 1.0f, 0.0f), glm::dvec3(-10.0, 10.0, 0.0), glm::dvec3(-5.0, -5.0, 0.0));
-        bodies.push_back(star1);
-        Body star2(12.0, 1.0, glm::vec3(1.0f, 0.0f, 1.0f), glm::dvec3(10.0, 10.0, 0.0), glm::dvec3(-5.0, 5.0, 0.0));
-        bodies.push_back(star2);
-        Body star3(12.0, 1.0, glm::vec3(0.0f, 1.0f, 1.0f), glm::dvec3(10.0, -10.0, 0.0), glm::dvec3(5.0, 5.0, 0.0));
-        bodies.push_back(star3);
-        Body star4(12.0, 1.0, glm::vec3(1.0f, 1.0f, 1.0f), glm::dvec3(-10.0, -10.0, 0.0), glm::dvec3(5.0, -5.0, 0.0));
-        bodies.push_back(star4);
+        bodies = createCluster(mode, numberOfBodies, seed);
     }
-    else if (mode == SLINGSHOT)
+    else if (mode == RESUME)
     {
-        // slingshot
-        Body star1(20.0, 3.0, glm::vec3(1.0f, 1.0f, 0.0f), glm::dvec3(0.0, 0.0, 0.0), glm::dvec3(0.0, -0.6, 0.0));
-        bodies.push_back(star1);
-        Body star2(1.0, 1.0, glm::vec3(1.0f, 0.0f, 1.0f), glm::dvec3(15.0, 0.0, 0.0), glm::dvec3(0.0, 12.0, 0.0));
-        bodies.push_back(star2);
-        Body star3(0.001, 0.5, glm::vec3(0.0f, 1.0f, 1.0f), glm::dvec3(-0.6, -12.8, 0.0), glm::dvec3(10.0, 0.0, 0.0));
-        bodies.push_back(star3);
+        // restored from the checkpoint below
     }
-    else if (mode == DOUBLE_SLINGSHOT)
+    else if (mode == REPLAY)
     {
-        // double slingshot
-        Body star1(20.0, 1.0, glm::vec3(1.0f, 1.0f, 0.0f), glm::dvec3(0.0, 0.0, 0.0), glm::dvec3(0.0, -0.1, 0.0));
-        bodies.push_back(star1);
-        Body star2(0.5, 0.5, glm::vec3(1.0f, 0.0f, 1.0f), glm::dvec3(0.0, -11.2, 0.0), glm::dvec3(13.4, 0.0, 0.0));
-        bodies.push_back(star2);
-        Body star3(0.4, 0.5, glm::vec3(0.0f, 1.0f, 1.0f), glm::dvec3(18.6, -0.5, 0.0), glm::dvec3(0.1, 11.1, 0.0));
-        bodies.push_back(star3);
-        Body star4(0.001, 0.2, glm::vec3(1.0f, 1.0f, 1.0f), glm::dvec3(7.0, 7.2, 0.0), glm::dvec3(-4.7, 6.3, 0.0));
-        bodies.push_back(star4);
-    }
-    else if (mode == HYPERBOLICS)
-    {
-        // hyperbolics
-        double x = 20.0;
-        double vx = -15.0;
-        Body star1(25.0, 3.0, glm::vec3(1.0f, 1.0f, 0.0f), glm::dvec3(-5.0, -4.5, 0.0), glm::dvec3(0.0, 0.0, 0.0));
-        bodies.push_back(star1);
-        Body star2(0.001, 0.5, glm::vec3(1.0f, 0.0f, 1.0f), glm::dvec3(x, 5.0, 0.0), glm::dvec3(vx, 0.0, 0.0));
-        bodies.push_back(star2);
-        Body star3(0.001, 0.5, glm::vec3(0.0f, 1.0f, 1.0f), glm::dvec3(x, 12.0, 0.0), glm::dvec3(vx, 0.0, 0.0));
-        bodies.push_back(star3);
-        Body star4(0.001, 0.5, glm::vec3(1.0f, 1.0f, 1.0f), glm::dvec3(x, 19.0, 0.0), glm::dvec3(vx, 0.0, 0.0));
-        bodies.push_back(star4);
-    }
-    else if (mode == ELLIPSES)
-    {
-        // ellipses
-        Body star1(25.0, 3.0, glm::vec3(1.0f, 1.0f, 0.0f), glm::dvec3(-20.0, 0.0, 0.0), glm::dvec3(0.0, 0.0, 0.0));
-        bodies.push_back(star1);
-        Body star2(0.001, 0.5, glm::vec3(1.0f, 0.0f, 1.0f), glm::dvec3(-11.5, 0.0, 0.0), glm::dvec3(0.0, 15.1, 0.0));
-        bodies.push_back(star2);
-        Body star3(0.001, 0.5, glm::vec3(0.0f, 1.0f, 1.0f), glm::dvec3(5.0, 0.0, 0.0), glm::dvec3(0.0, 6.0, 0.0));
-        bodies.push_back(star3);
-        Body star4(0.001, 0.5, glm::vec3(1.0f, 1.0f, 1.0f), glm::dvec3(22.0, 0.0, 0.0), glm::dvec3(0.0, 3.7, 0.0));
-        bodies.push_back(star4);
-    }
-    else if (mode == DOUBLE_DOUBLE)
-    {
-        // double double
-        Body star1(6.0, 1.0, glm::vec3(1.0f, 1.0f, 0.0f), glm::dvec3(-11.5, -0.3, 0.0), glm::dvec3(0.0, -15.4, 0.0));
-        bodies.push_back(star1);
-        Body star2(7.0, 1.0, glm::vec3(1.0f, 0.0f, 1.0f), glm::dvec3(10.2, 0.0, 0.0), glm::dvec3(0.1, 15.0, 0.0));
-        bodies.push_back(star2);
-        Body star3(5.5, 1.0, glm::vec3(0.0f, 1.0f, 1.0f), glm::dvec3(-7.7, 0.2, 0.0), glm::dvec3(-0.1, 4.2, 0.0));
-        bodies.push_back(star3);
-        Body star4(6.2, 1.0, glm::vec3(1.0f, 1.0f, 1.0f), glm::dvec3(13.5, 0.0, 0.0), glm::dvec3(-0.1, -5.2, 0.0));
-        bodies.push_back(star4);
+        // positions come from the recording, the system is never integrated
+        if (!player.open(TRAJECTORY_PATH))
+        {
+            cout << "Failed to open trajectory " << TRAJECTORY_PATH << endl;
+            glfwTerminate();
+            return -1;
+        }
+        // one sample per frame, as it was recorded
+        tPerFrame = player.getSampleSpacing();
+        player.getBodies(bodies);
+        cout << "Replay: SPACE pause, R reverse, LEFT/RIGHT seek, HOME/END jump, UP/DOWN speed" << endl;
     }
     else
     {
         numberOfBodies = 3;
-        bodies = creatBodies(numberOfBodies);
+        bodies = randomBodies(numberOfBodies, 0);
     }
     
-    BodySystem bodySystem(bodies);
+    // large systems and replays keep no trails in the system, so never allocate them
+    BodySystem bodySystem(bodies, mode != REPLAY && bodies.size() < LAZY_TRAILS_MIN);
     // bodySystem.info();
+    if (mode == RESUME && !loadCheckpoint(CHECKPOINT_PATH, bodySystem))
+    {
+        // only the fast parallel scheme fails to resume bit-exactly
+        if (!loadCheckpoint(CHECKPOINT_PATH, bodySystem, NULL, false))
+        {
+            cout << "Failed to load checkpoint " << CHECKPOINT_PATH << endl;
+            glfwTerminate();
+            return -1;
+        }
+        cout << "The checkpoint is of the fast parallel scheme, it does not continue bit-exactly" << endl;
+    }
+
+    // clusters and galaxies as points of light, point masses too, whose spheres would
+    // have no size
+    size_t size = bodySystem.getBodies().size();
+    bool pointMasses = size > 0;
+    for (auto &body : bodySystem.getBodies())
+        if (body.getRadius() > 0.0) pointMasses = false;
+    bool galaxy = size >= GALAXY_MIN || pointMasses;
+    int frameSteps = galaxy ? (int)max(1.0, min((double)steps, GALAXY_PAIRS / ((double)size * size))) : steps;
+    if (mode != REPLAY && frameSteps < steps)
+    {
+        tPerFrame *= (double)frameSteps / steps;
+        cout << frameSteps << " steps per frame of " << tPerFrame << " for " << size << " bodies" << endl;
+    }
+
+    // a checkpoint brings its own scheme
+    if (mode != RESUME && mode != REPLAY && size >= PARALLEL_MIN)
+        bodySystem.parallel(-1, PARALLEL_DETERMINISTIC && !galaxy);
+    bool rewind = mode != REPLAY && size * 3 * sizeof(glm::dvec3) * KEYFRAME_MIN <= KEYFRAME_BUDGET;
+    if (mode != REPLAY && !rewind)
+        cout << "No rewind and no trails for " << size << " bodies, over " << KEYFRAME_BUDGET / (3 * sizeof(glm::dvec3) * KEYFRAME_MIN) << endl;
+    // trails of large systems are integrated again from the snapshots
+    bool lazyTrails = rewind && size >= LAZY_TRAILS_MIN;
+    if (mode != REPLAY && size >= LAZY_TRAILS_MIN) bodySystem.recordPaths(false);
+    if (rewind) bodySystem.keyframes(KEYFRAME_EVERY, KEYFRAME_BUDGET, !lazyTrails);
+    TrailRebuilder rebuilder(LAZY_TRAIL_THREADS);
+    vector<size_t> trailBodies;
+    long long scrubFrame = -1;
+    double scrubPosition = 0.0;
+    AutoCheckpointer checkpointer(CHECKPOINT_PATH, CHECKPOINT_INTERVAL);
+    unique_ptr<TrajectoryWriter> recorder;
+    if (record) recorder.reset(new TrajectoryWriter(TRAJECTORY_PATH, bodySystem.getBodies(), true, record == 2 ? CODEC_PREDICTIVE : CODEC_RAW));
 
     // load texture
     // ------------
     int bodyCount = bodySystem.getBodies().size();
-    vector<unsigned int> diffuseTextureIds = loadTextures(bodyCount, "../asset/texture/planet/", "diffuse");
-    vector<unsigned int> specularTextureIds = loadTextures(bodyCount, "../asset/texture/planet/", "specular");
+
+    // replayed trails follow playback: those of every body of a small system, else of
+    // the nearest LAZY_TRAIL_BODIES in view, as live
+    bool replayAll = bodyCount < (int)LAZY_TRAILS_MIN;
+    vector<TrailPyramid> replayTrails;
+    vector<TrailUpdate> replayUpdates;
+    if (mode == REPLAY)
+    {
+        for (size_t k = 0; k < (replayAll ? bodyCount : LAZY_TRAIL_BODIES); k++)
+            replayTrails.push_back(TrailPyramid(1, trailLength));
+        replayUpdates.resize(replayTrails.size());
+        for (int b = 0; replayAll && b < bodyCount; b++)
+            trailBodies.push_back(b);
+    }
+
+    // trails on the GPU, one per body, per rebuilt trail or per replayed trail
+    // ------------------------------------------------------------------------
+    size_t trailRings = mode == REPLAY ? replayTrails.size() : bodyCount >= (int)LAZY_TRAILS_MIN ? LAZY_TRAIL_BODIES : bodyCount;
+    unique_ptr<TrailRenderer> trailRenderer(new TrailRenderer(trailRings));
+
+    // clusters and galaxies as points of light
+    // ----------------------------------------
+    unique_ptr<GalaxyRenderer> galaxyRenderer;
+    if (galaxy) galaxyRenderer.reset(new GalaxyRenderer());
+
+    // from here on the system belongs to the simulation thread
+    // --------------------------------------------------------
+    Simulation simulation(bodySystem, SIM_RATE);
+    simulation.onFrame([&](BodySystem &system) {
+        checkpointer.offer(system);
+        if (!recorder) return;
+        vector<Body> bodies = system.getBodies();
+        recorder->append(system.getTime(), bodies);
+    });
+    simulation.onSeek([&](BodySystem &) {
+        rebuilder.clear();
+        if (recorder)
+        {
+            recorder.reset();
+            cout << "Trajectory recording stopped at the rewind" << endl;
+        }
+    });
+    if (lazyTrails) simulation.lazyTrails(&rebuilder);
+    simulation.config(tPerFrame, frameSteps);
+    if (mode != REPLAY) simulation.start();
+    // the planet textures while there are enough of them, surfaces made up per body after
+    int surfaces = bodyCount > PLANET_TEXTURES ? SURFACE_PROCEDURAL : SURFACE_TEXTURES;
+    int diffuseTextures = -1, specularTextures = -1;
+    if (surfaces == SURFACE_TEXTURES)
+    {
+        diffuseTextures = textureLoader->loadArray(planetFiles("diffuse", bodyCount), PLANET_WIDTH, PLANET_HEIGHT, planetPacked("diffuse"), glm::vec3(0.5f));
+        specularTextures = textureLoader->loadArray(planetFiles("specular", bodyCount), PLANET_WIDTH, PLANET_HEIGHT, planetPacked("specular"), glm::vec3(0.5f));
+    }
+    textureLoader->start();
+    unique_ptr<SurfaceCache> surfaceCache;
+    if (surfaces == SURFACE_PROCEDURAL && !galaxy && PROCEDURAL_CACHE_WIDTH > 0 && bodyCount <= PROCEDURAL_CACHE_LAYERS)
+        surfaceCache.reset(new SurfaceCache(PROCEDURAL_CACHE_WIDTH, bodyCount));
 
     // render loop
     // -----------
@@ -462,6 +572,9 @@ int main()
         // input
         // -----
         processInput(window);
+        textureLoader->update();
+        if (surfaceCache) surfaceCache->update(planetBakeShader);
+        int surface = surfaceCache && surfaceCache->isDone() ? SURFACE_BAKED : surfaces;
 
         // background color update
         // -----------------------
@@ -469,142 +582,211 @@ int main()
 
         // set and update
         // --------------
-        bodySystem.config(tPerFrame, steps);
-        bodySystem.update();
-        vector<Body> bdies = bodySystem.getBodies();
+        vector<Body> bdies;
+        size_t trailCount = 0;
+        if (mode == REPLAY)
+        {
+            double length = player.getEndTime() - player.getStartTime();
+            player.advance(replaySeek * length + (replayPaused ? 0.0 : replayDirection * tPerFrame));
+            replaySeek = 0.0;
+            player.getBodies(bdies);
+            if (galaxy) galaxyRenderer->update(bdies, bdies, 1.0);
+            // only the samples passed since the last frame are pushed and sent
+            for (auto &trails : replayTrails)
+                trails.setCapacity(trailLength);
+            player.updateTrails(replayTrails, trailBodies, replayDirection);
+            trailCount = replayTrails.size();
+            for (size_t k = 0; k < trailCount; k++)
+            {
+                TrailUpdate &update = replayUpdates[k];
+                replayTrails[k].getUpdate(0, update.generation, update.total, update.version, update);
+                trailRenderer->update(k, update);
+            }
+        }
+        else
+        {
+            simulation.acquire();
+            const SimSnapshot &snapshot = simulation.current();
+            if (scrubDirection != 0 && rewind)
+            {
+                // scrubbing only shows the history, the system stays where it is
+                if (scrubFrame < 0) scrubPosition = snapshot.lastFrame;
+                scrubPosition += scrubDirection * SCRUB_RATE * deltaTime;
+                scrubPosition = min(max(scrubPosition, (double)snapshot.firstFrame), (double)snapshot.lastFrame);
+                scrubFrame = llround(scrubPosition);
+                simulation.preview(scrubFrame);
+            }
+            else if (scrubFrame >= 0)
+            {
+                // continues exactly from the frame the scrub stopped at
+                simulation.preview(-1);
+                scrubFrame = -1;
+            }
+            simulation.config(tPerFrame, frameSteps);
+            simulation.trailLength(trailLength);
+            // a galaxy is mixed straight into its vertex buffer, not copied first
+            if (galaxy)
+                galaxyRenderer->update(simulation.previous().bodies, snapshot.bodies, simulation.blend());
+            else
+                simulation.interpolate(bdies);
+            trailCount = snapshot.trails.size();
+            for (size_t k = 0; k < trailCount; k++)
+                trailRenderer->update(k, snapshot.trails[k]);
+        }
 
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, Z_NEAR, Z_FAR);
         glm::mat4 view = camera.GetViewMatrix();
-        glm::mat4 model;
-
-        // light
-        // -----
-        sphereShader.use();
-        sphereShader.setVec3("viewPos", camera.Position);
-        // direct light
-        sphereShader.setVec3("dirLights[0].direction", 0.0f, -1.0f, 0.0f);
-        sphereShader.setVec3("dirLights[0].ambient", 0.2f, 0.2f, 0.2f);
-        sphereShader.setVec3("dirLights[0].diffuse", 0.8f, 0.8f, 0.8f);
-        sphereShader.setVec3("dirLights[0].specular", 1.0f, 1.0f, 1.0f);
-        // point light
-        sphereShader.setVec3("pointLights[0].position", pointLightPositions[0]);
-        sphereShader.setVec3("pointLights[0].ambient", 0.2f, 0.2f, 0.2f);
-        sphereShader.setVec3("pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
-        sphereShader.setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
-        sphereShader.setFloat("pointLights[0].constant", 1.0f);
-        sphereShader.setFloat("pointLights[0].linear", 0.022f);
-        sphereShader.setFloat("pointLights[0].quadratic", 0.0019f);
-
-        sphereShader.setVec3("pointLights[1].position", pointLightPositions[1]);
-        sphereShader.setVec3("pointLights[1].ambient", 0.2f, 0.2f, 0.2f);
-        sphereShader.setVec3("pointLights[1].diffuse", 0.8f, 0.8f, 0.8f);
-        sphereShader.setVec3("pointLights[1].specular", 1.0f, 1.0f, 1.0f);
-        sphereShader.setFloat("pointLights[1].constant", 1.0f);
-        sphereShader.setFloat("pointLights[1].linear", 0.022f);
-        sphereShader.setFloat("pointLights[1].quadratic", 0.0019f);
-        // material
-        // sphereShader.setVec3("material.diffuse", glm::vec3(1.0f));
-        // sphereShader.setVec3("material.specular", glm::vec3(0.2f));
-        sphereShader.setVec3("material.emission", glm::vec3(0.0f));
-        sphereShader.setFloat("material.shininess", 64.0f);
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        // pixels per unit at unit distance
+        float pixels = 0.5f * height / tan(glm::radians(camera.Zoom) / 2.0f);
+        const vector<Body> &shown = galaxy && mode != REPLAY ? simulation.current().bodies : bdies;
+
+        // camera and lights
+        // -----------------
+        frameUniforms->camera.projection = projection;
+        frameUniforms->camera.view = view;
+        frameUniforms->camera.viewPos = camera.Position;
+        if (!galaxy)
+        {
+            // every star lights the clusters it reaches
+            lightClusters->update(bdies, view, glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, Z_NEAR, Z_FAR);
+            lightClusters->fill(frameUniforms->lights, width, height);
+        }
+        frameUniforms->upload();
 
         // draw sphere
         // -----------
-        sphereShader.setMat4("projection", projection);
-        sphereShader.setMat4("view", view);
-        int i = 0;
-        for (auto body : bdies)
+        if (!galaxy)
         {
-            model = drawSphere(body.getPosition(), body.getRadius());
-            model = glm::rotate(model, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-            model = glm::rotate(model, currentFrame, glm::vec3(0.0f, 1.0f, 0.0f));
-            
-            sphereShader.setMat4("model", model);
-            // sphereShader.setVec3("material.diffuse", body.getColor());
-            
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, diffuseTextureIds[i]);
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, specularTextureIds[i]);
-
-            glBindVertexArray(VAO);
-            glDrawElements(GL_TRIANGLES, X_SEGMENTS * Y_SEGMENTS * 6, GL_UNSIGNED_INT, 0);
-            i++;
+            // all bodies in two calls, the shaders build their model matrices: meshes for
+            // the ones close enough to show their facets, impostors for the rest
+            sphereInstances.clear();
+            impostorInstances.clear();
+            for (size_t i = 0; i < bdies.size(); i++)
+            {
+                SphereInstance instance;
+                instance.center = cvtVec3Lp(bdies[i].getPosition());
+                instance.radius = (float)bdies[i].getRadius();
+                instance.spin = currentFrame;
+                instance.layer = (float)(surfaces == SURFACE_TEXTURES ? i % PLANET_TEXTURES : i);
+                instance.glow = lightClusters->getGlow(i);
+                float distance = glm::length(instance.center - camera.Position);
+                bool impostor = distance > 2.0f * instance.radius && instance.radius / distance * pixels < IMPOSTOR_PIXELS;
+                (impostor ? impostorInstances : sphereInstances).push_back(instance);
+            }
+            size_t meshes = sphereInstances.size();
+            sphereInstances.insert(sphereInstances.end(), impostorInstances.begin(), impostorInstances.end());
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+            glBufferData(GL_ARRAY_BUFFER, sphereInstances.size() * sizeof(SphereInstance), sphereInstances.data(), GL_STREAM_DRAW);
+
+            if (surface == SURFACE_TEXTURES)
+            {
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D_ARRAY, textureLoader->get(diffuseTextures));
+                glActiveTexture(GL_TEXTURE1);
+                glBindTexture(GL_TEXTURE_2D_ARRAY, textureLoader->get(specularTextures));
+            }
+            else if (surface == SURFACE_BAKED)
+            {
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D_ARRAY, surfaceCache->getTexture());
+            }
+            lightClusters->bind(LIGHT_UNIT);
+
+            if (meshes)
+            {
+                sphereShader.use();
+                sphereShader.setInt("surfaces", surface);
+                glBindVertexArray(VAO);
+                glDrawElementsInstanced(GL_TRIANGLES, X_SEGMENTS * Y_SEGMENTS * 6, GL_UNSIGNED_INT, 0, meshes);
+            }
+            if (!impostorInstances.empty())
+            {
+                impostorShader.use();
+                impostorShader.setInt("surfaces", surface);
+                glBindVertexArray(impostorVAO);
+                glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+                size_t first = meshes * sizeof(SphereInstance);
+                glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(SphereInstance), (void*)first);  // center, radius
+                glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(SphereInstance), (void*)(first + offsetof(SphereInstance, spin)));  // spin, layer, glow
+                glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, impostorInstances.size());
+            }
         }
 
         // draw path
         // ---------
-        vector<vector<glm::dvec3>> paths = bodySystem.getPaths();
-        
-        pathShader.use();
-        pathShader.setMat4("projection", projection);
-        pathShader.setMat4("view", view);
-
-        int k = 1;
-        for (auto pos : paths)
+        if (lazyTrails || (mode == REPLAY && !replayAll))
         {
-            int i = 0;
-            for (auto body : bdies)
+            trailBodies.clear();
+            // the nearest bodies in front of the camera
+            vector<pair<float, size_t>> visible;
+            for (size_t b = 0; b < shown.size(); b++)
             {
-                // pathShader.setVec3("ourColor", k*1.0f/PATH_LENGTH*body.getColor());
-                pathShader.setVec3("ourColor", k*1.0f/PATH_LENGTH*glm::vec3(0.5f));
-
-                model = glm::mat4(1.0f);
-                model = glm::translate(model, cvtVec3Lp(pos[i]));
-                model = glm::scale(model, glm::vec3(0.05f));
-                pathShader.setMat4("model", model);
-                
-                glBindVertexArray(pathVAO);
-                glDrawArrays(GL_TRIANGLES, 0, 12 * 3);
-
-                i++;
+                glm::vec4 clip = projection * view * glm::vec4(cvtVec3Lp(shown[b].getPosition()), 1.0f);
+                if (clip.w > 0.0f && fabs(clip.x) <= clip.w && fabs(clip.y) <= clip.w)
+                    visible.push_back(make_pair(clip.w, b));
             }
-            k++;
+            size_t nearest = min(visible.size(), LAZY_TRAIL_BODIES);
+            partial_sort(visible.begin(), visible.begin() + nearest, visible.end());
+            for (size_t k = 0; k < nearest; k++)
+                trailBodies.push_back(visible[k].second);
+            if (lazyTrails) simulation.showTrails(trailBodies, LAZY_TRAIL_FRAMES);
         }
 
-        for (auto point : pointLightPositions)
-        {
-            pathShader.setVec3("ourColor", glm::vec3(1.0f));
-
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, point);
-            model = glm::scale(model, glm::vec3(0.5f));
-            pathShader.setMat4("model", model);
-            
-            glBindVertexArray(pathVAO);
-            glDrawArrays(GL_TRIANGLES, 0, 12 * 3);
-        }
-        
+        trailRenderer->draw(trailShader, trailCount);
+
+
         // draw skybox as last
         // -------------------
         glDepthFunc(GL_LEQUAL);
         skyboxShader.use();
-        view = glm::mat4(glm::mat3(camera.GetViewMatrix()));
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("projection", projection);
 
         glBindVertexArray(skyboxVAO);
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, textureLoader->get(cubemapTexture));
         glDrawArrays(GL_TRIANGLES, 0, 36);
         glBindVertexArray(0);
         glDepthFunc(GL_LESS);
 
+        // stars glow over everything else
+        // -------------------------------
+        if (galaxy) galaxyRenderer->draw(galaxyShader, tonemapShader, width, height, pixels);
+
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
+    simulation.stop();
+
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
     glDeleteVertexArrays(1, &VAO);
-    glDeleteVertexArrays(1, &pathVAO);
     glDeleteVertexArrays(1, &skyboxVAO);
     glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1, &pathVBO);
+    glDeleteBuffers(1, &instanceVBO);
+    glDeleteVertexArrays(1, &impostorVAO);
+    glDeleteBuffers(1, &impostorVBO);
+    trailRenderer.reset();
+    galaxyRenderer.reset();
+    frameUniforms.reset();
+    lightClusters.reset();
+    textureLoader.reset();
+    surfaceCache.reset();
     glDeleteBuffers(1, &skyboxVBO);
 
+    if (recorder)
+    {
+        recorder->close();
+        TrajectoryStats stats = recorder->getStats();
+        cout << "Trajectory: " << stats.rawBytes << " bytes raw, " << stats.storedBytes << " stored";
+        if (stats.encodeSeconds > 0.0)
+            cout << ", ratio " << (double)stats.rawBytes / stats.storedBytes << ", encoded at " << stats.rawBytes / stats.encodeSeconds / 1e6 << " MB/s";
+        cout << endl;
+    }
+
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();
@@ -657,59 +839,6 @@ vector<int> createSphereIndices()
     return sphereIndices;
 }
 
-vector<Body> creatBodies(int n)
-{
-    vector<Body> bodies;
-    for (int i = 0; i < n; i++)
-    {
-        // [-10, 10]
-        double px = rand() % 100 / 100.0 * 20 - 10;
-        double py = rand() % 100 / 100.0 * 20 - 10;
-        double pz = rand() % 100 / 100.0 * 20 - 10;
-        
-        // [-10, 10]
-        double vx = rand() % 100 / 100.0 * 20 - 10;
-        double vy = rand() % 100 / 100.0 * 20 - 10;
-        double vz = rand() % 100 / 100.0 * 20 - 10;
-
-        float r = vx / 20 + 0.5;
-        float g = vy / 20 + 0.5;
-        float b = vz / 20 + 0.5;
-
-        Body body(1.0, 1.0, glm::vec3(r, g, b), glm::dvec3(px, py, pz), glm::dvec3(vx, vy, vz));
-        bodies.push_back(body);
-    }
-    return bodies;
-}
-
-glm::mat4 drawSphere(glm::dvec3 center_hp, double radius_hp)
-{
-    glm::vec3 center = cvtVec3Lp(center_hp);
-    float radius = (float)radius_hp;
-
-    glm::mat4 model = glm::mat4(1.0f);
-
-    model = glm::translate(model, center);
-    model = glm::scale(model, glm::vec3(radius));
-
-    return model;
-}
-
-glm::mat4 cvtMat4Lp(glm::dmat4 mat4Hp)
-{
-    glm::mat4 mat4Lp;
-    
-    for (int i = 0; i < 4; i++)
-    {
-        for (int j = 0; j < 4; j++)
-        {
-            mat4Lp[i][j] = (float)mat4Hp[i][j];
-        }
-    }
-
-    return mat4Lp;
-}
-
 glm::vec3 cvtVec3Lp(glm::dvec3 vec3Hp)
 {
     glm::vec3 vec3Lp;
@@ -742,6 +871,43 @@ void processInput(GLFWwindow* window)
         tPerFrame *= 1.01;
     if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS)
         tPerFrame /= 1.01;
+
+    scrubDirection = 0;
+    if (glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS)
+        scrubDirection = -1;
+    if (glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS)
+        scrubDirection = 1;
+
+    // replay, toggles act on the key press only
+    static bool spaceDown = false, rDown = false;
+    bool space = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS;
+    bool r = glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS;
+    if (space && !spaceDown)
+        replayPaused = !replayPaused;
+    if (r && !rDown)
+        replayDirection = -replayDirection;
+    spaceDown = space;
+    rDown = r;
+
+    // holding LEFT or RIGHT runs through the whole recording in 4 seconds
+    if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
+        replaySeek -= 0.25 * deltaTime;
+    if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
+        replaySeek += 0.25 * deltaTime;
+    if (glfwGetKey(window, GLFW_KEY_HOME) == GLFW_PRESS)
+        replaySeek = -1.0;
+    if (glfwGetKey(window, GLFW_KEY_END) == GLFW_PRESS)
+        replaySeek = 1.0;
+
+    static bool commaDown = false, periodDown = false;
+    bool comma = glfwGetKey(window, GLFW_KEY_COMMA) == GLFW_PRESS;
+    bool period = glfwGetKey(window, GLFW_KEY_PERIOD) == GLFW_PRESS;
+    if (comma && !commaDown)
+        trailLength = max(trailLength / 2, TRAIL_MIN);
+    if (period && !periodDown)
+        trailLength = min(trailLength * 2, TRAIL_MAX);
+    commaDown = comma;
+    periodDown = period;
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -775,96 +941,3 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
     camera.ProcessMouseScroll(yoffset);
 }
-
-// utility function for loading a 2D texture from file
-// ---------------------------------------------------
-unsigned int loadTexture(char const * path)
-{
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    // stbi_set_flip_vertically_on_load(true);
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
-}
-
-// loads a cubemap texture from 6 individual texture faces
-// order:
-// +X (right)
-// -X (left)
-// +Y (top)
-// -Y (bottom)
-// +Z (front) 
-// -Z (back)
-// -------------------------------------------------------
-unsigned int loadCubemap(vector<std::string> faces)
-{
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-    int width, height, nrChannels;
-    for (unsigned int i = 0; i < faces.size(); i++)
-    {
-        unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    return textureID;
-}
-
-vector<unsigned int> loadTextures(const int n, const char* rootPath, const char* textureType)
-{
-    vector<unsigned int> textureIds;
-    for (int i = 1; i < n + 1; i++)
-    {
-        char filePath[64];
-        sprintf(filePath, "%s%.2d_%s.png", rootPath, i, textureType);
-
-        unsigned int textureId = loadTexture(filePath);
-        textureIds.push_back(textureId);
-    }
-    return textureIds;
-}
\ No newline at end of file